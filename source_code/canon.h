@@ -0,0 +1,456 @@
+/*
+ * CANON - Shared declarations
+ *
+ * Author: Francesco Pedulli
+ * Date: February 26, 2026
+ *
+ * Core GF(2) basis engine (canon_optimal.c) plus the entry points of
+ * the auxiliary modes built on top of it.
+ */
+
+#ifndef CANON_H
+#define CANON_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define MAX_RANK 65536  // Maximum basis size (64KB)
+#define CHUNK_SIZE 4096 // Process in 4KB chunks
+#define CANON_BLOCK_SIZE (1u << 20) // Progress granularity (1MB)
+#define CANON_MAX_INPUT (1ull << 32) // Derivations are uint32_t input positions
+
+/*
+ * GF(2) Basis Structure
+ * Represents the canonical form (what survives closure)
+ */
+typedef struct {
+    uint8_t *basis;           // Basis elements (size rank)
+    uint32_t rank;            // Number of linearly independent elements
+    uint32_t *derivation;     // How each position derives from basis
+    uint64_t *span_signature; // Fast span membership testing
+    uint64_t input_size;      // Input bytes covered (0 if unknown)
+    void *mapping;            // basis/derivation point into this read-only
+    uint64_t mapping_len;     // file mapping (canon_map_compressed); NULL if owned
+} GF2_Basis;
+
+/*
+ * On-disk layout, version 2
+ * Little-endian. Every section starts on a CANON_ALIGN boundary, so a
+ * mapped file can be used in place. The checksum table covers all
+ * bytes before it, header included.
+ */
+#define CANON_V2_MAGIC "CNV2"
+#define CANON_VERSION 2
+#define CANON_ALIGN 64
+#define CANON_FLAG_INPUT_SIZE 1u    // input_size is recorded
+
+typedef struct {
+    char magic[4];              // CANON_V2_MAGIC
+    uint16_t version;           // CANON_VERSION
+    uint16_t width;             // Bits per basis element
+    uint32_t flags;             // CANON_FLAG_*; readers reject unknown bits
+    uint32_t rank;
+    uint64_t input_size;
+    uint64_t basis_offset;      // rank elements of width bits
+    uint64_t derivation_offset; // rank uint32_t input positions
+    uint64_t checksum_offset;   // crc_count CRC32C, one per crc_block bytes before it
+    uint32_t crc_block;
+    uint32_t crc_count;
+    uint8_t reserved[8];
+} CanonHeader;
+
+_Static_assert(sizeof(CanonHeader) == CANON_ALIGN, "CanonHeader is one aligned block");
+
+// Version 1 (read only): "CANON", rank, basis, derivation map, then optional
+// trailers
+#define CANON_SIZE_MAGIC "CNSZ" // Trailer: magic + uint64 input_size
+
+/*
+ * Statistics for analysis
+ */
+typedef struct {
+    uint64_t input_size;
+    uint64_t basis_size;
+    uint64_t derivation_size;
+    double compression_ratio;
+    double time_seconds;
+    uint32_t rank;
+} CompressionStats;
+
+/* canon_optimal.c - core engine */
+GF2_Basis* basis_init(void);
+void basis_reset(GF2_Basis *B);
+void basis_trim(GF2_Basis *B);
+void basis_rebuild_signature(GF2_Basis *B);
+void basis_free(GF2_Basis *B);
+bool in_span(uint8_t x, GF2_Basis *B);
+bool add_to_basis(GF2_Basis *B, uint8_t x, uint32_t position);
+void canon_compress_block(GF2_Basis *B, const uint8_t *data, uint64_t size,
+                          uint64_t offset);
+bool canon_input_fits(const char *name, uint64_t size);
+GF2_Basis* canon_compress(const uint8_t *data, uint64_t size);
+uint64_t canon_reconstruct(const GF2_Basis *B, uint64_t from, uint64_t len,
+                           uint8_t *out, uint8_t *known);
+uint64_t canon_reconstructed_size(const GF2_Basis *B);
+uint8_t* canon_decompress(GF2_Basis *B, uint64_t *output_size);
+CompressionStats compute_stats(uint64_t input_size, GF2_Basis *B, double time_sec);
+void print_stats(CompressionStats stats);
+uint64_t canon_encoded_size(const GF2_Basis *B);
+uint64_t canon_encode(const GF2_Basis *B, uint8_t *out);
+GF2_Basis* canon_decode(const uint8_t *in, uint64_t len, const char *name);
+bool save_compressed(const char *filename, GF2_Basis *B);
+GF2_Basis* load_compressed(const char *filename);
+GF2_Basis* canon_map_compressed(const char *filename);
+uint8_t* read_file(const char *filename, uint64_t *size);
+
+/* canon_matrix.c - dense bit-packed GF(2) matrices and windows */
+#define CANON_MAT_ALIGN 64
+
+typedef struct {
+    uint32_t nrows, ncols;  // Entries; ncols bits per row
+    uint32_t stride;        // uint64_t words from one row to the next
+    uint64_t *rows;         // Row 0; column c is bit c % 64 of word c / 64
+    uint64_t *block;        // Owned storage, NULL for a window
+} GF2Matrix;
+
+GF2Matrix* canon_mat_new(uint32_t nrows, uint32_t ncols);
+void canon_mat_free(GF2Matrix *M);
+GF2Matrix canon_mat_window(const GF2Matrix *M, uint32_t row, uint32_t col,
+                           uint32_t nrows, uint32_t ncols);
+void canon_mat_zero(GF2Matrix *M);
+void canon_mat_copy(GF2Matrix *dst, const GF2Matrix *src);
+void canon_mat_add(GF2Matrix *C, const GF2Matrix *A, const GF2Matrix *B);
+bool canon_mat_equal(const GF2Matrix *A, const GF2Matrix *B);
+void canon_mat_random(GF2Matrix *M, uint64_t seed);
+void canon_mat_swap_rows(GF2Matrix *M, uint32_t a, uint32_t b);
+void canon_mat_transpose(GF2Matrix *dst, const GF2Matrix *src);
+GF2Matrix* canon_mat_from_basis(const GF2_Basis *B);
+int canon_matrix_main(int argc, char **argv);
+
+static inline uint64_t* canon_mat_row(const GF2Matrix *M, uint32_t r) {
+    return M->rows + (size_t)r * M->stride;
+}
+
+static inline uint32_t canon_mat_words(const GF2Matrix *M) {
+    return (M->ncols + 63) / 64;
+}
+
+// Bits of a row's last word that belong to the matrix
+static inline uint64_t canon_mat_last_mask(const GF2Matrix *M) {
+    return M->ncols % 64 ? (1ull << (M->ncols % 64)) - 1 : ~0ull;
+}
+
+static inline bool canon_mat_get(const GF2Matrix *M, uint32_t r, uint32_t c) {
+    return (canon_mat_row(M, r)[c / 64] >> (c % 64)) & 1;
+}
+
+static inline void canon_mat_set(GF2Matrix *M, uint32_t r, uint32_t c, bool bit) {
+    uint64_t *w = &canon_mat_row(M, r)[c / 64];
+    *w = (*w & ~(1ull << (c % 64))) | ((uint64_t)bit << (c % 64));
+}
+
+/* canon_m4ri.c - Method of Four Russians echelon form, rank and product */
+typedef struct CanonPool CanonPool;     // canon_pool.c
+
+uint32_t canon_m4ri_opt_k(uint32_t nrows, uint32_t ncols);
+uint32_t canon_m4ri_echelon(GF2Matrix *A, bool full, uint32_t k, uint32_t *pivots);
+uint32_t canon_m4ri_echelon_pool(CanonPool *pool, GF2Matrix *A, bool full, uint32_t k, uint32_t *pivots);
+uint32_t canon_m4ri_rank(const GF2Matrix *A);
+void canon_mat_addmul_m4rm(GF2Matrix *C, const GF2Matrix *A, const GF2Matrix *B);
+
+/* canon_mul.c - Strassen-Winograd multiplication over the M4RM kernel */
+#define CANON_MUL_CUTOFF 8192   // Smallest dimension still split into 2 x 2 blocks
+
+void canon_mat_addmul(GF2Matrix *C, const GF2Matrix *A, const GF2Matrix *B);
+void canon_mat_addmul_cutoff(GF2Matrix *C, const GF2Matrix *A, const GF2Matrix *B, uint32_t cutoff);
+
+/* canon_pluq.c - recursive PLUQ factorization and triangular solves */
+#define CANON_PLUQ_PANEL 512    // Columns copied to a contiguous panel (one cache line per row)
+
+uint32_t canon_pluq(GF2Matrix *A, uint32_t *rows, uint32_t *cols);
+void canon_mat_trsm_lower(const GF2Matrix *L, GF2Matrix *B);
+void canon_mat_trsm_upper(const GF2Matrix *U, GF2Matrix *B);
+bool canon_pluq_solve(const GF2Matrix *LU, uint32_t rank, const uint32_t *rows, const uint32_t *cols,
+                      const GF2Matrix *B, GF2Matrix *X);
+
+/* canon_serve.c - resident daemon over a Unix domain socket */
+#define SERVE_REQUEST_MAGIC  "CNRQ"
+#define SERVE_RESPONSE_MAGIC "CNRS"
+
+#define SERVE_OP_COMPRESS 1 // Body: canon_encode() output
+#define SERVE_OP_ESTIMATE 2 // Body: empty, rank only
+
+#define SERVE_STATUS_OK           0
+#define SERVE_STATUS_BAD_REQUEST -1
+#define SERVE_STATUS_TOO_LARGE   -2
+#define SERVE_STATUS_BAD_OP      -3
+
+typedef struct {
+    char magic[4];       // SERVE_REQUEST_MAGIC
+    uint32_t op;         // SERVE_OP_*
+    uint64_t size;       // Payload bytes that follow
+} ServeRequest;
+
+typedef struct {
+    char magic[4];       // SERVE_RESPONSE_MAGIC
+    int32_t status;      // SERVE_STATUS_*
+    uint32_t rank;
+    uint32_t reserved;
+    uint64_t input_size;
+    uint64_t elapsed_ns; // Server-side processing time
+    uint64_t body_size;  // Body bytes that follow
+} ServeResponse;
+
+int canon_serve_main(int argc, char **argv);
+int canon_request_main(int argc, char **argv);
+int canon_serve_connect(const char *path);
+bool canon_serve_call(int fd, uint32_t op, const uint8_t *data, uint64_t size,
+                      ServeResponse *resp, uint8_t **body);
+
+/* canon_ring.c - shared-memory ring ingestion */
+typedef struct RingProducer RingProducer;
+
+typedef struct {
+    uint32_t slot;
+    int32_t status;       // SERVE_STATUS_*
+    uint32_t rank;
+    uint64_t tag;         // Cookie passed to canon_ring_submit()
+    uint64_t size;        // Encoded result bytes at data
+    uint64_t elapsed_ns;
+    const uint8_t *data;  // Result, in place in the slot
+} RingResult;
+
+int canon_ring_main(int argc, char **argv);
+int canon_ring_submit_main(int argc, char **argv);
+RingProducer* canon_ring_attach(const char *socket_path);
+void canon_ring_detach(RingProducer *p);
+uint64_t canon_ring_slot_size(const RingProducer *p);
+uint8_t* canon_ring_acquire(RingProducer *p, uint32_t *slot);
+bool canon_ring_submit(RingProducer *p, uint32_t slot, uint64_t size, uint64_t tag);
+bool canon_ring_poll(RingProducer *p, RingResult *r);
+void canon_ring_release(RingProducer *p, uint32_t slot);
+
+/* canon_batch.c - coalescing batch front end for tiny inputs */
+#define BATCH_MAX_MESSAGE 4096 // Longer messages take the scalar path
+
+typedef struct CanonBatcher CanonBatcher;
+
+typedef void (*BatchCallback)(uint64_t tag, const GF2_Basis *B,
+                              uint64_t latency_ns, void *user);
+
+typedef struct {
+    uint32_t max_batch;     // Flush once this many messages are pending
+    uint64_t max_delay_ns;  // Flush once the oldest has waited this long
+    BatchCallback callback; // Called from the flusher thread
+    void *user;
+} BatchConfig;
+
+void canon_compress_many(const uint8_t *const *data, const uint64_t *sizes,
+                         uint32_t count, GF2_Basis **out);
+CanonBatcher* canon_batcher_create(const BatchConfig *cfg);
+bool canon_batcher_submit(CanonBatcher *b, const uint8_t *data, uint64_t size,
+                          uint64_t tag);
+void canon_batcher_destroy(CanonBatcher *b);
+int canon_batch_lines_main(int argc, char **argv);
+
+/* canon_metrics.c - per-thread latency histograms, Prometheus export */
+typedef enum {
+    METRIC_COMPRESS,
+    METRIC_DECOMPRESS,
+    METRIC_LOAD,
+    METRIC_SAVE,
+    METRIC_ESTIMATE,
+    METRIC_OP_COUNT
+} CanonMetricOp;
+
+extern bool canon_metrics_enabled;
+
+void canon_metrics_init(void);
+uint64_t canon_metrics_now(void);
+void canon_metrics_record(CanonMetricOp op, uint64_t latency_ns,
+                          uint64_t bytes_in, uint64_t bytes_out);
+void canon_metrics_write(FILE *f);
+bool canon_metrics_write_file(const char *path);
+
+/* canon_trace.c - workload trace capture and replay */
+void canon_trace_init(void);
+uint64_t canon_trace_clock(void);
+void canon_trace_record(CanonMetricOp mode, uint64_t start_ns, uint64_t input_size,
+                        uint64_t output_size, uint32_t rank, uint64_t compute_ns,
+                        uint64_t total_ns);
+int canon_replay_main(int argc, char **argv);
+
+/* canon_queue.c - priority- and deadline-aware job queue */
+int canon_queue_main(int argc, char **argv);
+
+/* canon_huge.c - 2 MB page backing for inputs and buffers */
+#define CANON_HUGE_PAGE (1u << 21)
+#define CANON_HUGE_OFF     0
+#define CANON_HUGE_THP     1   // madvise(MADV_HUGEPAGE), best effort
+#define CANON_HUGE_HUGETLB 2   // MAP_HUGETLB reserved pool, thp fallback
+
+bool canon_huge_option(const char *value);
+int canon_huge_mode(void);
+void* canon_huge_alloc(size_t len);
+void canon_huge_free(void *p, size_t len);
+const uint8_t* canon_huge_map_file(int fd, uint64_t size);
+void canon_huge_unmap_file(const uint8_t *p, uint64_t size);
+void canon_huge_drop(const void *p, size_t len);
+void canon_huge_report(FILE *out);
+
+/* canon_numa.c - NUMA topology, placement and pinning (no libnuma) */
+#define CANON_MAX_NODES 64
+
+int canon_numa_nodes(void);
+int canon_numa_worker_cpu(int worker);
+int canon_numa_cpu_node(int cpu);
+bool canon_numa_pin(int cpu, bool single_cpu);
+int canon_numa_page_node(const void *addr);
+bool canon_numa_bind(void *addr, size_t len, int node);
+
+/* canon_cache.c - content-hash keyed result cache */
+#define CANON_CACHE_SIZE (1ull << 30) // Default size bound
+
+typedef struct CanonCache CanonCache;
+
+uint64_t canon_hash64(const uint8_t *data, uint64_t len);
+bool canon_cache_hash_file(const char *path, uint64_t *hash, uint64_t *size);
+CanonCache* canon_cache_open(const char *dir, uint64_t max_bytes);
+GF2_Basis* canon_cache_get(CanonCache *c, uint64_t hash, uint64_t size);
+bool canon_cache_put(CanonCache *c, uint64_t hash, uint64_t size, const GF2_Basis *B);
+void canon_cache_report(CanonCache *c, FILE *out);
+void canon_cache_close(CanonCache *c);
+
+/* canon_crc.c - CRC32C block checksums (SSE4.2 + PCLMUL) */
+#define CANON_CRC_MAGIC "CNCK"           // Version 1 trailer: magic + block size + count + CRC32C each
+#define CANON_CRC_BLOCK (1u << 16)       // Bytes covered by one checksum
+#define CANON_CRC_PARALLEL (4u << 20)    // Verify on another thread per this many bytes
+
+uint32_t canon_crc32c(uint32_t crc, const void *data, size_t len);
+uint32_t canon_crc_blocks(uint64_t len);
+void canon_crc_sign(const uint8_t *data, uint64_t len, uint32_t *sums);
+int64_t canon_crc_verify(const uint8_t *data, uint64_t len, const uint32_t *sums);
+
+/* canon_verify.c - parallel round-trip verification against the original */
+#define CANON_VERIFY_BLOCK (4u << 20) // Default bytes per verify task
+
+int canon_verify_main(int argc, char **argv);
+
+/* canon_append.c - extend an existing .canon with new input */
+bool canon_append_file(const char *archive, const char *input, uint64_t from);
+int canon_append_main(int argc, char **argv);
+
+/* canon_pool.c - work-stealing thread pool and many-file compression */
+typedef void (*CanonTaskFn)(CanonPool *pool, void *arg);
+
+typedef struct {
+    const char *input;
+    const char *output;     // NULL: compress only, nothing written
+    uint64_t size;          // Size hint on entry (largest first), real size after
+    uint32_t rank;
+    uint64_t encoded;       // canon_encoded_size() of the result
+    bool failed;
+    uint64_t compute_ns;    // Elimination time summed over chunks
+    uint64_t start_ns, done_ns;
+    GF2_Basis *basis;       // Set when keep_bases (trimmed, read-only); caller frees
+    bool cached;            // Result came from the cache
+    uint64_t hash;          // Content hash, when a cache is in use
+} CanonFileJob;
+
+enum { CANON_IO_MMAP, CANON_IO_URING, CANON_IO_THREADS };
+
+typedef struct {
+    uint64_t chunk;         // Files larger than this become chunk tasks
+    bool split;             // Eliminate chunks independently, then merge
+    bool keep_bases;
+    int io;                 // CANON_IO_*: mmap, or the async read/write loop
+    uint32_t queue_depth;   // Async I/O: buffers (reads) in flight
+    bool pin;               // One CPU per pool worker
+    const char *cache_dir;  // Content-addressed result cache, NULL = off
+    uint64_t cache_size;    // Its size bound in bytes (0 = default)
+} CanonFilesConfig;
+
+#define CANON_FILES_DEFAULTS { CANON_BLOCK_SIZE * 4ull, false, false, CANON_IO_MMAP, 64, false, \
+                               NULL, 0 }
+#define CANON_POOL_PIN 1u
+
+CanonPool* canon_pool_create(int threads, unsigned flags);
+void canon_pool_submit(CanonPool *pool, CanonTaskFn fn, void *arg);
+void canon_pool_submit_node(CanonPool *pool, int node, CanonTaskFn fn, void *arg);
+void canon_pool_wait(CanonPool *pool);
+int canon_pool_threads(const CanonPool *pool);
+int canon_pool_worker(const CanonPool *pool);
+void canon_pool_report(CanonPool *pool, FILE *f);
+void canon_pool_destroy(CanonPool *pool);
+int canon_compress_files(CanonPool *pool, CanonFileJob *jobs, uint32_t n,
+                         const CanonFilesConfig *cfg);
+bool canon_files_option(CanonFilesConfig *cfg, int *threads, int argc, char **argv, int *i);
+int canon_compress_many_main(int argc, char **argv);
+
+/* canon_io.c - io_uring / thread-pool asynchronous batch I/O */
+void canon_io_compress_files(CanonPool *pool, CanonFileJob **order, uint32_t n,
+                             const CanonFilesConfig *cfg);
+
+/* canon_checkpoint.c - periodic checkpoints and --resume for compress */
+#define CANON_CHECKPOINT_EVERY (1ull << 30) // Default interval with --resume
+
+typedef struct {
+    const char *path;       // Sidecar file, NULL = no checkpoints
+    uint64_t every;         // Input bytes between checkpoints
+    bool resume;            // Continue from path if it validates
+} CanonCheckpointConfig;
+
+typedef struct {
+    uint64_t input_size;
+    int64_t input_mtime_ns;
+    uint64_t offset;        // Input bytes eliminated
+    uint64_t position;      // Derivation position reached (stream bytes)
+    uint64_t last_saved;    // Offset of the last checkpoint written
+} CanonCheckpoint;
+
+bool canon_checkpoint_start(const CanonCheckpointConfig *cfg, int input_fd,
+                            GF2_Basis **B, CanonCheckpoint *c);
+void canon_checkpoint_update(const CanonCheckpointConfig *cfg, int input_fd,
+                             const GF2_Basis *B, CanonCheckpoint *c,
+                             uint64_t offset, uint64_t position);
+void canon_checkpoint_finish(const CanonCheckpointConfig *cfg);
+
+/* canon_direct.c - O_DIRECT multi-buffered reader for large single files */
+GF2_Basis* canon_compress_direct(const char *path, uint32_t nbuf,
+                                 const CanonCheckpointConfig *ckpt);
+
+/* canon_pipeline.c - staged read/transform/eliminate/encode/write pipeline */
+typedef struct CanonPipeline CanonPipeline;
+typedef bool (*CanonTransformFn)(uint8_t *data, uint64_t *len, uint64_t capacity, void *user);
+
+typedef struct {
+    uint32_t blocks;        // 1 MB block buffers shared by all stages
+    int read_workers;
+    CanonCheckpointConfig checkpoint;
+} CanonPipelineConfig;
+
+CanonPipeline* canon_pipeline_create(const CanonPipelineConfig *cfg);
+bool canon_pipeline_add_transform(CanonPipeline *p, const char *name,
+                                  CanonTransformFn fn, void *user, int workers);
+GF2_Basis* canon_pipeline_run(CanonPipeline *p, const char *input, const char *output,
+                              bool *saved);
+void canon_pipeline_report(CanonPipeline *p, FILE *f);
+void canon_pipeline_destroy(CanonPipeline *p);
+
+/* canon_dir.c - directory / file-list batch mode with a corpus basis */
+bool canon_make_parents(char *path);
+GF2_Basis* canon_corpus_merge(const CanonFileJob *jobs, uint32_t n);
+int canon_compress_dir_main(int argc, char **argv);
+
+/* canon_archive.c - multi-member archive with a central directory */
+#define CANON_ARCHIVE_MAGIC "CNAR"     // Header: magic + version
+#define CANON_ARCHIVE_DIR_MAGIC "CNDR" // Footer at end of file, locates the directory
+#define CANON_ARCHIVE_VERSION 1
+
+bool canon_safe_name(const char *name);
+int canon_pack_main(int argc, char **argv);
+int canon_unpack_main(int argc, char **argv);
+int canon_list_main(int argc, char **argv);
+
+#endif /* CANON_H */
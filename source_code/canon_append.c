@@ -0,0 +1,186 @@
+/*
+ * CANON - Append mode for growing inputs
+ *
+ * Author: Francesco Pedulli
+ * Date: February 26, 2026
+ *
+ * `canon append <archive.canon> <input>` extends an archive of a file
+ * that has grown since (logs, journals). The archive's size trailer
+ * says how many input bytes it already covers; only the bytes after
+ * that are read and eliminated into the loaded basis. The cost is
+ * O(new bytes · r) instead of recompressing the whole input.
+ *
+ * The updated archive is written beside the old one, fsynced and renamed
+ * over it (as checkpoints, packs and cache entries are), so a crash at
+ * any point leaves either the old archive or the new one, never a mix.
+ * The derivation map moves whenever the basis section grows, so most
+ * of the file changes anyway. Version 1 archives are rewritten as
+ * version 2.
+ *
+ * The result is identical to compressing the grown input from scratch,
+ * since elimination is strictly in order.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "canon.h"
+
+static bool pwrite_all(int fd, const void *data, size_t len, uint64_t offset) {
+    const uint8_t *p = data;
+    while (len > 0) {
+        ssize_t k = pwrite(fd, p, len, (off_t)offset);
+        if (k < 0 && errno == EINTR) continue;
+        if (k <= 0) return false;
+        p += k;
+        len -= (size_t)k;
+        offset += (uint64_t)k;
+    }
+    return true;
+}
+
+/*
+ * Replace the archive with B's encoding: temporary file, fsync, rename
+ */
+static bool replace_archive(const char *archive, const GF2_Basis *B) {
+    struct stat st;
+    mode_t mode = stat(archive, &st) == 0 ? st.st_mode & 07777 : 0644;
+    size_t tlen = strlen(archive) + 5;
+    char *tmp = malloc(tlen);
+    snprintf(tmp, tlen, "%s.tmp", archive);
+
+    uint64_t len = canon_encoded_size(B);
+    uint8_t *enc = malloc(len);
+    canon_encode(B, enc);
+
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, mode);
+    bool ok = fd >= 0 &&
+              pwrite_all(fd, enc, len, 0) &&
+              fsync(fd) == 0;
+    if (fd >= 0 && close(fd) != 0) ok = false;
+    if (ok) ok = rename(tmp, archive) == 0;
+    if (!ok) {
+        perror("Error updating archive");
+        unlink(tmp);
+    }
+    free(enc);
+    free(tmp);
+    return ok;
+}
+
+/*
+ * Eliminate input bytes [from, end) into archive and update it
+ * from == UINT64_MAX takes the start from the archive's size trailer
+ */
+bool canon_append_file(const char *archive, const char *input, uint64_t from) {
+    GF2_Basis *B = load_compressed(archive);
+    if (!B) return false;
+    if (from == UINT64_MAX) {
+        if (B->input_size == 0 && B->rank > 0) {
+            fprintf(stderr, "Error: %s has no size trailer; pass --from OFFSET\n", archive);
+            basis_free(B);
+            return false;
+        }
+        from = B->input_size;
+    }
+
+    int fd = open(input, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        perror("Error opening input file");
+        if (fd >= 0) close(fd);
+        basis_free(B);
+        return false;
+    }
+    uint64_t size = (uint64_t)st.st_size;
+    if (size < from) {
+        fprintf(stderr, "Error: %s is %lu bytes but the archive covers %lu (truncated or rotated?)\n",
+                input, size, from);
+        close(fd);
+        basis_free(B);
+        return false;
+    }
+    if (!canon_input_fits(input, size)) {
+        close(fd);
+        basis_free(B);
+        return false;
+    }
+    if (size == from) {
+        printf("Nothing to append: %s still %lu bytes\n", input, size);
+        close(fd);
+        basis_free(B);
+        return true;
+    }
+    posix_fadvise(fd, (off_t)from, 0, POSIX_FADV_SEQUENTIAL);
+
+    // Loaded bases carry no signature; rebuild before extending
+    basis_rebuild_signature(B);
+    uint32_t old_rank = B->rank;
+    uint64_t t0 = canon_metrics_now();
+
+    uint8_t *buf = malloc(CANON_BLOCK_SIZE);
+    bool ok = true;
+    for (uint64_t offset = from; offset < size;) {
+        uint64_t want = size - offset < CANON_BLOCK_SIZE ? size - offset : CANON_BLOCK_SIZE;
+        ssize_t k = pread(fd, buf, want, (off_t)offset);
+        if (k < 0 && errno == EINTR) continue;
+        if (k <= 0) {
+            perror("Error reading input file");
+            ok = false;
+            break;
+        }
+        canon_compress_block(B, buf, (uint64_t)k, offset);
+        offset += (uint64_t)k;
+
+        // Progress indicator (every 1MB)
+        if (offset < size) {
+            printf("\rAppended: %lu MB, Rank: %u", (offset - from) >> 20, B->rank);
+            fflush(stdout);
+        }
+    }
+    free(buf);
+    close(fd);
+
+    if (ok) {
+        printf("\rAppended: %lu bytes (%lu -> %lu), Rank: %u -> %u\n",
+               size - from, from, size, old_rank, B->rank);
+        canon_metrics_record(METRIC_COMPRESS, canon_metrics_now() - t0, size - from,
+                             canon_encoded_size(B));
+        ok = replace_archive(archive, B);
+    }
+    basis_free(B);
+    return ok;
+}
+
+/*
+ * `canon append <archive.canon> <input> [--from OFFSET]`
+ */
+int canon_append_main(int argc, char **argv) {
+    if (argc < 3) {
+        fprintf(stderr, "Usage: canon append <archive.canon> <input> [--from OFFSET]\n");
+        return 1;
+    }
+    uint64_t from = UINT64_MAX;
+    for (int i = 3; i < argc; i++) {
+        if (strcmp(argv[i], "--from") == 0 && i + 1 < argc) {
+            from = strtoull(argv[++i], NULL, 10);
+        } else {
+            fprintf(stderr, "Error: Unknown option '%s'\n", argv[i]);
+            return 1;
+        }
+    }
+
+    printf("Appending: %s -> %s\n\n", argv[2], argv[1]);
+    if (!canon_append_file(argv[1], argv[2], from)) return 1;
+    printf("✓ Archive updated: %s\n", argv[1]);
+    return 0;
+}
@@ -0,0 +1,644 @@
+/*
+ * CANON - Multi-member archive with a central directory
+ *
+ * Author: Francesco Pedulli
+ * Date: February 26, 2026
+ *
+ * `canon pack` compresses many inputs on the work-stealing pool and
+ * stores the results as members of one archive; `canon unpack` and
+ * `canon list` read it back. Unlike a tarball of .canon files, every
+ * member can be found and extracted on its own, and all of them can be
+ * extracted at once in parallel.
+ *
+ * Layout:
+ *   header     "CNAR", version, reserved (16 bytes)
+ *   members    canon_encode() output each, CANON_ALIGN aligned
+ *   directory  one ArchiveEntry per member, each followed by its name
+ *   footer     "CNDR", count, directory offset/length/CRC32C (32 bytes)
+ *
+ * Readers start from the fixed-size footer, check the directory's CRC,
+ * and then need one pread per member. Member bytes are identical to the
+ * .canon file compress would write, so they carry their own block
+ * checksums on top of the member CRC kept in the directory. That CRC
+ * covers the bytes the block checksums sign, not the table itself: a
+ * CRC over data followed by its own CRC is the same for every input.
+ *
+ * With --corpus the member bases are also merged into a corpus basis
+ * (as in compress-dir), stored as a dictionary entry; every member's
+ * dictionary ID then names it. ID 0 means no dictionary.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "canon.h"
+
+#define ARCHIVE_DICT 1u   // Entry flag: a dictionary, not an input
+#define ARCHIVE_ALIGN CANON_ALIGN   // Members keep their sections aligned
+#define CORPUS_NAME ".corpus"
+
+typedef struct {
+    char magic[4];          // CANON_ARCHIVE_MAGIC
+    uint32_t version;
+    uint64_t reserved;
+} ArchiveHeader;
+
+typedef struct {
+    uint64_t offset;        // Member bytes (canon_encode output)
+    uint64_t length;
+    uint64_t input_size;
+    uint32_t rank;
+    uint32_t crc;           // CRC32C of the member bytes before their checksum table
+    uint32_t dict_id;       // 1-based entry index of its dictionary, 0 = none
+    uint32_t flags;         // ARCHIVE_*
+    uint32_t name_len;      // Name bytes that follow, padded to ARCHIVE_ALIGN
+    uint32_t reserved;
+} ArchiveEntry;
+
+typedef struct {
+    char magic[4];          // CANON_ARCHIVE_DIR_MAGIC
+    uint32_t count;
+    uint64_t dir_offset;
+    uint64_t dir_length;
+    uint32_t dir_crc;
+    uint32_t version;
+} ArchiveFooter;
+
+typedef struct {
+    int fd;
+    uint32_t count;
+    ArchiveEntry *entries;
+    char **names;
+} Archive;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t align_up(uint64_t x) {
+    return (x + ARCHIVE_ALIGN - 1) & ~(uint64_t)(ARCHIVE_ALIGN - 1);
+}
+
+static bool pwrite_all(int fd, const void *data, size_t len, uint64_t offset) {
+    const uint8_t *p = data;
+    while (len > 0) {
+        ssize_t k = pwrite(fd, p, len, (off_t)offset);
+        if (k < 0 && errno == EINTR) continue;
+        if (k <= 0) return false;
+        p += k;
+        len -= (size_t)k;
+        offset += (uint64_t)k;
+    }
+    return true;
+}
+
+static bool pread_all(int fd, void *data, size_t len, uint64_t offset) {
+    uint8_t *p = data;
+    while (len > 0) {
+        ssize_t k = pread(fd, p, len, (off_t)offset);
+        if (k < 0 && errno == EINTR) continue;
+        if (k <= 0) return false;
+        p += k;
+        len -= (size_t)k;
+        offset += (uint64_t)k;
+    }
+    return true;
+}
+
+/*
+ * Member name for an input path: relative, without leading "./"
+ */
+static const char* member_name(const char *path) {
+    for (;;) {
+        if (path[0] == '/') {
+            path++;
+        } else if (path[0] == '.' && path[1] == '/') {
+            path += 2;
+        } else {
+            return path;
+        }
+    }
+}
+
+static int by_member_name(const void *a, const void *b) {
+    return strcmp(member_name(*(const char *const *)a), member_name(*(const char *const *)b));
+}
+
+/*
+ * Names must stay inside the extraction directory
+ */
+bool canon_safe_name(const char *name) {
+    if (name[0] == '\0' || name[0] == '/') return false;
+    for (const char *p = name; *p;) {
+        const char *end = strchr(p, '/');
+        size_t len = end ? (size_t)(end - p) : strlen(p);
+        if (len == 2 && p[0] == '.' && p[1] == '.') return false;
+        p += len;
+        while (*p == '/') p++;
+    }
+    return true;
+}
+
+/*
+ * Directory CRC of member bytes: everything up to the checksum table
+ */
+static uint32_t member_crc(const uint8_t *buf, uint64_t length) {
+    uint64_t end = length;
+    if (length >= sizeof(CanonHeader)) {
+        CanonHeader h;
+        memcpy(&h, buf, sizeof(h));
+        if (h.checksum_offset >= sizeof(h) && h.checksum_offset <= length) end = h.checksum_offset;
+    }
+    return canon_crc32c(0, buf, end);
+}
+
+/* ---- Reading ---- */
+
+static void archive_close(Archive *a) {
+    if (!a) return;
+    close(a->fd);
+    for (uint32_t i = 0; a->names && i < a->count; i++) free(a->names[i]);
+    free(a->names);
+    free(a->entries);
+    free(a);
+}
+
+/*
+ * Open an archive and load its directory
+ * Returns NULL (and reports why) if the footer or directory is damaged
+ */
+static Archive* archive_open(const char *path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        perror(path);
+        if (fd >= 0) close(fd);
+        return NULL;
+    }
+    uint64_t size = (uint64_t)st.st_size;
+
+    ArchiveHeader h;
+    ArchiveFooter f;
+    const char *why = NULL;
+    if (size < sizeof(h) + sizeof(f) || !pread_all(fd, &h, sizeof(h), 0) ||
+        memcmp(h.magic, CANON_ARCHIVE_MAGIC, 4) != 0) {
+        why = "not a CANON archive";
+    } else if (h.version != CANON_ARCHIVE_VERSION) {
+        why = "unsupported archive version";
+    } else if (!pread_all(fd, &f, sizeof(f), size - sizeof(f)) ||
+               memcmp(f.magic, CANON_ARCHIVE_DIR_MAGIC, 4) != 0 ||
+               f.dir_offset < sizeof(h) || f.dir_length > size - sizeof(f) - f.dir_offset) {
+        why = "missing or damaged footer (truncated?)";
+    }
+
+    uint8_t *dir = NULL;
+    if (!why) {
+        dir = malloc(f.dir_length ? f.dir_length : 1);
+        if (!pread_all(fd, dir, f.dir_length, f.dir_offset)) {
+            why = "cannot read directory";
+        } else if (canon_crc32c(0, dir, f.dir_length) != f.dir_crc) {
+            why = "directory checksum mismatch";
+        }
+    }
+    if (why) {
+        fprintf(stderr, "Error: %s: %s\n", path, why);
+        free(dir);
+        close(fd);
+        return NULL;
+    }
+
+    Archive *a = calloc(1, sizeof(Archive));
+    a->fd = fd;
+    a->count = f.count;
+    a->entries = calloc(f.count ? f.count : 1, sizeof(ArchiveEntry));
+    a->names = calloc(f.count ? f.count : 1, sizeof(char *));
+    uint64_t at = 0;
+    for (uint32_t i = 0; i < f.count; i++) {
+        ArchiveEntry *e = &a->entries[i];
+        if (f.dir_length - at < sizeof(ArchiveEntry)) break;
+        memcpy(e, dir + at, sizeof(ArchiveEntry));
+        at += sizeof(ArchiveEntry);
+        if (f.dir_length - at < e->name_len || e->offset > f.dir_offset ||
+            e->length > f.dir_offset - e->offset) {
+            break;
+        }
+        a->names[i] = strndup((const char *)dir + at, e->name_len);
+        at += align_up(e->name_len);
+    }
+    free(dir);
+    if (f.count && !a->names[f.count - 1]) {
+        fprintf(stderr, "Error: %s: corrupt directory entry\n", path);
+        archive_close(a);
+        return NULL;
+    }
+    return a;
+}
+
+static int archive_find(const Archive *a, const char *name) {
+    for (uint32_t i = 0; i < a->count; i++) {
+        if (strcmp(a->names[i], member_name(name)) == 0) return (int)i;
+    }
+    return -1;
+}
+
+/*
+ * Member i's bytes, checked against the directory CRC; NULL on error
+ */
+static uint8_t* archive_read_member(const Archive *a, uint32_t i, const char *path) {
+    const ArchiveEntry *e = &a->entries[i];
+    uint8_t *buf = malloc(e->length ? e->length : 1);
+    if (!pread_all(a->fd, buf, e->length, e->offset)) {
+        fprintf(stderr, "Error: %s: cannot read member %s\n", path, a->names[i]);
+        free(buf);
+        return NULL;
+    }
+    if (member_crc(buf, e->length) != e->crc) {
+        fprintf(stderr, "Error: %s: checksum mismatch in member %s (bytes %lu-%lu)\n",
+                path, a->names[i], e->offset, e->offset + e->length - 1);
+        free(buf);
+        return NULL;
+    }
+    return buf;
+}
+
+/* ---- Pack ---- */
+
+typedef struct {
+    int fd;
+    const GF2_Basis *B;
+    ArchiveEntry *entry;
+    bool failed;
+} PackTask;
+
+/*
+ * Encode one basis and write it at its precomputed offset
+ */
+static void pack_task(CanonPool *pool, void *arg) {
+    (void)pool;
+    PackTask *t = arg;
+    uint8_t *buf = malloc(t->entry->length);
+    canon_encode(t->B, buf);
+    t->entry->crc = member_crc(buf, t->entry->length);
+    t->failed = !pwrite_all(t->fd, buf, t->entry->length, t->entry->offset);
+    free(buf);
+}
+
+/*
+ * Write the members, directory and footer of a new archive to fd
+ * names[i] and bases[i] describe entry i
+ */
+static bool write_archive(CanonPool *pool, int fd, ArchiveEntry *entries, const char **names,
+                          const GF2_Basis **bases, uint32_t count) {
+    ArchiveHeader h = { .version = CANON_ARCHIVE_VERSION };
+    memcpy(h.magic, CANON_ARCHIVE_MAGIC, 4);
+    if (!pwrite_all(fd, &h, sizeof(h), 0)) return false;
+
+    // Offsets are known up front, so members are written in parallel
+    uint64_t at = sizeof(h);
+    for (uint32_t i = 0; i < count; i++) {
+        entries[i].offset = at;
+        entries[i].length = canon_encoded_size(bases[i]);
+        entries[i].rank = bases[i]->rank;
+        entries[i].name_len = (uint32_t)strlen(names[i]);
+        at = align_up(at + entries[i].length);
+    }
+    PackTask *tasks = calloc(count ? count : 1, sizeof(PackTask));
+    for (uint32_t i = 0; i < count; i++) {
+        tasks[i] = (PackTask){ fd, bases[i], &entries[i], false };
+        canon_pool_submit(pool, pack_task, &tasks[i]);
+    }
+    canon_pool_wait(pool);
+    bool ok = true;
+    for (uint32_t i = 0; i < count; i++) ok = ok && !tasks[i].failed;
+    free(tasks);
+    if (!ok) return false;
+
+    uint64_t dir_length = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        dir_length += sizeof(ArchiveEntry) + align_up(entries[i].name_len);
+    }
+    uint8_t *dir = calloc(1, dir_length ? dir_length : 1);
+    uint64_t d = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        memcpy(dir + d, &entries[i], sizeof(ArchiveEntry));
+        d += sizeof(ArchiveEntry);
+        memcpy(dir + d, names[i], entries[i].name_len);
+        d += align_up(entries[i].name_len);
+    }
+    ArchiveFooter f = { .count = count, .dir_offset = at, .dir_length = dir_length,
+                        .dir_crc = canon_crc32c(0, dir, dir_length),
+                        .version = CANON_ARCHIVE_VERSION };
+    memcpy(f.magic, CANON_ARCHIVE_DIR_MAGIC, 4);
+    ok = pwrite_all(fd, dir, dir_length, at) &&
+         pwrite_all(fd, &f, sizeof(f), at + dir_length) &&
+         fsync(fd) == 0;
+    free(dir);
+    return ok;
+}
+
+/*
+ * `canon pack <archive> <input>... [--corpus] [compress-many options]`
+ */
+int canon_pack_main(int argc, char **argv) {
+    CanonFilesConfig cfg = CANON_FILES_DEFAULTS;
+    int threads = 0;
+    bool corpus = false;
+
+    CanonFileJob *jobs = calloc(argc, sizeof(CanonFileJob));
+    uint32_t n = 0;
+    const char *archive = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--corpus") == 0) {
+            corpus = true;
+        } else if (canon_files_option(&cfg, &threads, argc, argv, &i)) {
+            continue;
+        } else if (strncmp(argv[i], "--", 2) == 0) {
+            fprintf(stderr, "Error: Unknown option '%s'\n", argv[i]);
+            free(jobs);
+            return 1;
+        } else if (!archive) {
+            archive = argv[i];
+        } else if (!canon_safe_name(member_name(argv[i]))) {
+            fprintf(stderr, "Error: %s: cannot be stored as a member name\n", argv[i]);
+            free(jobs);
+            return 1;
+        } else {
+            jobs[n++].input = argv[i];
+        }
+    }
+    if (n == 0) {
+        fprintf(stderr, "Usage: canon pack <archive> <input>... [--corpus] [--threads N] [--chunk BYTES]\n"
+                        "       [--split] [--io mmap|uring|threads] [--queue-depth N] [--pin]\n"
+                        "       [--hugepages off|thp|hugetlb] [--cache DIR [--cache-size BYTES]]\n");
+        free(jobs);
+        return 1;
+    }
+    // Members are found by name, so two inputs may not share one
+    const char **sorted = malloc(n * sizeof(char *));
+    for (uint32_t i = 0; i < n; i++) sorted[i] = jobs[i].input;
+    qsort(sorted, n, sizeof(char *), by_member_name);
+    for (uint32_t i = 0; i < n; i++) {
+        const char *dup = i > 0 && by_member_name(&sorted[i - 1], &sorted[i]) == 0 ? sorted[i - 1] :
+                          corpus && strcmp(member_name(sorted[i]), CORPUS_NAME) == 0 ? "--corpus" : NULL;
+        if (dup) {
+            fprintf(stderr, "Error: %s and %s: same member name %s\n", dup, sorted[i], member_name(sorted[i]));
+            free(sorted);
+            free(jobs);
+            return 1;
+        }
+    }
+    free(sorted);
+
+    for (uint32_t i = 0; i < n; i++) {
+        struct stat st;
+        if (stat(jobs[i].input, &st) == 0) jobs[i].size = (uint64_t)st.st_size;
+    }
+    cfg.keep_bases = true;
+
+    CanonPool *pool = canon_pool_create(threads, cfg.pin ? CANON_POOL_PIN : 0);
+    if (!pool) {
+        free(jobs);
+        return 1;
+    }
+    printf("Packing %u file(s) into %s\n\n", n, archive);
+    fflush(stdout);
+
+    uint64_t t0 = now_ns();
+    int failed = canon_compress_files(pool, jobs, n, &cfg);
+
+    // Entry 0 is the dictionary when there is one
+    uint32_t count = 0, dict_id = 0;
+    ArchiveEntry *entries = calloc(n + 1, sizeof(ArchiveEntry));
+    const char **names = calloc(n + 1, sizeof(char *));
+    const GF2_Basis **bases = calloc(n + 1, sizeof(GF2_Basis *));
+    GF2_Basis *C = corpus ? canon_corpus_merge(jobs, n) : NULL;
+    if (corpus && !C) {
+        canon_pool_destroy(pool);
+        for (uint32_t i = 0; i < n; i++) basis_free(jobs[i].basis);
+        free(bases);
+        free(names);
+        free(entries);
+        free(jobs);
+        return 1;
+    }
+    if (C) {
+        names[count] = CORPUS_NAME;
+        bases[count] = C;
+        entries[count].input_size = C->input_size;
+        entries[count].flags = ARCHIVE_DICT;
+        dict_id = ++count;
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        if (jobs[i].failed || !jobs[i].basis) continue;
+        names[count] = member_name(jobs[i].input);
+        bases[count] = jobs[i].basis;
+        entries[count].input_size = jobs[i].size;
+        entries[count].dict_id = dict_id;
+        count++;
+    }
+
+    // Written beside the target and renamed over it when complete
+    size_t len = strlen(archive) + 5;
+    char *tmp = malloc(len);
+    snprintf(tmp, len, "%s.tmp", archive);
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    bool ok = fd >= 0 && write_archive(pool, fd, entries, names, bases, count);
+    if (fd >= 0 && close(fd) != 0) ok = false;
+    if (ok) ok = rename(tmp, archive) == 0;
+    if (!ok) {
+        perror("Error writing archive");
+        unlink(tmp);
+    }
+    double sec = (now_ns() - t0) / 1e9;
+
+    uint64_t total = 0, packed = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        if (jobs[i].failed) printf("✗ %s\n", jobs[i].input);
+        else total += jobs[i].size;
+    }
+    for (uint32_t i = 0; i < count; i++) packed += entries[i].length;
+    if (ok) {
+        printf("✓ %s: %u member(s)%s, %lu bytes -> %lu bytes in %.3f seconds (%.2f MB/s), %d failed\n",
+               archive, count - (C ? 1 : 0), C ? " + corpus dictionary" : "", total, packed, sec,
+               sec > 0 ? total / 1048576.0 / sec : 0.0, failed);
+    }
+    canon_pool_report(pool, stdout);
+    canon_huge_report(stdout);
+    canon_pool_destroy(pool);
+
+    basis_free(C);
+    for (uint32_t i = 0; i < n; i++) basis_free(jobs[i].basis);
+    free(tmp);
+    free(bases);
+    free(names);
+    free(entries);
+    free(jobs);
+    return ok && !failed ? 0 : 1;
+}
+
+/* ---- Unpack / list ---- */
+
+typedef struct {
+    const Archive *a;
+    const char *path;
+    const char *out_dir;
+    uint32_t index;
+    bool failed;
+} UnpackTask;
+
+/*
+ * Extract one member to OUT_DIR/<name>.canon after checking it
+ */
+static void unpack_task(CanonPool *pool, void *arg) {
+    (void)pool;
+    UnpackTask *t = arg;
+    const ArchiveEntry *e = &t->a->entries[t->index];
+    const char *name = t->a->names[t->index];
+    t->failed = true;
+    if (!canon_safe_name(name)) {
+        fprintf(stderr, "Error: %s: refusing member name %s\n", t->path, name);
+        return;
+    }
+    uint8_t *buf = archive_read_member(t->a, t->index, t->path);
+    if (!buf) return;
+
+    // Member CRC covers the transfer; decoding checks the contents
+    GF2_Basis *B = canon_decode(buf, e->length, name);
+    if (B) {
+        size_t len = strlen(t->out_dir) + strlen(name) + 8;
+        char *out = malloc(len);
+        snprintf(out, len, "%s/%s.canon", t->out_dir, name);
+        FILE *f = canon_make_parents(out) ? fopen(out, "wb") : NULL;
+        bool ok = f && fwrite(buf, 1, e->length, f) == e->length;
+        if (f && fclose(f) != 0) ok = false;
+        if (!ok) perror(out);
+        t->failed = !ok;
+        free(out);
+        basis_free(B);
+    }
+    free(buf);
+}
+
+/*
+ * `canon unpack <archive> [member...] [--out-dir DIR] [--threads N]`
+ */
+int canon_unpack_main(int argc, char **argv) {
+    const char *path = NULL, *out_dir = ".";
+    int threads = 0;
+    const char **wanted = calloc(argc, sizeof(char *));
+    int nwanted = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--out-dir") == 0 && i + 1 < argc) {
+            out_dir = argv[++i];
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threads = (int)strtol(argv[++i], NULL, 10);
+        } else if (strncmp(argv[i], "--", 2) == 0) {
+            fprintf(stderr, "Error: Unknown option '%s'\n", argv[i]);
+            free(wanted);
+            return 1;
+        } else if (!path) {
+            path = argv[i];
+        } else {
+            wanted[nwanted++] = argv[i];
+        }
+    }
+    if (!path) {
+        fprintf(stderr, "Usage: canon unpack <archive> [member...] [--out-dir DIR] [--threads N]\n");
+        free(wanted);
+        return 1;
+    }
+
+    Archive *a = archive_open(path);
+    if (!a) {
+        free(wanted);
+        return 1;
+    }
+
+    // Selected members only, or all of them
+    UnpackTask *tasks = calloc(a->count ? a->count : 1, sizeof(UnpackTask));
+    uint32_t ntasks = 0;
+    int missing = 0;
+    for (int w = 0; w < nwanted; w++) {
+        int i = archive_find(a, wanted[w]);
+        if (i < 0) {
+            fprintf(stderr, "Error: %s: no member %s\n", path, wanted[w]);
+            missing++;
+        } else {
+            tasks[ntasks++] = (UnpackTask){ a, path, out_dir, (uint32_t)i, false };
+        }
+    }
+    for (uint32_t i = 0; nwanted == 0 && i < a->count; i++) {
+        tasks[ntasks++] = (UnpackTask){ a, path, out_dir, i, false };
+    }
+
+    CanonPool *pool = canon_pool_create(threads, 0);
+    if (!pool) {
+        free(tasks);
+        archive_close(a);
+        free(wanted);
+        return 1;
+    }
+    uint64_t t0 = now_ns();
+    for (uint32_t t = 0; t < ntasks; t++) canon_pool_submit(pool, unpack_task, &tasks[t]);
+    canon_pool_wait(pool);
+    double sec = (now_ns() - t0) / 1e9;
+
+    int failed = missing;
+    uint64_t bytes = 0;
+    for (uint32_t t = 0; t < ntasks; t++) {
+        const char *name = a->names[tasks[t].index];
+        if (tasks[t].failed) {
+            printf("✗ %s\n", name);
+            failed++;
+        } else {
+            printf("✓ %s -> %s/%s.canon\n", name, out_dir, name);
+            bytes += a->entries[tasks[t].index].length;
+        }
+    }
+    printf("\nExtracted %u member(s), %lu bytes in %.3f seconds, %d failed\n",
+           ntasks - (uint32_t)(failed - missing), bytes, sec, failed);
+
+    canon_pool_destroy(pool);
+    free(tasks);
+    archive_close(a);
+    free(wanted);
+    return failed ? 1 : 0;
+}
+
+/*
+ * `canon list <archive>`
+ */
+int canon_list_main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: canon list <archive>\n");
+        return 1;
+    }
+    Archive *a = archive_open(argv[1]);
+    if (!a) return 1;
+
+    printf("%-12s %-12s %-8s %-4s %-8s  %s\n", "input", "packed", "rank", "dict", "crc32c", "name");
+    uint64_t input = 0, packed = 0;
+    for (uint32_t i = 0; i < a->count; i++) {
+        const ArchiveEntry *e = &a->entries[i];
+        printf("%-12lu %-12lu %-8u %-4u %08x  %s%s\n", e->input_size, e->length, e->rank,
+               e->dict_id, e->crc, a->names[i], e->flags & ARCHIVE_DICT ? " (dictionary)" : "");
+        if (!(e->flags & ARCHIVE_DICT)) input += e->input_size;
+        packed += e->length;
+    }
+    printf("\n%u entr%s, %lu input bytes in %lu packed bytes\n",
+           a->count, a->count == 1 ? "y" : "ies", input, packed);
+    archive_close(a);
+    return 0;
+}
@@ -0,0 +1,529 @@
+/*
+ * CANON - Coalescing batch front end for many tiny inputs
+ *
+ * Author: Francesco Pedulli
+ * Date: February 26, 2026
+ *
+ * Two layers:
+ *
+ * 1. canon_compress_many() - synchronous batch kernel. Up to BATCH_LANES
+ *    short messages are eliminated in lockstep, one message per SIMD
+ *    lane: byte j of every message is reduced against its own basis in
+ *    the same vector instructions. The basis is stored transposed
+ *    (basis[i][lane]) with a precomputed leading-bit table, so the
+ *    in_span() reduction loop becomes a handful of vector ops per basis
+ *    row for all lanes at once. Results are bit-identical to
+ *    canon_compress_block() on each message.
+ *
+ * 2. CanonBatcher - asynchronous coalescer. Submitted messages are
+ *    copied into a pending arena; a flusher thread drains it when
+ *    max_batch messages are waiting or the oldest one has waited
+ *    max_delay_ns, so per-message setup is amortized while queueing
+ *    delay stays bounded.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "canon.h"
+
+#define BATCH_LANES 32
+
+typedef uint8_t lane_vec __attribute__((vector_size(BATCH_LANES)));
+
+/*
+ * Per-lane leading-bit index, 1-based: 0 for x = 0, 8 for x >= 128
+ * Two lanes agree exactly when in_span() would compare bit_r == bit_b.
+ */
+static inline lane_vec lane_msb(lane_vec x) {
+    lane_vec m = {0};
+    m -= (lane_vec)(x >= 1);
+    m -= (lane_vec)(x >= 2);
+    m -= (lane_vec)(x >= 4);
+    m -= (lane_vec)(x >= 8);
+    m -= (lane_vec)(x >= 16);
+    m -= (lane_vec)(x >= 32);
+    m -= (lane_vec)(x >= 64);
+    m -= (lane_vec)(x >= 128);
+    return m;
+}
+
+static uint8_t scalar_msb(uint8_t x) {
+    return x ? (uint8_t)(32 - __builtin_clz(x)) : 0;
+}
+
+/*
+ * Transposed lockstep state for one group of lanes
+ */
+typedef struct {
+    uint64_t rows;        // Capacity in basis rows
+    lane_vec *basis;      // basis[i][lane], zero beyond each lane's rank
+    lane_vec *msb;        // lane_msb(basis[i])
+    uint32_t *derivation; // derivation[i * BATCH_LANES + lane]
+    uint8_t (*sig)[256];  // Span signature per lane
+} BatchWorkspace;
+
+static bool workspace_reserve(BatchWorkspace *ws, uint64_t rows) {
+    if (rows <= ws->rows) return true;
+    free(ws->basis);
+    free(ws->msb);
+    free(ws->derivation);
+    ws->basis = aligned_alloc(sizeof(lane_vec), rows * sizeof(lane_vec));
+    ws->msb = aligned_alloc(sizeof(lane_vec), rows * sizeof(lane_vec));
+    ws->derivation = malloc(rows * BATCH_LANES * sizeof(uint32_t));
+    if (!ws->sig) ws->sig = malloc(BATCH_LANES * 256);
+    ws->rows = (ws->basis && ws->msb && ws->derivation && ws->sig) ? rows : 0;
+    return ws->rows != 0;
+}
+
+static void workspace_free(BatchWorkspace *ws) {
+    free(ws->basis);
+    free(ws->msb);
+    free(ws->derivation);
+    free(ws->sig);
+    memset(ws, 0, sizeof(*ws));
+}
+
+/*
+ * Eliminate up to BATCH_LANES messages in lockstep
+ * Every message must be at most ws->rows bytes (rank <= length).
+ */
+static void batch_group(BatchWorkspace *ws, const uint8_t *const *data,
+                        const uint64_t *sizes, uint32_t lanes, GF2_Basis **out) {
+    uint64_t maxlen = 0;
+    for (uint32_t k = 0; k < lanes; k++) {
+        if (sizes[k] > maxlen) maxlen = sizes[k];
+    }
+
+    uint32_t rank[BATCH_LANES] = {0};
+    uint32_t maxrank = 0;
+    memset(ws->sig, 0, BATCH_LANES * 256);
+    memset(ws->basis, 0, maxlen * sizeof(lane_vec));
+    memset(ws->msb, 0, maxlen * sizeof(lane_vec));
+
+    for (uint64_t j = 0; j < maxlen; j++) {
+        lane_vec x = {0};
+        for (uint32_t k = 0; k < lanes; k++) {
+            if (j < sizes[k]) x[k] = data[k][j];
+        }
+
+        // in_span() reduction for all lanes; zero rows never match
+        lane_vec residue = x;
+        for (uint32_t i = 0; i < maxrank; i++) {
+            lane_vec mr = lane_msb(residue);
+            lane_vec hit = (lane_vec)(mr == ws->msb[i]) & (lane_vec)(mr != 0);
+            residue ^= ws->basis[i] & hit;
+        }
+
+        // add_to_basis() for lanes whose byte was not in span
+        for (uint32_t k = 0; k < lanes; k++) {
+            if (j >= sizes[k]) continue;
+            uint8_t v = x[k];
+            bool spanned = rank[k] > 0 && ws->sig[k][v] && residue[k] == 0;
+            if (spanned) continue;
+
+            uint32_t r = rank[k];
+            ws->basis[r][k] = v;
+            ws->msb[r][k] = scalar_msb(v);
+            ws->derivation[(uint64_t)r * BATCH_LANES + k] = (uint32_t)j;
+            ws->sig[k][v] = 1;
+            for (uint32_t i = 0; i < r; i++) ws->sig[k][ws->basis[i][k] ^ v] = 1;
+            rank[k] = r + 1;
+            if (rank[k] > maxrank) maxrank = rank[k];
+        }
+    }
+
+    // Scatter lanes back into ordinary GF2_Basis contexts
+    for (uint32_t k = 0; k < lanes; k++) {
+        GF2_Basis *B = out[k];
+        basis_reset(B);
+        B->rank = rank[k];
+        B->input_size = sizes[k];
+        for (uint32_t i = 0; i < rank[k]; i++) {
+            B->basis[i] = ws->basis[i][k];
+            B->derivation[i] = ws->derivation[(uint64_t)i * BATCH_LANES + k];
+        }
+        for (int v = 0; v < 256; v++) B->span_signature[v] = ws->sig[k][v];
+    }
+}
+
+static void batch_run(BatchWorkspace *ws, const uint8_t *const *data,
+                      const uint64_t *sizes, uint32_t count, GF2_Basis **out) {
+    const uint8_t *gdata[BATCH_LANES];
+    uint64_t gsizes[BATCH_LANES];
+    GF2_Basis *gout[BATCH_LANES];
+    uint32_t lanes = 0;
+
+    for (uint32_t m = 0; m < count; m++) {
+        if (sizes[m] > BATCH_MAX_MESSAGE || !workspace_reserve(ws, BATCH_MAX_MESSAGE)) {
+            // Long messages gain nothing from lockstep: scalar path
+            basis_reset(out[m]);
+            canon_compress_block(out[m], data[m], sizes[m], 0);
+            continue;
+        }
+        gdata[lanes] = data[m];
+        gsizes[lanes] = sizes[m];
+        gout[lanes] = out[m];
+        if (++lanes == BATCH_LANES) {
+            batch_group(ws, gdata, gsizes, lanes, gout);
+            lanes = 0;
+        }
+    }
+    if (lanes > 0) batch_group(ws, gdata, gsizes, lanes, gout);
+}
+
+/*
+ * Compress count independent messages into out[0..count)
+ * Messages up to BATCH_MAX_MESSAGE bytes go through the lockstep
+ * kernel; pass them sorted by size to keep lanes evenly loaded.
+ */
+void canon_compress_many(const uint8_t *const *data, const uint64_t *sizes,
+                         uint32_t count, GF2_Basis **out) {
+    BatchWorkspace ws = {0};
+    batch_run(&ws, data, sizes, count, out);
+    workspace_free(&ws);
+}
+
+/*
+ * Pending messages: one contiguous arena plus an index
+ */
+typedef struct {
+    uint64_t offset;
+    uint64_t size;
+    uint64_t tag;
+    uint64_t submit_ns;
+} BatchEntry;
+
+typedef struct {
+    uint8_t *arena;
+    uint64_t arena_len, arena_cap;
+    BatchEntry *entries;
+    uint32_t count, cap;
+} BatchQueue;
+
+struct CanonBatcher {
+    BatchConfig cfg;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_t thread;
+    bool running;
+    BatchQueue pending;    // Filled by submitters
+    BatchQueue active;     // Drained by the flusher
+    BatchWorkspace ws;
+    GF2_Basis **bases;     // Pooled contexts, one per batch slot
+    uint32_t *order;       // Size-sorted processing order
+    uint32_t order_cap;
+};
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// qsort_r comparator; entries is the batch being ordered
+static int by_size(const void *a, const void *b, void *entries) {
+    const BatchEntry *e = entries;
+    uint64_t sa = e[*(const uint32_t *)a].size;
+    uint64_t sb = e[*(const uint32_t *)b].size;
+    return (sa > sb) - (sa < sb);
+}
+
+/*
+ * Process one drained batch and invoke callbacks
+ */
+static void batcher_process(CanonBatcher *b, BatchQueue *q) {
+    uint32_t done = 0;
+
+    if (q->count > b->order_cap) {
+        free(b->order);
+        b->order = malloc(q->cap * sizeof(uint32_t));
+        b->order_cap = q->cap;
+    }
+
+    // Size order keeps lockstep lanes similarly loaded
+    for (uint32_t i = 0; i < q->count; i++) b->order[i] = i;
+    qsort_r(b->order, q->count, sizeof(uint32_t), by_size, q->entries);
+
+    while (done < q->count) {
+        const uint8_t *data[BATCH_LANES];
+        uint64_t sizes[BATCH_LANES];
+        uint32_t n = q->count - done < BATCH_LANES ? q->count - done : BATCH_LANES;
+
+        for (uint32_t k = 0; k < n; k++) {
+            const BatchEntry *e = &q->entries[b->order[done + k]];
+            data[k] = q->arena + e->offset;
+            sizes[k] = e->size;
+        }
+        batch_run(&b->ws, data, sizes, n, b->bases);
+
+        uint64_t now = now_ns();
+        for (uint32_t k = 0; k < n; k++) {
+            const BatchEntry *e = &q->entries[b->order[done + k]];
+            b->cfg.callback(e->tag, b->bases[k], now - e->submit_ns, b->cfg.user);
+        }
+        done += n;
+    }
+    q->count = 0;
+    q->arena_len = 0;
+}
+
+static void* batcher_thread(void *arg) {
+    CanonBatcher *b = arg;
+
+    pthread_mutex_lock(&b->lock);
+    for (;;) {
+        BatchQueue *p = &b->pending;
+        if (p->count == 0) {
+            if (!b->running) break;
+            pthread_cond_wait(&b->wake, &b->lock);
+            continue;
+        }
+
+        uint64_t deadline = p->entries[0].submit_ns + b->cfg.max_delay_ns;
+        if (b->running && p->count < b->cfg.max_batch && now_ns() < deadline) {
+            struct timespec ts = {
+                (time_t)(deadline / 1000000000ull), (long)(deadline % 1000000000ull)
+            };
+            pthread_cond_timedwait(&b->wake, &b->lock, &ts);
+            continue;
+        }
+
+        // Swap queues so submitters keep appending during processing
+        BatchQueue t = b->active;
+        b->active = *p;
+        *p = t;
+        pthread_mutex_unlock(&b->lock);
+
+        batcher_process(b, &b->active);
+
+        pthread_mutex_lock(&b->lock);
+    }
+    pthread_mutex_unlock(&b->lock);
+    return NULL;
+}
+
+/*
+ * Create a batcher; cfg->callback receives each message's basis
+ * (valid only during the call) from the flusher thread
+ */
+CanonBatcher* canon_batcher_create(const BatchConfig *cfg) {
+    if (!cfg->callback || cfg->max_batch == 0) return NULL;
+
+    CanonBatcher *b = calloc(1, sizeof(CanonBatcher));
+    if (!b) return NULL;
+    b->cfg = *cfg;
+    b->running = true;
+
+    b->bases = calloc(BATCH_LANES, sizeof(GF2_Basis *));
+    for (uint32_t i = 0; i < BATCH_LANES; i++) b->bases[i] = basis_init();
+
+    pthread_condattr_t ca;
+    pthread_condattr_init(&ca);
+    pthread_condattr_setclock(&ca, CLOCK_MONOTONIC);
+    pthread_cond_init(&b->wake, &ca);
+    pthread_condattr_destroy(&ca);
+    pthread_mutex_init(&b->lock, NULL);
+
+    if (pthread_create(&b->thread, NULL, batcher_thread, b) != 0) {
+        for (uint32_t i = 0; i < BATCH_LANES; i++) basis_free(b->bases[i]);
+        free(b->bases);
+        free(b);
+        return NULL;
+    }
+    return b;
+}
+
+static bool queue_append(BatchQueue *q, const uint8_t *data, uint64_t size,
+                         uint64_t tag, uint64_t now) {
+    if (q->count == q->cap) {
+        uint32_t ncap = q->cap ? q->cap * 2 : 256;
+        BatchEntry *e = realloc(q->entries, ncap * sizeof(BatchEntry));
+        if (!e) return false;
+        q->entries = e;
+        q->cap = ncap;
+    }
+    if (q->arena_len + size > q->arena_cap) {
+        uint64_t ncap = q->arena_cap ? q->arena_cap : 65536;
+        while (ncap < q->arena_len + size) ncap *= 2;
+        uint8_t *a = realloc(q->arena, ncap);
+        if (!a) return false;
+        q->arena = a;
+        q->arena_cap = ncap;
+    }
+    memcpy(q->arena + q->arena_len, data, size);
+    q->entries[q->count++] = (BatchEntry){ q->arena_len, size, tag, now };
+    q->arena_len += size;
+    return true;
+}
+
+/*
+ * Queue one message (copied); returns false on allocation failure
+ */
+bool canon_batcher_submit(CanonBatcher *b, const uint8_t *data, uint64_t size,
+                          uint64_t tag) {
+    pthread_mutex_lock(&b->lock);
+    bool ok = queue_append(&b->pending, data, size, tag, now_ns());
+    uint32_t count = b->pending.count;
+    pthread_mutex_unlock(&b->lock);
+
+    // First message arms the delay timer, a full batch flushes now
+    if (ok && (count == 1 || count >= b->cfg.max_batch)) pthread_cond_signal(&b->wake);
+    return ok;
+}
+
+/*
+ * Flush everything still pending, stop the flusher, free resources
+ */
+void canon_batcher_destroy(CanonBatcher *b) {
+    if (!b) return;
+    pthread_mutex_lock(&b->lock);
+    b->running = false;
+    pthread_cond_signal(&b->wake);
+    pthread_mutex_unlock(&b->lock);
+    pthread_join(b->thread, NULL);
+
+    for (uint32_t i = 0; i < BATCH_LANES; i++) basis_free(b->bases[i]);
+    free(b->bases);
+    free(b->order);
+    free(b->pending.arena);
+    free(b->pending.entries);
+    free(b->active.arena);
+    free(b->active.entries);
+    workspace_free(&b->ws);
+    pthread_cond_destroy(&b->wake);
+    pthread_mutex_destroy(&b->lock);
+    free(b);
+}
+
+/*
+ * Driver for `canon batch-lines`
+ */
+typedef struct {
+    uint64_t *latency_ns;
+    uint32_t *rank;
+    const uint8_t *input;
+    const uint64_t *offsets;
+    bool check;
+    uint64_t mismatches;
+    GF2_Basis *ref;
+} BatchLinesState;
+
+static void batch_lines_done(uint64_t tag, const GF2_Basis *B, uint64_t latency_ns,
+                             void *user) {
+    BatchLinesState *st = user;
+    st->latency_ns[tag] = latency_ns;
+    st->rank[tag] = B->rank;
+
+    if (st->check) {
+        uint64_t off = st->offsets[tag];
+        basis_reset(st->ref);
+        canon_compress_block(st->ref, st->input + off, st->offsets[tag + 1] - off - 1, 0);
+        if (st->ref->rank != B->rank ||
+            memcmp(st->ref->basis, B->basis, B->rank) != 0 ||
+            memcmp(st->ref->derivation, B->derivation, B->rank * sizeof(uint32_t)) != 0) {
+            st->mismatches++;
+        }
+    }
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+/*
+ * `canon batch-lines <input> [--max-batch N] [--max-delay-us US] [--check]`
+ * Each line of input is one message; reports throughput and latency.
+ */
+int canon_batch_lines_main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: canon batch-lines <input> [--max-batch N] [--max-delay-us US] [--check]\n");
+        return 1;
+    }
+    BatchConfig cfg = { 256, 1000000, batch_lines_done, NULL };
+    bool check = false;
+
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--max-batch") == 0 && i + 1 < argc) {
+            cfg.max_batch = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--max-delay-us") == 0 && i + 1 < argc) {
+            cfg.max_delay_ns = strtoull(argv[++i], NULL, 10) * 1000;
+        } else if (strcmp(argv[i], "--check") == 0) {
+            check = true;
+        } else {
+            fprintf(stderr, "Error: Unknown option '%s'\n", argv[i]);
+            return 1;
+        }
+    }
+
+    uint64_t size;
+    uint8_t *input = read_file(argv[1], &size);
+    if (!input) return 1;
+
+    // Line start offsets, with a sentinel one past the final newline
+    uint64_t lines = 0;
+    for (uint64_t i = 0; i < size; i++) lines += input[i] == '\n';
+    if (size > 0 && input[size - 1] != '\n') lines++;
+    uint64_t *offsets = malloc((lines + 1) * sizeof(uint64_t));
+    uint64_t n = 0;
+    offsets[n++] = 0;
+    for (uint64_t i = 0; i < size && n <= lines; i++) {
+        if (input[i] == '\n') offsets[n++] = i + 1;
+    }
+    if (n <= lines) offsets[n] = size + 1;
+
+    BatchLinesState st = {0};
+    st.latency_ns = calloc(lines ? lines : 1, sizeof(uint64_t));
+    st.rank = calloc(lines ? lines : 1, sizeof(uint32_t));
+    st.input = input;
+    st.offsets = offsets;
+    st.check = check;
+    st.ref = basis_init();
+    cfg.user = &st;
+
+    CanonBatcher *b = canon_batcher_create(&cfg);
+    if (!b) {
+        fprintf(stderr, "Error: Cannot create batcher\n");
+        return 1;
+    }
+
+    uint64_t start = now_ns();
+    for (uint64_t m = 0; m < lines; m++) {
+        canon_batcher_submit(b, input + offsets[m], offsets[m + 1] - offsets[m] - 1, m);
+    }
+    canon_batcher_destroy(b);
+    double sec = (now_ns() - start) / 1e9;
+
+    uint64_t rank_sum = 0;
+    for (uint64_t m = 0; m < lines; m++) rank_sum += st.rank[m];
+    qsort(st.latency_ns, lines, sizeof(uint64_t), cmp_u64);
+
+    printf("Messages:     %lu (%lu bytes)\n", lines, size);
+    printf("Mean rank:    %.2f\n", lines ? (double)rank_sum / lines : 0.0);
+    printf("Time Taken:   %.3f seconds (%.0f msg/s)\n", sec, lines / (sec > 0 ? sec : 1e-9));
+    if (lines > 0) {
+        printf("Latency p50:  %.1f us\n", st.latency_ns[lines / 2] / 1000.0);
+        printf("Latency p99:  %.1f us\n", st.latency_ns[(lines * 99) / 100] / 1000.0);
+        printf("Latency max:  %.1f us\n", st.latency_ns[lines - 1] / 1000.0);
+    }
+    if (check) {
+        printf("Check:        %s (%lu mismatch(es))\n",
+               st.mismatches ? "FAILED" : "✓ identical to scalar path", st.mismatches);
+    }
+
+    basis_free(st.ref);
+    free(st.latency_ns);
+    free(st.rank);
+    free(offsets);
+    free(input);
+    return st.mismatches ? 1 : 0;
+}
@@ -0,0 +1,346 @@
+/*
+ * CANON - Content-addressed result cache
+ *
+ * Author: Francesco Pedulli
+ * Date: February 26, 2026
+ *
+ * `--cache DIR` keys every input by a 64-bit XXH64 of its content plus
+ * its size. When the directory already holds a basis for that key, it
+ * is loaded instead of recompressing. Hashing streams the input once at
+ * memory/disk bandwidth; elimination is Θ(n·r), so a hit costs a small
+ * fraction of a compression and a miss barely anything extra (the
+ * pages are warm for the compression that follows).
+ *
+ * Layout: DIR/<first two hex digits>/<hash>-<size>.canon, ordinary
+ * .canon files. Safe for concurrent processes:
+ * - entries are written to a private temporary name and renamed in,
+ *   so readers never see a partial file (racing writers produce the
+ *   same bytes, and the last rename wins);
+ * - a hit refreshes the entry's mtime, which is the LRU clock;
+ * - eviction runs under flock(DIR/.lock), skipped if another process
+ *   holds it, and deletes oldest entries until the cache is back under
+ *   90% of its size bound. An entry unlinked while being read stays
+ *   readable through the open descriptor.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+
+#include "canon.h"
+
+#define CACHE_EVICT_EVERY 64        // Puts between size checks
+#define CACHE_STALE_TMP_SEC 3600    // Leftovers of crashed writers
+
+struct CanonCache {
+    char *dir;
+    uint64_t max_bytes;
+    atomic_uint puts_since_evict;
+    atomic_uint tmp_seq;
+    atomic_ulong hits, misses, stores, evicted;
+    pthread_mutex_t evict_lock;
+};
+
+/* ---- XXH64 ---- */
+
+#define XXH_P1 0x9E3779B185EBCA87ull
+#define XXH_P2 0xC2B2AE3D27D4EB4Full
+#define XXH_P3 0x165667B19E3779F9ull
+#define XXH_P4 0x85EBCA77C2B2AE63ull
+#define XXH_P5 0x27D4EB2F165667C5ull
+
+static inline uint64_t rotl64(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t read64(const uint8_t *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint64_t xxh_round(uint64_t acc, uint64_t input) {
+    acc += input * XXH_P2;
+    acc = rotl64(acc, 31);
+    return acc * XXH_P1;
+}
+
+static inline uint64_t xxh_merge(uint64_t acc, uint64_t v) {
+    acc ^= xxh_round(0, v);
+    return acc * XXH_P1 + XXH_P4;
+}
+
+/*
+ * XXH64 of data (little-endian host), seed 0
+ */
+uint64_t canon_hash64(const uint8_t *data, uint64_t len) {
+    const uint8_t *p = data, *end = data + len;
+    uint64_t h;
+
+    if (len >= 32) {
+        uint64_t v1 = XXH_P1 + XXH_P2, v2 = XXH_P2, v3 = 0, v4 = -XXH_P1;
+        const uint8_t *limit = end - 32;
+        do {
+            v1 = xxh_round(v1, read64(p));
+            v2 = xxh_round(v2, read64(p + 8));
+            v3 = xxh_round(v3, read64(p + 16));
+            v4 = xxh_round(v4, read64(p + 24));
+            p += 32;
+        } while (p <= limit);
+        h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+        h = xxh_merge(h, v1);
+        h = xxh_merge(h, v2);
+        h = xxh_merge(h, v3);
+        h = xxh_merge(h, v4);
+    } else {
+        h = XXH_P5;
+    }
+    h += len;
+
+    for (; p + 8 <= end; p += 8) {
+        h ^= xxh_round(0, read64(p));
+        h = rotl64(h, 27) * XXH_P1 + XXH_P4;
+    }
+    if (p + 4 <= end) {
+        uint32_t k;
+        memcpy(&k, p, sizeof(k));
+        h ^= (uint64_t)k * XXH_P1;
+        h = rotl64(h, 23) * XXH_P2 + XXH_P3;
+        p += 4;
+    }
+    for (; p < end; p++) {
+        h ^= *p * XXH_P5;
+        h = rotl64(h, 11) * XXH_P1;
+    }
+
+    h ^= h >> 33;
+    h *= XXH_P2;
+    h ^= h >> 29;
+    h *= XXH_P3;
+    h ^= h >> 32;
+    return h;
+}
+
+/*
+ * Hash a file's content (mapped, read sequentially once)
+ */
+bool canon_cache_hash_file(const char *path, uint64_t *hash, uint64_t *size) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        perror(path);
+        if (fd >= 0) close(fd);
+        return false;
+    }
+    *size = (uint64_t)st.st_size;
+    if (*size == 0) {
+        *hash = canon_hash64(NULL, 0);
+        close(fd);
+        return true;
+    }
+    void *p = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        perror(path);
+        return false;
+    }
+    madvise(p, *size, MADV_SEQUENTIAL);
+    *hash = canon_hash64(p, *size);
+    munmap(p, *size);
+    return true;
+}
+
+/* ---- Cache directory ---- */
+
+static char* entry_path(const CanonCache *c, uint64_t hash, uint64_t size) {
+    size_t len = strlen(c->dir) + 64;
+    char *path = malloc(len);
+    snprintf(path, len, "%s/%02x/%016lx-%lu.canon", c->dir, (unsigned)(hash >> 56), hash, size);
+    return path;
+}
+
+CanonCache* canon_cache_open(const char *dir, uint64_t max_bytes) {
+    if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+        perror(dir);
+        return NULL;
+    }
+    CanonCache *c = calloc(1, sizeof(CanonCache));
+    c->dir = strdup(dir);
+    c->max_bytes = max_bytes ? max_bytes : CANON_CACHE_SIZE;
+    pthread_mutex_init(&c->evict_lock, NULL);
+    return c;
+}
+
+/*
+ * Basis stored for (hash, size), or NULL on a miss
+ */
+GF2_Basis* canon_cache_get(CanonCache *c, uint64_t hash, uint64_t size) {
+    char *path = entry_path(c, hash, size);
+    GF2_Basis *B = NULL;
+    struct stat st;
+    if (stat(path, &st) == 0) {
+        B = load_compressed(path);
+        // A damaged entry is dropped rather than trusted
+        if (B && ((uint64_t)st.st_size != canon_encoded_size(B) || B->input_size != size)) {
+            fprintf(stderr, "Warning: Dropping damaged cache entry %s\n", path);
+            unlink(path);
+            basis_free(B);
+            B = NULL;
+        }
+        if (B) utimensat(AT_FDCWD, path, NULL, 0);   // LRU: now
+    }
+    free(path);
+    atomic_fetch_add(B ? &c->hits : &c->misses, 1);
+    return B;
+}
+
+typedef struct {
+    char *path;
+    uint64_t bytes;
+    struct timespec mtime;
+} CacheEntry;
+
+static int by_mtime(const void *a, const void *b) {
+    const CacheEntry *x = a, *y = b;
+    if (x->mtime.tv_sec != y->mtime.tv_sec) return x->mtime.tv_sec < y->mtime.tv_sec ? -1 : 1;
+    return (x->mtime.tv_nsec > y->mtime.tv_nsec) - (x->mtime.tv_nsec < y->mtime.tv_nsec);
+}
+
+/*
+ * Delete least recently used entries until under 90% of the bound
+ */
+static void cache_evict(CanonCache *c) {
+    if (pthread_mutex_trylock(&c->evict_lock) != 0) return;
+    size_t len = strlen(c->dir) + 16;
+    char *lock_path = malloc(len);
+    snprintf(lock_path, len, "%s/.lock", c->dir);
+    int lock = open(lock_path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    free(lock_path);
+    if (lock < 0 || flock(lock, LOCK_EX | LOCK_NB) != 0) {
+        if (lock >= 0) close(lock);
+        pthread_mutex_unlock(&c->evict_lock);
+        return;
+    }
+
+    CacheEntry *e = NULL;
+    size_t n = 0, cap = 0;
+    uint64_t total = 0;
+    time_t now = time(NULL);
+    DIR *top = opendir(c->dir);
+    struct dirent *d;
+    while (top && (d = readdir(top))) {
+        if (d->d_name[0] == '.') {
+            // Temporaries from writers that died before renaming
+            if (strncmp(d->d_name, ".tmp-", 5) == 0) {
+                struct stat st;
+                if (fstatat(dirfd(top), d->d_name, &st, 0) == 0 &&
+                    now - st.st_mtime > CACHE_STALE_TMP_SEC) {
+                    unlinkat(dirfd(top), d->d_name, 0);
+                }
+            }
+            continue;
+        }
+        size_t slen = strlen(c->dir) + strlen(d->d_name) + 2;
+        char *sub = malloc(slen);
+        snprintf(sub, slen, "%s/%s", c->dir, d->d_name);
+        DIR *dd = opendir(sub);
+        struct dirent *f;
+        while (dd && (f = readdir(dd))) {
+            struct stat st;
+            if (f->d_name[0] == '.' || fstatat(dirfd(dd), f->d_name, &st, 0) != 0 ||
+                !S_ISREG(st.st_mode)) {
+                continue;
+            }
+            if (n == cap) {
+                cap = cap ? cap * 2 : 256;
+                e = realloc(e, cap * sizeof(CacheEntry));
+            }
+            size_t plen = slen + strlen(f->d_name) + 1;
+            e[n].path = malloc(plen);
+            snprintf(e[n].path, plen, "%s/%s", sub, f->d_name);
+            e[n].bytes = (uint64_t)st.st_size;
+            e[n].mtime = st.st_mtim;
+            total += e[n].bytes;
+            n++;
+        }
+        if (dd) closedir(dd);
+        free(sub);
+    }
+    if (top) closedir(top);
+
+    if (total > c->max_bytes) {
+        qsort(e, n, sizeof(CacheEntry), by_mtime);
+        uint64_t target = c->max_bytes / 10 * 9;
+        for (size_t i = 0; i < n && total > target; i++) {
+            if (unlink(e[i].path) == 0) {
+                total -= e[i].bytes;
+                atomic_fetch_add(&c->evicted, 1);
+            }
+        }
+    }
+    for (size_t i = 0; i < n; i++) free(e[i].path);
+    free(e);
+
+    flock(lock, LOCK_UN);
+    close(lock);
+    pthread_mutex_unlock(&c->evict_lock);
+}
+
+/*
+ * Store B as the result for (hash, size); atomic for concurrent readers
+ */
+bool canon_cache_put(CanonCache *c, uint64_t hash, uint64_t size, const GF2_Basis *B) {
+    char *path = entry_path(c, hash, size);
+    size_t len = strlen(c->dir) + 64;
+    char *tmp = malloc(len);
+    snprintf(tmp, len, "%s/.tmp-%d-%u", c->dir, (int)getpid(), atomic_fetch_add(&c->tmp_seq, 1));
+
+    // Two-level fan-out keeps directories small
+    char *slash = strrchr(path, '/');
+    *slash = '\0';
+    mkdir(path, 0755);
+    *slash = '/';
+
+    bool ok = save_compressed(tmp, (GF2_Basis *)B) && rename(tmp, path) == 0;
+    if (!ok) unlink(tmp);
+    free(tmp);
+    free(path);
+    if (ok) atomic_fetch_add(&c->stores, 1);
+
+    if (atomic_fetch_add(&c->puts_since_evict, 1) + 1 >= CACHE_EVICT_EVERY) {
+        atomic_store(&c->puts_since_evict, 0);
+        cache_evict(c);
+    }
+    return ok;
+}
+
+void canon_cache_report(CanonCache *c, FILE *out) {
+    fprintf(out, "Cache %s: %lu hit(s), %lu miss(es), %lu stored, %lu evicted\n", c->dir,
+            (unsigned long)atomic_load(&c->hits), (unsigned long)atomic_load(&c->misses),
+            (unsigned long)atomic_load(&c->stores), (unsigned long)atomic_load(&c->evicted));
+}
+
+/*
+ * Enforce the size bound once more and release
+ */
+void canon_cache_close(CanonCache *c) {
+    if (!c) return;
+    if (atomic_load(&c->puts_since_evict) > 0) cache_evict(c);
+    pthread_mutex_destroy(&c->evict_lock);
+    free(c->dir);
+    free(c);
+}
@@ -0,0 +1,235 @@
+/*
+ * CANON - Checkpoint and resume for long compressions
+ *
+ * Author: Francesco Pedulli
+ * Date: February 26, 2026
+ *
+ * Every --checkpoint-every bytes of input, `canon compress` writes the
+ * partial basis, its derivation map and the input/stream offsets it
+ * covers to a sidecar file (<output>.ckpt). `--resume` loads that file
+ * and continues from the recorded offset instead of byte zero.
+ *
+ * Blocks are eliminated strictly in order, so a checkpoint taken at a
+ * block boundary is exactly the state a fresh run has at that offset:
+ * resumed output is identical to an uninterrupted run.
+ *
+ * The sidecar is replaced atomically (write, fsync, rename) and carries
+ * a checksum over its body. It is only accepted if the input still has
+ * the recorded size and mtime and the 4 KB before the offset hash the
+ * same. The sidecar is removed once the output is saved.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "canon.h"
+
+#define CKPT_MAGIC "CNCKPT1"   // 8 bytes with the terminator
+#define CKPT_SAMPLE 4096
+
+typedef struct {
+    char magic[8];
+    uint64_t input_size;
+    int64_t input_mtime_ns;
+    uint64_t offset;
+    uint64_t position;
+    uint64_t sample;
+    uint32_t rank;
+    uint32_t reserved;
+} CheckpointHeader;
+
+/*
+ * FNV-1a, continuing from h
+ */
+static uint64_t fnv1a(uint64_t h, const void *data, size_t len) {
+    const uint8_t *p = data;
+    for (size_t i = 0; i < len; i++) {
+        h ^= p[i];
+        h *= 0x100000001b3ull;
+    }
+    return h;
+}
+
+#define FNV_INIT 0xcbf29ce484222325ull
+
+/*
+ * Hash of the (up to) 4 KB of input that end at offset
+ */
+static bool input_sample(int fd, uint64_t offset, uint64_t *hash) {
+    _Alignas(4096) uint8_t buf[CKPT_SAMPLE];    // Input may be O_DIRECT
+    uint64_t len = offset < CKPT_SAMPLE ? offset : CKPT_SAMPLE;
+    uint64_t got = 0;
+    while (got < len) {
+        ssize_t k = pread(fd, buf + got, len - got, (off_t)(offset - len + got));
+        if (k < 0 && errno == EINTR) continue;
+        if (k <= 0) return false;
+        got += (uint64_t)k;
+    }
+    *hash = fnv1a(FNV_INIT, buf, len);
+    return true;
+}
+
+static bool write_all(int fd, const void *data, size_t len) {
+    const uint8_t *p = data;
+    while (len > 0) {
+        ssize_t k = write(fd, p, len);
+        if (k < 0 && errno == EINTR) continue;
+        if (k <= 0) return false;
+        p += k;
+        len -= (size_t)k;
+    }
+    return true;
+}
+
+/*
+ * Write the checkpoint for B at c->offset / c->position
+ */
+static bool checkpoint_save(const char *path, int input_fd, const GF2_Basis *B,
+                            CanonCheckpoint *c) {
+    CheckpointHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, CKPT_MAGIC, sizeof(h.magic));
+    h.input_size = c->input_size;
+    h.input_mtime_ns = c->input_mtime_ns;
+    h.offset = c->offset;
+    h.position = c->position;
+    h.rank = B->rank;
+    if (!input_sample(input_fd, c->offset, &h.sample)) return false;
+
+    uint64_t sum = fnv1a(FNV_INIT, &h, sizeof(h));
+    sum = fnv1a(sum, B->basis, B->rank);
+    sum = fnv1a(sum, B->derivation, B->rank * sizeof(uint32_t));
+
+    size_t len = strlen(path) + 5;
+    char *tmp = malloc(len);
+    snprintf(tmp, len, "%s.tmp", path);
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    bool ok = fd >= 0 &&
+              write_all(fd, &h, sizeof(h)) &&
+              write_all(fd, B->basis, B->rank) &&
+              write_all(fd, B->derivation, B->rank * sizeof(uint32_t)) &&
+              write_all(fd, &sum, sizeof(sum)) &&
+              fsync(fd) == 0;
+    if (fd >= 0 && close(fd) != 0) ok = false;
+    if (ok) ok = rename(tmp, path) == 0;
+    if (!ok) unlink(tmp);
+    free(tmp);
+    return ok;
+}
+
+/*
+ * Load and validate path against the open input
+ * Returns NULL (and reports why) if it does not belong to this input
+ */
+static GF2_Basis* checkpoint_load(const char *path, int input_fd, CanonCheckpoint *c) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return NULL;
+
+    CheckpointHeader h;
+    GF2_Basis *B = NULL;
+    const char *why = NULL;
+    uint64_t sum, stored;
+    if (fread(&h, sizeof(h), 1, f) != 1 || memcmp(h.magic, CKPT_MAGIC, sizeof(h.magic)) != 0) {
+        why = "not a checkpoint file";
+    } else if (h.rank > MAX_RANK) {
+        why = "corrupt header";
+    } else {
+        B = basis_init();
+        B->rank = h.rank;
+        sum = fnv1a(FNV_INIT, &h, sizeof(h));
+        if (fread(B->basis, 1, h.rank, f) != h.rank ||
+            fread(B->derivation, sizeof(uint32_t), h.rank, f) != h.rank ||
+            fread(&stored, sizeof(stored), 1, f) != 1) {
+            why = "truncated";
+        } else {
+            sum = fnv1a(sum, B->basis, h.rank);
+            sum = fnv1a(sum, B->derivation, h.rank * sizeof(uint32_t));
+            if (sum != stored) why = "checksum mismatch";
+        }
+    }
+    fclose(f);
+
+    uint64_t sample;
+    if (!why && (h.input_size != c->input_size || h.input_mtime_ns != c->input_mtime_ns)) {
+        why = "input size or modification time changed";
+    } else if (!why && h.offset > h.input_size) {
+        why = "offset past end of input";
+    } else if (!why && (!input_sample(input_fd, h.offset, &sample) || sample != h.sample)) {
+        why = "input content changed";
+    }
+    if (why) {
+        fprintf(stderr, "Error: Checkpoint %s rejected: %s\n", path, why);
+        basis_free(B);
+        return NULL;
+    }
+
+    basis_rebuild_signature(B);
+    c->offset = h.offset;
+    c->position = h.position;
+    return B;
+}
+
+/*
+ * Starting state for a run over input_fd
+ * *B is a fresh basis, or the checkpointed one with cfg->resume; c gets
+ * the offsets to continue from. False if a checkpoint exists but is
+ * rejected (resuming from zero would silently discard it).
+ */
+bool canon_checkpoint_start(const CanonCheckpointConfig *cfg, int input_fd,
+                            GF2_Basis **B, CanonCheckpoint *c) {
+    memset(c, 0, sizeof(*c));
+    struct stat st;
+    if (fstat(input_fd, &st) == 0) {
+        c->input_size = (uint64_t)st.st_size;
+        c->input_mtime_ns = (int64_t)st.st_mtim.tv_sec * 1000000000ll + st.st_mtim.tv_nsec;
+    }
+
+    *B = NULL;
+    if (cfg && cfg->path && cfg->resume) {
+        if (access(cfg->path, F_OK) != 0) {
+            printf("No checkpoint at %s, starting from the beginning\n", cfg->path);
+        } else {
+            *B = checkpoint_load(cfg->path, input_fd, c);
+            if (!*B) return false;
+            printf("Resuming from %s: offset %lu of %lu, rank %u\n",
+                   cfg->path, c->offset, c->input_size, (*B)->rank);
+        }
+    }
+    if (!*B) *B = basis_init();
+    c->last_saved = c->offset;
+    return true;
+}
+
+/*
+ * Record progress: input consumed up to offset, stream position reached
+ * Writes a checkpoint whenever cfg->every more bytes have gone by
+ */
+void canon_checkpoint_update(const CanonCheckpointConfig *cfg, int input_fd,
+                             const GF2_Basis *B, CanonCheckpoint *c,
+                             uint64_t offset, uint64_t position) {
+    c->offset = offset;
+    c->position = position;
+    if (!cfg || !cfg->path || offset - c->last_saved < cfg->every || offset >= c->input_size) {
+        return;
+    }
+    if (!checkpoint_save(cfg->path, input_fd, B, c)) {
+        fprintf(stderr, "\nWarning: Could not write checkpoint %s: %s\n", cfg->path, strerror(errno));
+    }
+    c->last_saved = offset;
+}
+
+/*
+ * Output is safely written: the checkpoint is no longer needed
+ */
+void canon_checkpoint_finish(const CanonCheckpointConfig *cfg) {
+    if (cfg && cfg->path) unlink(cfg->path);
+}
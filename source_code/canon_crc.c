@@ -0,0 +1,237 @@
+/*
+ * CANON - CRC32C block checksums
+ *
+ * Author: Francesco Pedulli
+ * Date: February 26, 2026
+ *
+ * Every .canon file ends in a table of CRC32C (Castagnoli) checksums,
+ * one per CANON_CRC_BLOCK bytes of everything before it. The loader
+ * recomputes them before trusting a single byte of the basis.
+ *
+ * With SSE4.2 and PCLMUL the checksum runs on three independent crc32
+ * streams per lane, which hides the instruction's 3-cycle latency, and
+ * the three partial CRCs are folded together with one carry-less
+ * multiply each. Without them a byte-wise table is used.
+ *
+ * Large buffers are verified on several threads, a contiguous run of
+ * blocks each; below CANON_CRC_PARALLEL bytes thread startup would cost
+ * more than the checksum itself, so they are verified inline.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#if defined(__SSE4_2__) && defined(__PCLMUL__)
+#include <immintrin.h>
+#define CRC_HW 1
+#endif
+
+#include "canon.h"
+
+#define POLY 0x82f63b78u        // Castagnoli, reflected
+#define CRC_MAX_THREADS 16
+
+#ifdef CRC_HW
+
+/*
+ * a * b modulo P, reflected (bit 31 is x^0)
+ */
+static uint32_t multmodp(uint32_t a, uint32_t b) {
+    uint32_t m = 1u << 31, p = 0;
+    for (;;) {
+        if (a & m) {
+            p ^= b;
+            if ((a & (m - 1)) == 0) break;
+        }
+        m >>= 1;
+        b = b & 1 ? (b >> 1) ^ POLY : b >> 1;
+    }
+    return p;
+}
+
+/*
+ * x^n modulo P
+ */
+static uint32_t xnmodp(uint64_t n) {
+    uint32_t p = 1u << 31, sq = 1u << 30;
+    for (; n; n >>= 1) {
+        if (n & 1) p = multmodp(p, sq);
+        sq = multmodp(sq, sq);
+    }
+    return p;
+}
+
+#define LANE_LONG 4096
+#define LANE_SHORT 256
+
+// Fold constants x^(8n-33): see crc_fold()
+static uint32_t k_long[2], k_short[2];
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+
+static void crc_init(void) {
+    k_long[0] = xnmodp(8ull * 2 * LANE_LONG - 33);
+    k_long[1] = xnmodp(8ull * LANE_LONG - 33);
+    k_short[0] = xnmodp(8ull * 2 * LANE_SHORT - 33);
+    k_short[1] = xnmodp(8ull * LANE_SHORT - 33);
+}
+
+static inline uint64_t clmul(uint32_t a, uint32_t b) {
+    return (uint64_t)_mm_cvtsi128_si64(_mm_clmulepi64_si128(_mm_cvtsi32_si128((int)a),
+                                                            _mm_cvtsi32_si128((int)b), 0));
+}
+
+/*
+ * c0 * x^(16 lane) + c1 * x^(8 lane) + c2
+ * clmul of two reflected 32-bit values is x * a * b in 64 bits, and
+ * crc32 of a 64-bit word w from zero is w * x^32, so multiplying by
+ * x^(8n-33) and reducing with crc32 shifts by exactly n bytes
+ */
+static inline uint32_t crc_fold(uint32_t c0, uint32_t c1, uint32_t c2, const uint32_t *k) {
+    return (uint32_t)_mm_crc32_u64(0, clmul(c0, k[0]) ^ clmul(c1, k[1])) ^ c2;
+}
+
+static inline uint64_t load64(const uint8_t *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+/*
+ * Three streams of lane bytes each, while at least 3 lanes remain
+ */
+static uint32_t crc_lanes(uint32_t crc, const uint8_t **pp, size_t *len, size_t lane,
+                          const uint32_t *k) {
+    const uint8_t *p = *pp;
+    while (*len >= 3 * lane) {
+        uint32_t c0 = crc, c1 = 0, c2 = 0;
+        for (size_t i = 0; i < lane; i += 8) {
+            c0 = (uint32_t)_mm_crc32_u64(c0, load64(p + i));
+            c1 = (uint32_t)_mm_crc32_u64(c1, load64(p + lane + i));
+            c2 = (uint32_t)_mm_crc32_u64(c2, load64(p + 2 * lane + i));
+        }
+        crc = crc_fold(c0, c1, c2, k);
+        p += 3 * lane;
+        *len -= 3 * lane;
+    }
+    *pp = p;
+    return crc;
+}
+
+static uint32_t crc_update(uint32_t crc, const uint8_t *p, size_t len) {
+    pthread_once(&crc_once, crc_init);
+    crc = crc_lanes(crc, &p, &len, LANE_LONG, k_long);
+    crc = crc_lanes(crc, &p, &len, LANE_SHORT, k_short);
+    for (; len >= 8; p += 8, len -= 8) crc = (uint32_t)_mm_crc32_u64(crc, load64(p));
+    for (; len; p++, len--) crc = _mm_crc32_u8(crc, *p);
+    return crc;
+}
+
+#else
+
+static uint32_t crc_table[256];
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+
+static void crc_init(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++) c = c & 1 ? (c >> 1) ^ POLY : c >> 1;
+        crc_table[i] = c;
+    }
+}
+
+static uint32_t crc_update(uint32_t crc, const uint8_t *p, size_t len) {
+    pthread_once(&crc_once, crc_init);
+    for (; len; p++, len--) crc = crc_table[(crc ^ *p) & 0xff] ^ (crc >> 8);
+    return crc;
+}
+
+#endif
+
+/*
+ * CRC32C of data, continuing from crc (0 to start)
+ */
+uint32_t canon_crc32c(uint32_t crc, const void *data, size_t len) {
+    return ~crc_update(~crc, data, len);
+}
+
+uint32_t canon_crc_blocks(uint64_t len) {
+    return (uint32_t)((len + CANON_CRC_BLOCK - 1) / CANON_CRC_BLOCK);
+}
+
+/*
+ * Checksum table for len bytes of data: one CRC32C per block
+ */
+void canon_crc_sign(const uint8_t *data, uint64_t len, uint32_t *sums) {
+    uint32_t n = canon_crc_blocks(len);
+    for (uint32_t b = 0; b < n; b++) {
+        uint64_t at = (uint64_t)b * CANON_CRC_BLOCK;
+        uint64_t end = at + CANON_CRC_BLOCK < len ? at + CANON_CRC_BLOCK : len;
+        sums[b] = canon_crc32c(0, data + at, end - at);
+    }
+}
+
+typedef struct {
+    const uint8_t *data;
+    uint64_t len;
+    const uint32_t *sums;
+    uint32_t first, last;   // Blocks [first, last)
+    int64_t bad;            // First mismatching block, -1 if none
+} VerifyRange;
+
+static void* verify_range(void *arg) {
+    VerifyRange *v = arg;
+    v->bad = -1;
+    for (uint32_t b = v->first; b < v->last; b++) {
+        uint64_t at = (uint64_t)b * CANON_CRC_BLOCK;
+        uint64_t end = at + CANON_CRC_BLOCK < v->len ? at + CANON_CRC_BLOCK : v->len;
+        if (canon_crc32c(0, v->data + at, end - at) != v->sums[b]) {
+            v->bad = b;
+            break;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Check len bytes of data against their checksum table
+ * Returns the first block that does not match, or -1 if all do
+ */
+int64_t canon_crc_verify(const uint8_t *data, uint64_t len, const uint32_t *sums) {
+    uint32_t n = canon_crc_blocks(len);
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    uint64_t threads = len / CANON_CRC_PARALLEL;
+    if (threads > (uint64_t)cpus) threads = (uint64_t)cpus;
+    if (threads > CRC_MAX_THREADS) threads = CRC_MAX_THREADS;
+    if (threads > n) threads = n;
+
+    VerifyRange r[CRC_MAX_THREADS];
+    if (threads <= 1) {
+        r[0] = (VerifyRange){ data, len, sums, 0, n, -1 };
+        verify_range(&r[0]);
+        return r[0].bad;
+    }
+
+    pthread_t tid[CRC_MAX_THREADS];
+    bool started[CRC_MAX_THREADS];
+    for (uint32_t t = 0; t < threads; t++) {
+        r[t] = (VerifyRange){ data, len, sums, (uint32_t)(n * t / threads),
+                              (uint32_t)(n * (t + 1) / threads), -1 };
+        started[t] = t > 0 && pthread_create(&tid[t], NULL, verify_range, &r[t]) == 0;
+        if (t > 0 && !started[t]) verify_range(&r[t]);
+    }
+    verify_range(&r[0]);
+
+    int64_t bad = -1;
+    for (uint32_t t = 0; t < threads; t++) {
+        if (started[t]) pthread_join(tid[t], NULL);
+        if (bad < 0 && r[t].bad >= 0) bad = r[t].bad;
+    }
+    return bad;
+}
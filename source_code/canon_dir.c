@@ -0,0 +1,316 @@
+/*
+ * CANON - Directory and file-list batch mode with a corpus basis
+ *
+ * Author: Francesco Pedulli
+ * Date: February 26, 2026
+ *
+ * `canon compress-dir` compresses every regular file under a tree (or
+ * every path in a --files-from list) on the work-stealing pool, writing
+ * one .canon per file next to it or mirrored under --out-dir. With
+ * --corpus the per-file bases are also merged, in sorted path order, into
+ * one corpus-wide basis whose derivations are offsets into the
+ * concatenation of the files in that order. It can seed dictionary
+ * training or cross-file dedup without a second pass over the data.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <time.h>
+#include <fts.h>
+#include <sys/stat.h>
+
+#include "canon.h"
+
+typedef struct {
+    char **paths;
+    uint64_t *sizes;
+    uint32_t n, cap;
+} FileList;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static bool has_suffix(const char *s, const char *suffix) {
+    size_t n = strlen(s), m = strlen(suffix);
+    return n >= m && strcmp(s + n - m, suffix) == 0;
+}
+
+static void list_add(FileList *l, const char *path, uint64_t size) {
+    if (l->n == l->cap) {
+        l->cap = l->cap ? l->cap * 2 : 256;
+        l->paths = realloc(l->paths, l->cap * sizeof(char *));
+        l->sizes = realloc(l->sizes, l->cap * sizeof(uint64_t));
+    }
+    l->paths[l->n] = strdup(path);
+    l->sizes[l->n] = size;
+    l->n++;
+}
+
+/*
+ * Add the regular files under root; false if root cannot be walked
+ */
+static bool walk_tree(FileList *l, const char *root) {
+    char *roots[] = { (char *)root, NULL };
+    FTS *fts = fts_open(roots, FTS_PHYSICAL | FTS_NOCHDIR, NULL);
+    if (!fts) {
+        perror(root);
+        return false;
+    }
+    bool ok = true;
+    FTSENT *e;
+    while ((e = fts_read(fts)) != NULL) {
+        if (e->fts_info == FTS_DNR || e->fts_info == FTS_ERR || e->fts_info == FTS_NS) {
+            errno = e->fts_errno;
+            perror(e->fts_path);
+            if (e->fts_level == FTS_ROOTLEVEL) ok = false;
+            continue;
+        }
+        // Regular files only; earlier outputs are not inputs
+        if (e->fts_info == FTS_F && S_ISREG(e->fts_statp->st_mode) && !has_suffix(e->fts_path, ".canon")) {
+            list_add(l, e->fts_path, (uint64_t)e->fts_statp->st_size);
+        }
+    }
+    fts_close(fts);
+    return ok;
+}
+
+/*
+ * Read newline-separated paths from a list file ("-" = stdin)
+ */
+static bool read_files_from(FileList *l, const char *list) {
+    FILE *f = strcmp(list, "-") == 0 ? stdin : fopen(list, "r");
+    if (!f) {
+        perror("Error opening file list");
+        return false;
+    }
+
+    char *line = NULL;
+    size_t cap = 0;
+    ssize_t len;
+    while ((len = getline(&line, &cap, f)) > 0) {
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) line[--len] = '\0';
+        if (len == 0) continue;
+        struct stat st;
+        if (stat(line, &st) != 0 || !S_ISREG(st.st_mode)) {
+            fprintf(stderr, "Error: %s: not a regular file\n", line);
+            continue;
+        }
+        list_add(l, line, (uint64_t)st.st_size);
+    }
+    free(line);
+    if (f != stdin) fclose(f);
+    return true;
+}
+
+/*
+ * mkdir -p for the directory part of path
+ */
+bool canon_make_parents(char *path) {
+    for (char *p = path + 1; *p; p++) {
+        if (*p != '/') continue;
+        *p = '\0';
+        bool ok = mkdir(path, 0777) == 0 || errno == EEXIST;
+        *p = '/';
+        if (!ok) {
+            perror(path);
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Output for input: beside it, or mirrored under out_dir
+ * NULL if the mirrored path would leave out_dir
+ */
+static char* output_path(const char *input, const char *root, const char *out_dir) {
+    size_t len;
+    char *out;
+    if (!out_dir) {
+        len = strlen(input) + 7;
+        out = malloc(len);
+        snprintf(out, len, "%s.canon", input);
+        return out;
+    }
+
+    // Mirror the path relative to the walked root under out_dir
+    const char *rel = input;
+    size_t rl = root ? strlen(root) : 0;
+    if (root && strncmp(input, root, rl) == 0) rel = input + rl;
+    while (*rel == '/') rel++;
+    if (!canon_safe_name(rel)) return NULL;
+    len = strlen(out_dir) + strlen(rel) + 8;
+    out = malloc(len);
+    snprintf(out, len, "%s/%s.canon", out_dir, rel);
+    return out;
+}
+
+/*
+ * Merge per-file bases in job order into one corpus basis
+ * Derivations become offsets into the concatenation of the inputs;
+ * NULL (reported) if that exceeds CANON_MAX_INPUT
+ */
+GF2_Basis* canon_corpus_merge(const CanonFileJob *jobs, uint32_t n) {
+    uint64_t size = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        if (jobs[i].basis) size += jobs[i].size;
+    }
+    if (size > CANON_MAX_INPUT) {
+        fprintf(stderr, "Error: Corpus of %lu bytes exceeds the %llu-byte derivation range\n",
+                size, CANON_MAX_INPUT);
+        return NULL;
+    }
+
+    GF2_Basis *C = basis_init();
+    uint64_t base = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        GF2_Basis *P = jobs[i].basis;
+        if (!P) continue;
+        for (uint32_t k = 0; k < P->rank; k++) {
+            add_to_basis(C, P->basis[k], (uint32_t)(base + P->derivation[k]));
+        }
+        base += jobs[i].size;
+    }
+    C->input_size = base;
+    return C;
+}
+
+static void jobs_free(CanonFileJob *jobs, FileList *l) {
+    for (uint32_t i = 0; i < l->n; i++) {
+        if (jobs) free((char *)jobs[i].output);
+        free(l->paths[i]);
+    }
+    free(jobs);
+    free(l->paths);
+    free(l->sizes);
+}
+
+static int by_path(const void *a, const void *b) {
+    return strcmp(((const CanonFileJob *)a)->input, ((const CanonFileJob *)b)->input);
+}
+
+/*
+ * `canon compress-dir <dir> | --files-from LIST [--out-dir DIR]
+ *  [--corpus FILE] [--threads N] [--chunk BYTES] [--split]
+ *  [--io mmap|uring|threads] [--queue-depth N] [--pin]
+ *  [--hugepages off|thp|hugetlb] [--cache DIR [--cache-size BYTES]]`
+ */
+int canon_compress_dir_main(int argc, char **argv) {
+    CanonFilesConfig cfg = CANON_FILES_DEFAULTS;
+    const char *root = NULL, *files_from = NULL, *out_dir = NULL, *corpus = NULL;
+    int threads = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--files-from") == 0 && i + 1 < argc) {
+            files_from = argv[++i];
+        } else if (strcmp(argv[i], "--out-dir") == 0 && i + 1 < argc) {
+            out_dir = argv[++i];
+        } else if (strcmp(argv[i], "--corpus") == 0 && i + 1 < argc) {
+            corpus = argv[++i];
+        } else if (canon_files_option(&cfg, &threads, argc, argv, &i)) {
+            continue;
+        } else if (strncmp(argv[i], "--", 2) != 0 && !root) {
+            root = argv[i];
+        } else {
+            fprintf(stderr, "Error: Unknown option '%s'\n", argv[i]);
+            return 1;
+        }
+    }
+    if (!root == !files_from) {
+        fprintf(stderr, "Usage: canon compress-dir <dir> | --files-from LIST [--out-dir DIR]\n"
+                        "       [--corpus FILE] [--threads N] [--chunk BYTES] [--split]\n"
+                        "       [--io mmap|uring|threads] [--queue-depth N] [--pin]\n"
+                        "       [--hugepages off|thp|hugetlb] [--cache DIR [--cache-size BYTES]]\n");
+        return 1;
+    }
+    cfg.keep_bases = corpus != NULL;
+
+    FileList list = { 0 };
+    FileList *l = &list;
+    if (root ? !walk_tree(l, root) : !read_files_from(l, files_from)) {
+        jobs_free(NULL, l);
+        return 1;
+    }
+    if (l->n == 0) {
+        fprintf(stderr, "Error: No input files\n");
+        jobs_free(NULL, l);
+        return 1;
+    }
+
+    // Sorted by path: stable output naming and corpus merge order
+    CanonFileJob *jobs = calloc(l->n, sizeof(CanonFileJob));
+    for (uint32_t i = 0; i < l->n; i++) {
+        jobs[i].input = l->paths[i];
+        jobs[i].size = l->sizes[i];
+    }
+    qsort(jobs, l->n, sizeof(CanonFileJob), by_path);
+
+    for (uint32_t i = 0; i < l->n; i++) {
+        jobs[i].output = output_path(jobs[i].input, root, out_dir);
+        if (!jobs[i].output) {
+            fprintf(stderr, "Error: %s: would be written outside %s\n", jobs[i].input, out_dir);
+            jobs_free(jobs, l);
+            return 1;
+        }
+    }
+    for (uint32_t i = 0; out_dir && i < l->n; i++) {
+        if (!canon_make_parents((char *)jobs[i].output)) {
+            jobs_free(jobs, l);
+            return 1;
+        }
+    }
+
+    CanonPool *pool = canon_pool_create(threads, cfg.pin ? CANON_POOL_PIN : 0);
+    if (!pool) {
+        jobs_free(jobs, l);
+        return 1;
+    }
+    printf("Compressing %u file(s) from %s\n\n", l->n, root ? root : files_from);
+    fflush(stdout);
+
+    uint64_t t0 = now_ns();
+    int failed = canon_compress_files(pool, jobs, l->n, &cfg);
+    double sec = (now_ns() - t0) / 1e9;
+
+    uint64_t total = 0, encoded = 0;
+    for (uint32_t i = 0; i < l->n; i++) {
+        CanonFileJob *j = &jobs[i];
+        if (j->failed) {
+            printf("✗ %s\n", j->input);
+            continue;
+        }
+        printf("✓ %s -> %s: %lu bytes, rank %u\n", j->input, j->output, j->size, j->rank);
+        total += j->size;
+        encoded += j->encoded;
+    }
+    printf("\nTotal: %lu bytes -> %lu bytes in %.3f seconds (%.2f MB/s), %d failed\n",
+           total, encoded, sec, sec > 0 ? total / 1048576.0 / sec : 0.0, failed);
+    canon_pool_report(pool, stdout);
+    canon_huge_report(stdout);
+    canon_pool_destroy(pool);
+
+    if (corpus) {
+        // Merge in path order; derivations become corpus stream offsets
+        GF2_Basis *C = canon_corpus_merge(jobs, l->n);
+        if (C && save_compressed(corpus, C)) {
+            printf("✓ Corpus basis saved: %s (rank %u over %lu bytes)\n", corpus, C->rank,
+                   C->input_size);
+        } else {
+            failed++;
+        }
+        basis_free(C);
+    }
+
+    for (uint32_t i = 0; i < l->n; i++) basis_free(jobs[i].basis);
+    jobs_free(jobs, l);
+    return failed ? 1 : 0;
+}
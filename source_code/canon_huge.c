@@ -0,0 +1,233 @@
+/*
+ * CANON - 2 MB page backing for input mappings and I/O buffers
+ *
+ * Author: Francesco Pedulli
+ * Date: February 26, 2026
+ *
+ * Large inputs are walked linearly and I/O buffers are rewritten all
+ * the time; with 4 KB pages both cost a TLB miss every few thousand
+ * bytes. Two ways to get 2 MB pages:
+ *
+ * - thp:     2 MB aligned regions with madvise(MADV_HUGEPAGE). Works
+ *            wherever transparent hugepages are "always" or "madvise";
+ *            the kernel may still hand out small pages.
+ * - hugetlb: MAP_HUGETLB from the reserved pool (vm.nr_hugepages).
+ *            Guaranteed once the mapping succeeds. Inputs are read
+ *            into a hugetlb buffer, since hugetlbfs cannot back a
+ *            regular file. When the pool is short, thp is used instead.
+ *
+ * Regions under one huge page stay on normal pages. Pages actually
+ * obtained are read from /proc/self/smaps when each region is released
+ * and summarised by canon_huge_report().
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <linux/mman.h>
+
+#include "canon.h"
+
+static int huge_mode = CANON_HUGE_OFF;
+static atomic_ulong pages_wanted;
+static atomic_ulong pages_hugetlb;
+static atomic_ulong pages_thp;
+static atomic_ulong hugetlb_fallbacks;
+
+/*
+ * Parse "off", "thp" or "hugetlb" and make it the process-wide mode
+ * Set once at startup: regions are sized by the mode they were made in
+ */
+bool canon_huge_option(const char *value) {
+    if (strcmp(value, "off") == 0) {
+        huge_mode = CANON_HUGE_OFF;
+    } else if (strcmp(value, "thp") == 0) {
+        huge_mode = CANON_HUGE_THP;
+    } else if (strcmp(value, "hugetlb") == 0) {
+        huge_mode = CANON_HUGE_HUGETLB;
+    } else {
+        fprintf(stderr, "Error: Unknown hugepage mode '%s' (off, thp, hugetlb)\n", value);
+        return false;
+    }
+    return true;
+}
+
+int canon_huge_mode(void) {
+    return huge_mode;
+}
+
+/*
+ * Bytes actually reserved for a region of len bytes
+ */
+static size_t huge_span(size_t len) {
+    if (huge_mode == CANON_HUGE_OFF || len < CANON_HUGE_PAGE) return len;
+    return (len + CANON_HUGE_PAGE - 1) & ~(size_t)(CANON_HUGE_PAGE - 1);
+}
+
+/*
+ * 2 MB aligned reservation of span bytes (PROT_NONE until mapped over)
+ */
+static uint8_t* reserve_aligned(size_t span, int prot) {
+    size_t total = span + CANON_HUGE_PAGE;
+    uint8_t *raw = mmap(NULL, total, prot, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (raw == MAP_FAILED) return NULL;
+    uint8_t *p = (uint8_t *)(((uintptr_t)raw + CANON_HUGE_PAGE - 1) & ~(uintptr_t)(CANON_HUGE_PAGE - 1));
+    if (p > raw) munmap(raw, (size_t)(p - raw));
+    if (raw + total > p + span) munmap(p + span, (size_t)(raw + total - (p + span)));
+    return p;
+}
+
+static uint8_t* hugetlb_map(size_t span) {
+    uint8_t *p = mmap(NULL, span, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_HUGE_2MB, -1, 0);
+    if (p == MAP_FAILED) {
+        atomic_fetch_add(&hugetlb_fallbacks, 1);
+        return NULL;
+    }
+    return p;
+}
+
+/*
+ * Huge pages mapped in [p, p+span), from /proc/self/smaps
+ */
+static void region_pages(const void *p, size_t span, uint64_t *hugetlb, uint64_t *thp) {
+    *hugetlb = *thp = 0;
+    FILE *f = fopen("/proc/self/smaps", "r");
+    if (!f) return;
+    uintptr_t lo = (uintptr_t)p, hi = lo + span;
+    bool inside = false;
+    uint64_t tlb_kb = 0, thp_kb = 0;
+    char line[512];
+    while (fgets(line, sizeof(line), f)) {
+        unsigned long start, end, kb;
+        if (sscanf(line, "%lx-%lx ", &start, &end) == 2) {
+            inside = start < hi && end > lo;
+        } else if (!inside) {
+            continue;
+        } else if (sscanf(line, "AnonHugePages: %lu kB", &kb) == 1 ||
+                   sscanf(line, "FilePmdMapped: %lu kB", &kb) == 1) {
+            thp_kb += kb;
+        } else if (sscanf(line, "Private_Hugetlb: %lu kB", &kb) == 1 ||
+                   sscanf(line, "Shared_Hugetlb: %lu kB", &kb) == 1) {
+            tlb_kb += kb;
+        }
+    }
+    fclose(f);
+    *hugetlb = tlb_kb * 1024 / CANON_HUGE_PAGE;
+    *thp = thp_kb * 1024 / CANON_HUGE_PAGE;
+}
+
+/*
+ * Count what a region got, then unmap it
+ */
+static void huge_release(void *p, size_t span) {
+    if (span >= CANON_HUGE_PAGE && huge_mode != CANON_HUGE_OFF) {
+        uint64_t tlb, thp;
+        region_pages(p, span, &tlb, &thp);
+        atomic_fetch_add(&pages_wanted, span / CANON_HUGE_PAGE);
+        atomic_fetch_add(&pages_hugetlb, tlb);
+        atomic_fetch_add(&pages_thp, thp);
+    }
+    munmap(p, span);
+}
+
+/*
+ * Zeroed, page-aligned read/write buffer; NULL on failure
+ * 2 MB aligned and huge-backed when a mode is set and len allows
+ */
+void* canon_huge_alloc(size_t len) {
+    size_t span = huge_span(len);
+    if (span < CANON_HUGE_PAGE || huge_mode == CANON_HUGE_OFF) {
+        void *p = mmap(NULL, span, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        return p == MAP_FAILED ? NULL : p;
+    }
+    if (huge_mode == CANON_HUGE_HUGETLB) {
+        uint8_t *p = hugetlb_map(span);
+        if (p) return p;
+    }
+    uint8_t *p = reserve_aligned(span, PROT_READ | PROT_WRITE);
+    if (p) madvise(p, span, MADV_HUGEPAGE);
+    return p;
+}
+
+void canon_huge_free(void *p, size_t len) {
+    if (!p) return;
+    huge_release(p, huge_span(len));
+}
+
+/*
+ * Read-only view of size bytes of fd, like mmap(PROT_READ, MAP_PRIVATE)
+ * Returns NULL (errno set) on failure; release with canon_huge_unmap_file()
+ */
+const uint8_t* canon_huge_map_file(int fd, uint64_t size) {
+    size_t span = huge_span(size);
+    if (span < CANON_HUGE_PAGE || huge_mode == CANON_HUGE_OFF) {
+        void *p = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        return p == MAP_FAILED ? NULL : p;
+    }
+
+    if (huge_mode == CANON_HUGE_HUGETLB) {
+        uint8_t *p = hugetlb_map(span);
+        if (p) {
+            uint64_t got = 0;
+            while (got < size) {
+                ssize_t k = pread(fd, p + got, size - got, (off_t)got);
+                if (k < 0 && errno == EINTR) continue;
+                if (k <= 0) break;
+                got += (uint64_t)k;
+            }
+            if (got == size) {
+                mprotect(p, span, PROT_READ);
+                return p;
+            }
+            munmap(p, span);
+            errno = EIO;
+            return NULL;
+        }
+    }
+
+    // File pages over an aligned reservation; the tail stays PROT_NONE
+    uint8_t *p = reserve_aligned(span, PROT_NONE);
+    if (!p) return NULL;
+    if (mmap(p, size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+        int err = errno;
+        munmap(p, span);
+        errno = err;
+        return NULL;
+    }
+    madvise(p, size, MADV_HUGEPAGE);
+    return p;
+}
+
+void canon_huge_unmap_file(const uint8_t *p, uint64_t size) {
+    if (!p) return;
+    huge_release((void *)p, huge_span(size));
+}
+
+/*
+ * Give consumed input pages back, unless they are huge-backed
+ * Dropping part of a 2 MB mapping would split it again
+ */
+void canon_huge_drop(const void *p, size_t len) {
+    if (huge_mode == CANON_HUGE_OFF) madvise((void *)p, len, MADV_DONTNEED);
+}
+
+void canon_huge_report(FILE *out) {
+    if (huge_mode == CANON_HUGE_OFF) return;
+    unsigned long wanted = atomic_load(&pages_wanted);
+    unsigned long tlb = atomic_load(&pages_hugetlb);
+    unsigned long thp = atomic_load(&pages_thp);
+    fprintf(out, "Hugepages (%s): %lu of %lu 2 MB page(s) obtained, %lu hugetlb, %lu transparent",
+            huge_mode == CANON_HUGE_HUGETLB ? "hugetlb" : "thp", tlb + thp, wanted, tlb, thp);
+    unsigned long fallbacks = atomic_load(&hugetlb_fallbacks);
+    if (fallbacks) fprintf(out, ", %lu hugetlb fallback(s) to thp", fallbacks);
+    fprintf(out, "\n");
+}
@@ -0,0 +1,851 @@
+/*
+ * CANON - Asynchronous batch I/O: io_uring with a thread fallback
+ *
+ * Author: Francesco Pedulli
+ * Date: February 26, 2026
+ *
+ * With `--io uring` the batch modes stop mapping files. Instead one I/O
+ * loop (the calling thread) keeps up to --queue-depth reads in flight
+ * across many files into registered buffers. Completed blocks go to the
+ * work-stealing pool, and the encoded outputs come back to the loop as
+ * writes. Buffers are the only bound: a block's buffer returns to the loop
+ * once it has been eliminated, so the disks never run ahead of the
+ * workers by more than the buffer pool.
+ *
+ * io_uring is driven through raw syscalls. Workers wake the loop through
+ * an eventfd read that is kept armed on the ring. When io_uring is
+ * unavailable (old kernel, seccomp) or `--io threads` is asked for, a few
+ * I/O threads do pread/pwrite against the same request and completion
+ * path; the reason is reported. Registered buffers are pinned memory, so
+ * without CAP_IPC_LOCK --queue-depth is capped to what RLIMIT_MEMLOCK
+ * allows rather than losing io_uring altogether. A ring that fails
+ * mid-run fails the files still in progress.
+ *
+ * Blocks of one file are eliminated strictly in offset order by a single
+ * drain task at a time, so output is identical to `canon compress`.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/syscall.h>
+#include <sys/eventfd.h>
+#include <linux/capability.h>
+#include <linux/io_uring.h>
+
+#include "canon.h"
+
+#define IO_BLOCK (256u * 1024u)
+#define IO_THREADS 4
+
+#define TAG_WAKE 0ull
+#define TAG_WRITE 1ull           // Low bit set: IOFile*, clear: IOBuf*
+
+struct IOEngine;
+
+typedef struct IOBuf {
+    uint8_t *data;
+    uint16_t index;             // Registered buffer index
+    uint16_t node;              // NUMA node the buffer memory prefers
+    struct IOFile *file;
+    uint64_t offset;
+    uint32_t len;               // Requested length
+    uint32_t filled;
+    bool error;
+    struct IOBuf *next;
+} IOBuf;
+
+typedef struct IOFile {
+    struct IOEngine *io;
+    CanonFileJob *job;
+    int fd;
+    int node;                   // Buffers and drain tasks prefer this node
+    uint64_t read_off;          // Next offset to issue (I/O loop only)
+    uint32_t held;              // Buffers issued and not yet released
+    uint32_t inflight;          // Reads at the device
+
+    pthread_mutex_t lock;       // Guards ready, next_off, draining
+    IOBuf *ready;               // Completed blocks, sorted by offset
+    uint64_t next_off;
+    bool draining;
+    bool failed;
+
+    GF2_Basis *B;
+    uint64_t compute_ns;
+
+    // Output, written by the I/O loop
+    uint8_t *out;
+    uint64_t out_len, out_done;
+    int out_fd;
+    uint64_t write_t0;
+    struct IOFile *next_write;
+} IOFile;
+
+typedef struct {
+    uint64_t tag;
+    int64_t res;
+} IOCompletion;
+
+typedef struct IOEngine {
+    CanonPool *pool;
+    const CanonFilesConfig *cfg;
+    CanonFileJob **order;
+    uint32_t n, next_file, files_left, open_files;
+
+    IOBuf *bufs;
+    uint8_t *arena;
+    uint32_t nbufs;
+    IOBuf *free_bufs[CANON_MAX_NODES];  // Per node, I/O loop only
+    uint32_t nfree;
+    int nnodes;
+    uint32_t per_file_cap;
+
+    IOFile **active;            // Open files with reads left to issue
+    uint32_t nactive, rr;
+    uint32_t inflight;          // Reads and writes at the device
+
+    // Inbox from workers: released buffers and finished outputs
+    pthread_mutex_t lock;
+    pthread_cond_t cond;        // Thread backend: inbox or completion
+    IOBuf *released;
+    IOFile *writes;
+
+    // io_uring backend
+    bool uring;
+    int ring_fd, event_fd;
+    uint64_t event_val;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_ptr, *cq_ptr;
+    size_t sq_len, cq_len, sqes_len;
+    unsigned to_submit;
+
+    // Thread backend
+    pthread_t threads[IO_THREADS];
+    IOCompletion *done;         // Completions waiting for the loop
+    uint32_t ndone, done_cap;
+    struct IORequest *requests; // FIFO for I/O threads
+    struct IORequest *requests_tail;
+    pthread_cond_t request_cond;
+    bool stop;
+} IOEngine;
+
+typedef struct IORequest {
+    bool write;
+    int fd;
+    uint8_t *data;
+    uint64_t len, offset;
+    uint64_t tag;
+    struct IORequest *next;
+} IORequest;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/* ---- io_uring backend (raw syscalls, no liburing) ---- */
+
+/*
+ * Whether the kernel supports every opcode the engine submits. Rings
+ * exist from 5.1, but IORING_OP_READ and IORING_OP_WRITE (and the probe
+ * itself) only from 5.6; older kernels fail each of those with -EINVAL.
+ */
+static bool uring_probe(int fd) {
+    static const uint8_t needed[] = { IORING_OP_READ, IORING_OP_READ_FIXED, IORING_OP_WRITE };
+    struct io_uring_probe *probe = calloc(1, sizeof(struct io_uring_probe) +
+                                                 256 * sizeof(struct io_uring_probe_op));
+    if (!probe) return false;
+    bool ok = syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, 256) >= 0;
+    for (size_t i = 0; ok && i < sizeof(needed); i++) {
+        ok = needed[i] <= probe->last_op && (probe->ops[needed[i]].flags & IO_URING_OP_SUPPORTED);
+    }
+    free(probe);
+    return ok;
+}
+
+/*
+ * Registered buffers that fit in RLIMIT_MEMLOCK (UINT32_MAX: no limit)
+ * One block is left for the rings, which older kernels also charge.
+ */
+static uint32_t uring_max_bufs(void) {
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_MEMLOCK, &rl) != 0 || rl.rlim_cur == RLIM_INFINITY) return UINT32_MAX;
+    struct __user_cap_header_struct hdr = { _LINUX_CAPABILITY_VERSION_3, 0 };
+    struct __user_cap_data_struct caps[_LINUX_CAPABILITY_U32S_3];
+    if (syscall(SYS_capget, &hdr, caps) == 0 && (caps[0].effective & (1u << CAP_IPC_LOCK))) {
+        return UINT32_MAX;
+    }
+    uint64_t fit = rl.rlim_cur / IO_BLOCK;
+    return fit > 1 ? (uint32_t)(fit - 1) : 0;
+}
+
+/*
+ * Set up the ring; NULL on success, else what failed (errno is kept)
+ */
+static const char* uring_setup(IOEngine *io) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    unsigned entries = 1;
+    while (entries < 2 * io->nbufs + 2) entries <<= 1;
+
+    int fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+    if (fd < 0) return "io_uring_setup";
+    if (!uring_probe(fd)) {
+        close(fd);
+        errno = EOPNOTSUPP;
+        return "probing READ/WRITE opcodes (kernel 5.6+)";
+    }
+
+    io->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    io->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    io->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+
+    io->sq_ptr = mmap(NULL, io->sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      fd, IORING_OFF_SQ_RING);
+    io->cq_ptr = mmap(NULL, io->cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      fd, IORING_OFF_CQ_RING);
+    io->sqes = mmap(NULL, io->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                    fd, IORING_OFF_SQES);
+    if (io->sq_ptr == MAP_FAILED || io->cq_ptr == MAP_FAILED || io->sqes == MAP_FAILED) {
+        int err = errno;
+        close(fd);
+        errno = err;
+        return "mapping the rings";
+    }
+
+    uint8_t *sq = io->sq_ptr, *cq = io->cq_ptr;
+    io->sq_head = (unsigned *)(sq + p.sq_off.head);
+    io->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    io->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+    io->sq_array = (unsigned *)(sq + p.sq_off.array);
+    io->cq_head = (unsigned *)(cq + p.cq_off.head);
+    io->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    io->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+    io->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+
+    // Registered buffers: pinned once, no per-read page walks
+    struct iovec *iov = malloc(io->nbufs * sizeof(struct iovec));
+    for (uint32_t i = 0; i < io->nbufs; i++) {
+        iov[i].iov_base = io->bufs[i].data;
+        iov[i].iov_len = IO_BLOCK;
+    }
+    long r = syscall(__NR_io_uring_register, fd, IORING_REGISTER_BUFFERS, iov, io->nbufs);
+    int err = errno;
+    free(iov);
+    if (r < 0) {
+        close(fd);
+        errno = err;
+        return "registering buffers (RLIMIT_MEMLOCK?)";
+    }
+
+    io->event_fd = eventfd(0, EFD_CLOEXEC);
+    if (io->event_fd < 0) {
+        err = errno;
+        close(fd);
+        errno = err;
+        return "eventfd";
+    }
+    io->ring_fd = fd;
+    return NULL;
+}
+
+static struct io_uring_sqe* uring_sqe(IOEngine *io) {
+    unsigned tail = *io->sq_tail + io->to_submit;
+    unsigned idx = tail & *io->sq_mask;
+    struct io_uring_sqe *sqe = &io->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    io->sq_array[idx] = idx;
+    io->to_submit++;
+    return sqe;
+}
+
+static void uring_arm_wake(IOEngine *io) {
+    struct io_uring_sqe *sqe = uring_sqe(io);
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = io->event_fd;
+    sqe->addr = (uint64_t)(uintptr_t)&io->event_val;
+    sqe->len = sizeof(io->event_val);
+    sqe->user_data = TAG_WAKE;
+}
+
+/*
+ * Publish queued SQEs, wait for at least one completion, reap them all
+ * into out (*got of them); false if the ring itself failed
+ */
+static bool uring_wait(IOEngine *io, IOCompletion *out, uint32_t max, uint32_t *got) {
+    __atomic_store_n(io->sq_tail, *io->sq_tail + io->to_submit, __ATOMIC_RELEASE);
+    unsigned submit = io->to_submit;
+    io->to_submit = 0;
+
+    unsigned head = *io->cq_head;
+    if (head == __atomic_load_n(io->cq_tail, __ATOMIC_ACQUIRE) || submit > 0) {
+        bool empty = head == __atomic_load_n(io->cq_tail, __ATOMIC_ACQUIRE);
+        while (syscall(__NR_io_uring_enter, io->ring_fd, submit, empty ? 1 : 0,
+                       IORING_ENTER_GETEVENTS, NULL, 0) < 0) {
+            if (errno != EINTR) {
+                perror("io_uring_enter");
+                return false;
+            }
+        }
+    }
+
+    uint32_t n = 0;
+    unsigned tail = __atomic_load_n(io->cq_tail, __ATOMIC_ACQUIRE);
+    while (head != tail && n < max) {
+        struct io_uring_cqe *cqe = &io->cqes[head & *io->cq_mask];
+        out[n].tag = cqe->user_data;
+        out[n].res = cqe->res;
+        n++;
+        head++;
+    }
+    __atomic_store_n(io->cq_head, head, __ATOMIC_RELEASE);
+    *got = n;
+    return true;
+}
+
+static void uring_teardown(IOEngine *io) {
+    munmap(io->sqes, io->sqes_len);
+    munmap(io->cq_ptr, io->cq_len);
+    munmap(io->sq_ptr, io->sq_len);
+    close(io->event_fd);
+    close(io->ring_fd);
+}
+
+/* ---- Thread backend ---- */
+
+static void* io_thread(void *arg) {
+    IOEngine *io = arg;
+    pthread_mutex_lock(&io->lock);
+    for (;;) {
+        while (!io->requests && !io->stop) pthread_cond_wait(&io->request_cond, &io->lock);
+        if (!io->requests) break;
+        IORequest *r = io->requests;
+        io->requests = r->next;
+        if (!io->requests) io->requests_tail = NULL;
+        pthread_mutex_unlock(&io->lock);
+
+        // Full transfer or error, like a completed io_uring op
+        int64_t res = 0;
+        while ((uint64_t)res < r->len) {
+            ssize_t k = r->write ? pwrite(r->fd, r->data + res, r->len - res, r->offset + res)
+                                 : pread(r->fd, r->data + res, r->len - res, r->offset + res);
+            if (k < 0 && errno == EINTR) continue;
+            if (k < 0) {
+                res = -errno;
+                break;
+            }
+            if (k == 0) break;
+            res += k;
+        }
+
+        pthread_mutex_lock(&io->lock);
+        if (io->ndone == io->done_cap) {
+            io->done_cap = io->done_cap ? io->done_cap * 2 : 64;
+            io->done = realloc(io->done, io->done_cap * sizeof(IOCompletion));
+        }
+        io->done[io->ndone].tag = r->tag;
+        io->done[io->ndone].res = res;
+        io->ndone++;
+        pthread_cond_signal(&io->cond);
+        free(r);
+    }
+    pthread_mutex_unlock(&io->lock);
+    return NULL;
+}
+
+static void thread_request(IOEngine *io, bool write, int fd, uint8_t *data,
+                           uint64_t len, uint64_t offset, uint64_t tag) {
+    IORequest *r = malloc(sizeof(IORequest));
+    *r = (IORequest){ write, fd, data, len, offset, tag, NULL };
+    pthread_mutex_lock(&io->lock);
+    if (io->requests_tail) io->requests_tail->next = r;
+    else io->requests = r;
+    io->requests_tail = r;
+    pthread_cond_signal(&io->request_cond);
+    pthread_mutex_unlock(&io->lock);
+}
+
+/* ---- Backend-neutral submission ---- */
+
+static void submit_read(IOEngine *io, IOBuf *b) {
+    uint64_t off = b->offset + b->filled;
+    uint32_t len = b->len - b->filled;
+    if (io->uring) {
+        struct io_uring_sqe *sqe = uring_sqe(io);
+        sqe->opcode = IORING_OP_READ_FIXED;
+        sqe->fd = b->file->fd;
+        sqe->off = off;
+        sqe->addr = (uint64_t)(uintptr_t)(b->data + b->filled);
+        sqe->len = len;
+        sqe->buf_index = b->index;
+        sqe->user_data = (uint64_t)(uintptr_t)b;
+    } else {
+        thread_request(io, false, b->file->fd, b->data + b->filled, len, off,
+                       (uint64_t)(uintptr_t)b);
+    }
+    io->inflight++;
+}
+
+static void submit_write(IOEngine *io, IOFile *f) {
+    uint64_t tag = (uint64_t)(uintptr_t)f | TAG_WRITE;
+    if (io->uring) {
+        struct io_uring_sqe *sqe = uring_sqe(io);
+        sqe->opcode = IORING_OP_WRITE;
+        sqe->fd = f->out_fd;
+        sqe->off = f->out_done;
+        sqe->addr = (uint64_t)(uintptr_t)(f->out + f->out_done);
+        sqe->len = (uint32_t)(f->out_len - f->out_done);
+        sqe->user_data = tag;
+    } else {
+        thread_request(io, true, f->out_fd, f->out + f->out_done, f->out_len - f->out_done,
+                       f->out_done, tag);
+    }
+    io->inflight++;
+}
+
+/*
+ * Worker side: hand something to the I/O loop and make sure it wakes
+ */
+static void io_notify(IOEngine *io) {
+    if (io->uring) {
+        uint64_t one = 1;
+        if (write(io->event_fd, &one, sizeof(one)) < 0) perror("eventfd");
+    } else {
+        pthread_cond_signal(&io->cond);
+    }
+}
+
+static void io_release(IOEngine *io, IOBuf *b) {
+    pthread_mutex_lock(&io->lock);
+    b->next = io->released;
+    io->released = b;
+    if (!io->uring) io_notify(io);
+    pthread_mutex_unlock(&io->lock);
+    if (io->uring) io_notify(io);
+}
+
+/* ---- Per-file elimination on the pool ---- */
+
+static void file_output(IOFile *f) {
+    IOEngine *io = f->io;
+    CanonFileJob *job = f->job;
+
+    job->compute_ns = f->compute_ns;
+    job->rank = f->B->rank;
+    job->encoded = canon_encoded_size(f->B);
+    job->basis = f->B;
+    canon_metrics_record(METRIC_COMPRESS, f->compute_ns, job->size, job->encoded);
+
+    f->out_fd = -1;
+    if (!f->failed && job->output) {
+        f->out_len = canon_encoded_size(f->B);
+        f->out = malloc(f->out_len);
+        canon_encode(f->B, f->out);
+        f->out_fd = open(job->output, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+        if (f->out_fd < 0) {
+            perror(job->output);
+            f->failed = true;
+        }
+    }
+    f->write_t0 = now_ns();
+
+    // Even without an output the loop retires the file from its inbox
+    pthread_mutex_lock(&io->lock);
+    f->next_write = io->writes;
+    io->writes = f;
+    if (!io->uring) io_notify(io);
+    pthread_mutex_unlock(&io->lock);
+    if (io->uring) io_notify(io);
+}
+
+/*
+ * Drain task: eliminate this file's ready blocks in offset order
+ */
+static void drain_task(CanonPool *pool, void *arg) {
+    (void)pool;
+    IOFile *f = arg;
+
+    pthread_mutex_lock(&f->lock);
+    for (;;) {
+        IOBuf *b = f->ready;
+        if (!b || b->offset != f->next_off) break;
+        f->ready = b->next;
+        pthread_mutex_unlock(&f->lock);
+
+        if (b->error) {
+            f->failed = true;
+        } else if (!f->failed) {
+            uint64_t t0 = now_ns();
+            canon_compress_block(f->B, b->data, b->filled, b->offset);
+            f->compute_ns += now_ns() - t0;
+        }
+        uint32_t len = b->len;
+        io_release(f->io, b);
+
+        pthread_mutex_lock(&f->lock);
+        f->next_off += len;
+    }
+    bool done = f->next_off >= f->job->size;
+    f->draining = false;
+    pthread_mutex_unlock(&f->lock);
+
+    if (done) file_output(f);
+}
+
+/*
+ * I/O loop: a block is complete, queue it for its file's drain task
+ */
+static void deliver(IOEngine *io, IOBuf *b) {
+    IOFile *f = b->file;
+    pthread_mutex_lock(&f->lock);
+    IOBuf **p = &f->ready;
+    while (*p && (*p)->offset < b->offset) p = &(*p)->next;
+    b->next = *p;
+    *p = b;
+    bool start = !f->draining && f->ready->offset == f->next_off;
+    if (start) f->draining = true;
+    pthread_mutex_unlock(&f->lock);
+    if (start) canon_pool_submit_node(io->pool, f->node, drain_task, f);
+}
+
+static void open_next(IOEngine *io) {
+    CanonFileJob *job = io->order[io->next_file++];
+    job->start_ns = now_ns();
+
+    IOFile *f = calloc(1, sizeof(IOFile));
+    f->io = io;
+    f->job = job;
+    f->node = (int)(io->next_file % (uint32_t)io->nnodes);
+    pthread_mutex_init(&f->lock, NULL);
+
+    f->fd = open(job->input, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    bool opened = f->fd >= 0 && fstat(f->fd, &st) == 0;
+    if (!opened) perror(job->input);
+    if (!opened || !canon_input_fits(job->input, (uint64_t)st.st_size)) {
+        if (f->fd >= 0) close(f->fd);
+        job->failed = true;
+        job->done_ns = now_ns();
+        pthread_mutex_destroy(&f->lock);
+        free(f);
+        io->files_left--;
+        return;
+    }
+    job->size = (uint64_t)st.st_size;
+    posix_fadvise(f->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    f->B = basis_init();
+    io->open_files++;
+
+    if (job->size == 0) {
+        close(f->fd);
+        f->fd = -1;
+        f->draining = true;
+        canon_pool_submit_node(io->pool, f->node, drain_task, f);
+        return;
+    }
+    io->active[io->nactive++] = f;
+}
+
+/*
+ * Issue reads round-robin over open files while buffers last
+ */
+static void issue_reads(IOEngine *io) {
+    while (io->nfree > 0 && io->nactive > 0) {
+        if (io->rr >= io->nactive) io->rr = 0;
+        IOFile *f = io->active[io->rr];
+
+        if (f->held >= io->per_file_cap) {
+            // This file's drain is behind; let the others read
+            bool any = false;
+            for (uint32_t k = 0; k < io->nactive; k++) {
+                if (io->active[k]->held < io->per_file_cap) {
+                    io->rr = k;
+                    any = true;
+                    break;
+                }
+            }
+            if (!any) return;
+            continue;
+        }
+
+        // A buffer on the file's node, else whichever node has one
+        int node = f->node;
+        for (int k = 1; !io->free_bufs[node] && k < io->nnodes; k++) {
+            node = (f->node + k) % io->nnodes;
+        }
+        IOBuf *b = io->free_bufs[node];
+        io->free_bufs[node] = b->next;
+        io->nfree--;
+        b->file = f;
+        b->offset = f->read_off;
+        b->len = f->job->size - f->read_off < IO_BLOCK ? (uint32_t)(f->job->size - f->read_off)
+                                                       : IO_BLOCK;
+        b->filled = 0;
+        b->error = false;
+        f->read_off += b->len;
+        f->held++;
+        f->inflight++;
+        submit_read(io, b);
+
+        if (f->read_off >= f->job->size) {
+            io->active[io->rr] = io->active[--io->nactive];
+        } else {
+            io->rr++;
+        }
+    }
+}
+
+static void read_complete(IOEngine *io, IOBuf *b, int64_t res) {
+    IOFile *f = b->file;
+    io->inflight--;
+    if (res < 0) {
+        errno = (int)-res;
+        perror(f->job->input);
+        b->error = true;
+    } else if (res == 0) {
+        // File shrank under us
+        fprintf(stderr, "Error: %s: unexpected end of file\n", f->job->input);
+        b->error = true;
+    } else if (b->filled + (uint32_t)res < b->len) {
+        b->filled += (uint32_t)res;
+        submit_read(io, b);         // Short read: continue in place
+        return;
+    } else {
+        b->filled += (uint32_t)res;
+    }
+
+    f->inflight--;
+    if (f->inflight == 0 && f->read_off >= f->job->size) {
+        close(f->fd);
+        f->fd = -1;
+    }
+    deliver(io, b);
+}
+
+static void file_retire(IOEngine *io, IOFile *f) {
+    CanonFileJob *job = f->job;
+    if (f->out_fd >= 0 && close(f->out_fd) != 0) {
+        perror(job->output);
+        f->failed = true;
+    }
+    if (f->out && !f->failed) {
+        canon_metrics_record(METRIC_SAVE, now_ns() - f->write_t0, 0, f->out_len);
+    }
+    free(f->out);
+
+    job->failed = f->failed;
+    if (io->cfg->keep_bases) {
+        basis_trim(job->basis);
+    } else {
+        basis_free(job->basis);
+        job->basis = NULL;
+    }
+    job->done_ns = now_ns();
+    pthread_mutex_destroy(&f->lock);
+    free(f);
+    io->open_files--;
+    io->files_left--;
+}
+
+static void write_complete(IOEngine *io, IOFile *f, int64_t res) {
+    io->inflight--;
+    if (res < 0) {
+        errno = (int)-res;
+        perror(f->job->output);
+        f->failed = true;
+    } else if (res > 0 && f->out_done + (uint64_t)res < f->out_len) {
+        f->out_done += (uint64_t)res;
+        submit_write(io, f);
+        return;
+    } else if (res == 0 && f->out_len > 0) {
+        f->failed = true;
+    }
+    file_retire(io, f);
+}
+
+/*
+ * Run the batch: the calling thread is the I/O loop
+ * Returns false if it had to stop with files unfinished.
+ */
+static bool io_loop(IOEngine *io) {
+    IOCompletion *cq = malloc((2 * io->nbufs + 4) * sizeof(IOCompletion));
+    if (io->uring) uring_arm_wake(io);
+
+    while (io->files_left > 0) {
+        // Open up to the window; each open file holds a basis
+        while (io->next_file < io->n && io->open_files < io->nbufs) open_next(io);
+
+        // Collect the inbox
+        pthread_mutex_lock(&io->lock);
+        IOBuf *rel = io->released;
+        IOFile *wr = io->writes;
+        io->released = NULL;
+        io->writes = NULL;
+        pthread_mutex_unlock(&io->lock);
+
+        while (rel) {
+            IOBuf *next = rel->next;
+            rel->file->held--;
+            rel->next = io->free_bufs[rel->node];
+            io->free_bufs[rel->node] = rel;
+            io->nfree++;
+            rel = next;
+        }
+        while (wr) {
+            IOFile *next = wr->next_write;
+            if (wr->out_fd >= 0) submit_write(io, wr);
+            else file_retire(io, wr);
+            wr = next;
+        }
+
+        issue_reads(io);
+        if (io->files_left == 0) break;
+
+        uint32_t got;
+        if (io->uring) {
+            if (!uring_wait(io, cq, 2 * io->nbufs + 4, &got)) {
+                fprintf(stderr, "Error: io_uring failed with %u file(s) unfinished\n", io->files_left);
+                free(cq);
+                return false;
+            }
+        } else {
+            pthread_mutex_lock(&io->lock);
+            while (io->ndone == 0 && !io->released && !io->writes) {
+                pthread_cond_wait(&io->cond, &io->lock);
+            }
+            got = io->ndone < 2 * io->nbufs + 4 ? io->ndone : 2 * io->nbufs + 4;
+            memcpy(cq, io->done + io->ndone - got, got * sizeof(IOCompletion));
+            io->ndone -= got;
+            pthread_mutex_unlock(&io->lock);
+        }
+
+        for (uint32_t i = 0; i < got; i++) {
+            if (cq[i].tag == TAG_WAKE) {
+                uring_arm_wake(io);
+            } else if (cq[i].tag & TAG_WRITE) {
+                write_complete(io, (IOFile *)(uintptr_t)(cq[i].tag & ~TAG_WRITE), cq[i].res);
+            } else {
+                read_complete(io, (IOBuf *)(uintptr_t)cq[i].tag, cq[i].res);
+            }
+        }
+    }
+    free(cq);
+    return true;
+}
+
+/*
+ * Compress jobs (already in largest-first order) through the async I/O
+ * loop on the calling thread; elimination runs on pool
+ */
+void canon_io_compress_files(CanonPool *pool, CanonFileJob **order, uint32_t n,
+                             const CanonFilesConfig *cfg) {
+    IOEngine io;
+    memset(&io, 0, sizeof(io));
+    io.pool = pool;
+    io.cfg = cfg;
+    io.order = order;
+    io.n = n;
+    io.files_left = n;
+    io.nbufs = cfg->queue_depth ? cfg->queue_depth : 64;
+    if (io.nbufs > 4096) io.nbufs = 4096;
+    if (cfg->io == CANON_IO_URING) {
+        uint32_t fit = uring_max_bufs();
+        if (fit < io.nbufs && fit >= 2) {
+            fprintf(stderr, "Note: RLIMIT_MEMLOCK fits %u of %u registered %u KB buffers; using %u\n",
+                    fit, io.nbufs, IO_BLOCK / 1024, fit);
+            io.nbufs = fit;
+        }
+    }
+    io.per_file_cap = io.nbufs > 4 ? io.nbufs - io.nbufs / 4 : io.nbufs;
+    io.active = malloc(io.nbufs * sizeof(IOFile *));
+    pthread_mutex_init(&io.lock, NULL);
+    pthread_cond_init(&io.cond, NULL);
+    pthread_cond_init(&io.request_cond, NULL);
+
+    io.arena = canon_huge_alloc((size_t)io.nbufs * IO_BLOCK);
+    io.bufs = calloc(io.nbufs, sizeof(IOBuf));
+
+    // Split the arena into one contiguous slice per node, bound before first touch
+    io.nnodes = canon_numa_nodes();
+    if ((uint32_t)io.nnodes > io.nbufs) io.nnodes = (int)io.nbufs;
+    for (int node = 0; node < io.nnodes; node++) {
+        uint32_t lo = (uint32_t)((uint64_t)io.nbufs * node / io.nnodes);
+        uint32_t hi = (uint32_t)((uint64_t)io.nbufs * (node + 1) / io.nnodes);
+        canon_numa_bind(io.arena + (size_t)lo * IO_BLOCK, (size_t)(hi - lo) * IO_BLOCK, node);
+        for (uint32_t i = hi; i-- > lo;) {
+            io.bufs[i].data = io.arena + (size_t)i * IO_BLOCK;
+            io.bufs[i].index = (uint16_t)i;
+            io.bufs[i].node = (uint16_t)node;
+            io.bufs[i].next = io.free_bufs[node];
+            io.free_bufs[node] = &io.bufs[i];
+        }
+    }
+    io.nfree = io.nbufs;
+
+    if (cfg->io == CANON_IO_URING) {
+        const char *why = uring_setup(&io);
+        io.uring = !why;
+        if (why) {
+            fprintf(stderr, "Warning: io_uring unavailable (%s: %s), using %d I/O threads\n",
+                    why, strerror(errno), IO_THREADS);
+        }
+    }
+    int started = 0;
+    if (!io.uring) {
+        while (started < IO_THREADS && pthread_create(&io.threads[started], NULL, io_thread, &io) == 0) {
+            started++;
+        }
+        if (started < IO_THREADS) {
+            fprintf(stderr, "Error: Cannot start I/O threads (%d of %d running)\n", started, IO_THREADS);
+        }
+    }
+    printf("I/O: %s, %u x %u KB buffers in flight on %d node(s)\n\n",
+           io.uring ? "io_uring" : "threads", io.nbufs, IO_BLOCK / 1024, io.nnodes);
+    fflush(stdout);
+
+    bool finished = (io.uring || started > 0) && io_loop(&io);
+    canon_pool_wait(pool);
+    if (!finished) {
+        // Nothing completes reads any more; what did not finish failed
+        for (uint32_t i = 0; i < n; i++) {
+            if (order[i]->done_ns) continue;
+            order[i]->failed = true;
+            order[i]->done_ns = now_ns();
+        }
+    }
+
+    if (io.uring) {
+        uring_teardown(&io);
+    } else {
+        pthread_mutex_lock(&io.lock);
+        io.stop = true;
+        pthread_cond_broadcast(&io.request_cond);
+        pthread_mutex_unlock(&io.lock);
+        for (int i = 0; i < started; i++) pthread_join(io.threads[i], NULL);
+        free(io.done);
+    }
+    canon_huge_free(io.arena, (size_t)io.nbufs * IO_BLOCK);
+    free(io.bufs);
+    free(io.active);
+    pthread_mutex_destroy(&io.lock);
+    pthread_cond_destroy(&io.cond);
+    pthread_cond_destroy(&io.request_cond);
+}
@@ -0,0 +1,504 @@
+/*
+ * CANON - Method of Four Russians (M4RI) elimination
+ *
+ * Author: Francesco Pedulli
+ * Date: February 26, 2026
+ *
+ * Echelon form, reduced echelon form and rank of a dense GF2Matrix.
+ * add_to_basis() clears one row against one pivot at a time; M4RI clears
+ * a row against k pivots with a single row XOR.
+ *
+ * Each step finds up to M4RI_TABLES * k pivots in consecutive columns with
+ * a small Gaussian elimination on the next few rows, leaving them as an
+ * identity block. For every group of k pivot rows a table of all 2^k
+ * combinations is built in Gray-code order, so each entry is the previous
+ * one XOR a single pivot row. A target row then reads its bits at the
+ * pivot columns, uses them directly as table indices, and is cleared in
+ * all of those columns by one fused pass of M4RI_TABLES table rows.
+ *
+ * The update runs over column stripes sized so that every table of the
+ * stripe stays in half of L2 while target rows stream past; k itself is
+ * chosen from the matrix size, as building 2^k entries only pays off when
+ * enough rows reuse them. Row XORs use AVX-512 or AVX2 when the build
+ * has them.
+ *
+ * On a CanonPool the update of each step becomes a small task graph of
+ * row-block x column-stripe tiles that all read the same pivot panel,
+ * so square matrices far beyond one core's reach scale with the pool.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <math.h>
+#include <unistd.h>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#include "canon.h"
+
+#define M4RI_MAX_K 8
+#define M4RI_TABLES 8           // Tables per step: up to 64 pivot columns
+#define M4RI_PREFETCH 4         // Target rows fetched ahead of the update
+#define L2_FALLBACK (256u << 10)
+#define M4RI_TILE_ROWS 2048     // Fewest target rows per parallel tile
+#define M4RI_TILES_PER_THREAD 4 // Parallel tiles per pool worker and step
+
+/*
+ * n <= 64 bits of a row starting at column col, bit 0 = column col
+ */
+static inline uint64_t read_bits(const uint64_t *row, uint32_t col, uint32_t n) {
+    uint32_t w = col / 64, s = col % 64;
+    uint64_t v = row[w] >> s;
+    if (s && s + n > 64) v |= row[w + 1] << (64 - s);
+    return n == 64 ? v : v & ((1ull << n) - 1);
+}
+
+/*
+ * dst ^= src over words [from, words); the last word only inside mask
+ */
+static inline void row_add(uint64_t *dst, const uint64_t *src, uint32_t from, uint32_t words,
+                           uint64_t mask) {
+    for (uint32_t w = from; w + 1 < words; w++) dst[w] ^= src[w];
+    dst[words - 1] ^= src[words - 1] & mask;
+}
+
+/*
+ * dst ^= src[0] ^ ... ^ src[n-1] over len words
+ * Fused so the target is loaded and stored once however many tables hit it
+ */
+static inline void xor_rows(uint64_t *dst, const uint64_t *const *src, uint32_t n, uint32_t len) {
+    uint32_t w = 0;
+#ifdef __AVX512F__
+    for (; w + 16 <= len; w += 16) {
+        __m512i a = _mm512_loadu_si512(dst + w), b = _mm512_loadu_si512(dst + w + 8);
+        for (uint32_t i = 0; i < n; i++) {
+            a = _mm512_xor_si512(a, _mm512_loadu_si512(src[i] + w));
+            b = _mm512_xor_si512(b, _mm512_loadu_si512(src[i] + w + 8));
+        }
+        _mm512_storeu_si512(dst + w, a);
+        _mm512_storeu_si512(dst + w + 8, b);
+    }
+#endif
+#ifdef __AVX2__
+    for (; w + 8 <= len; w += 8) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(dst + w));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(dst + w + 4));
+        for (uint32_t i = 0; i < n; i++) {
+            a = _mm256_xor_si256(a, _mm256_loadu_si256((const __m256i *)(src[i] + w)));
+            b = _mm256_xor_si256(b, _mm256_loadu_si256((const __m256i *)(src[i] + w + 4)));
+        }
+        _mm256_storeu_si256((__m256i *)(dst + w), a);
+        _mm256_storeu_si256((__m256i *)(dst + w + 4), b);
+    }
+#endif
+    for (; w < len; w++) {
+        uint64_t v = dst[w];
+        for (uint32_t i = 0; i < n; i++) v ^= src[i][w];
+        dst[w] = v;
+    }
+}
+
+/*
+ * Gaussian elimination on columns [c, c + n) from row r down
+ * Stops at the first column without a pivot and returns the number of
+ * pivots found, kbar. Rows r .. r+kbar-1 then hold an identity block in
+ * columns c .. c+kbar-1; rows below are only cleared as far as the scan
+ * for a pivot reached them, which the table pass finishes.
+ */
+static uint32_t gauss_block(GF2Matrix *A, uint32_t r, uint32_t c, uint32_t n) {
+    uint32_t words = canon_mat_words(A);
+    uint64_t mask = canon_mat_last_mask(A);
+    uint32_t start = r;
+
+    for (uint32_t j = 0; j < n; j++) {
+        bool found = false;
+        for (uint32_t i = start; i < A->nrows; i++) {
+            uint64_t *row = canon_mat_row(A, i);
+            // Clear the pivot columns found so far; the block is an identity,
+            // so adding pivot l leaves the other pivot bits alone (not bit j)
+            for (uint32_t l0 = 0; l0 < j; l0 += 64) {
+                uint64_t bits = read_bits(row, c + l0, j - l0 < 64 ? j - l0 : 64);
+                for (; bits; bits &= bits - 1) {
+                    uint32_t l = l0 + (uint32_t)__builtin_ctzll(bits);
+                    row_add(row, canon_mat_row(A, r + l), (c + l) / 64, words, mask);
+                }
+            }
+            if (!((row[(c + j) / 64] >> ((c + j) % 64)) & 1)) continue;
+
+            canon_mat_swap_rows(A, i, start);
+            uint64_t *pivot = canon_mat_row(A, start);
+            for (uint32_t l = r; l < start; l++) {
+                uint64_t *above = canon_mat_row(A, l);
+                if ((above[(c + j) / 64] >> ((c + j) % 64)) & 1) row_add(above, pivot, (c + j) / 64, words, mask);
+            }
+            start++;
+            found = true;
+            break;
+        }
+        if (!found) return j;
+    }
+    return n;
+}
+
+/*
+ * Half of the L2 cache, where one stripe of tables has to fit
+ */
+static size_t table_budget(void) {
+    long l2 = sysconf(_SC_LEVEL2_CACHE_SIZE);
+    return (l2 > 0 ? (size_t)l2 : L2_FALLBACK) / 2;
+}
+
+typedef struct {
+    uint32_t k;             // Bits per table
+    uint32_t stripe;        // Words per column stripe
+    uint64_t *tables;       // M4RI_TABLES x 2^k entries of stripe words
+    uint32_t *todo;         // Rows with nonzero pivot bits this step
+    uint8_t *index;         // Their M4RI_TABLES table indices each
+} M4RIState;
+
+/*
+ * One column stripe of M4RI_TABLES tables of 2^k entries
+ */
+static uint64_t* tables_alloc(const M4RIState *s) {
+    size_t bytes = ((size_t)M4RI_TABLES << s->k) * s->stripe * sizeof(uint64_t);
+    return aligned_alloc(CANON_MAT_ALIGN, (bytes + CANON_MAT_ALIGN - 1) / CANON_MAT_ALIGN * CANON_MAT_ALIGN);
+}
+
+/*
+ * Tables for M4RI_TABLES x k bits per step and index room for rows targets
+ */
+static bool state_init(M4RIState *s, uint32_t k, uint32_t rows, uint32_t words) {
+    size_t entries = (size_t)M4RI_TABLES << k;
+    s->k = k;
+    s->stripe = (uint32_t)(table_budget() / (entries * sizeof(uint64_t))) & ~7u;
+    if (s->stripe < 8) s->stripe = 8;
+    if (s->stripe > words) s->stripe = words;
+    s->tables = tables_alloc(s);
+    s->todo = malloc((rows ? rows : 1) * sizeof(uint32_t));
+    s->index = malloc((size_t)(rows ? rows : 1) * M4RI_TABLES);
+    if (!s->tables || !s->todo || !s->index) {
+        fprintf(stderr, "Error: Out of memory for M4RI tables\n");
+        free(s->tables);
+        free(s->todo);
+        free(s->index);
+        return false;
+    }
+    return true;
+}
+
+static void state_free(M4RIState *s) {
+    free(s->tables);
+    free(s->todo);
+    free(s->index);
+}
+
+/*
+ * One tile of an update: rows s->todo[j0 .. j1) of C, words [s0, s0 + len)
+ * Builds the stripe's tables from rows first .. first+count-1 of S into
+ * tables, then adds to each row the combination s->index selects.
+ */
+static void update_tile(const M4RIState *s, uint64_t *tables, GF2Matrix *C, const GF2Matrix *S, uint32_t first,
+                        uint32_t count, uint32_t j0, uint32_t j1, uint32_t s0, uint32_t len) {
+    uint32_t words = canon_mat_words(C);
+    uint64_t mask = canon_mat_last_mask(C);
+    uint32_t k = s->k, ntables = (count + k - 1) / k;
+
+    for (uint32_t t = 0; t < ntables; t++) {
+        uint32_t kt = count - t * k < k ? count - t * k : k;
+        uint64_t *T = tables + ((size_t)t << k) * s->stripe;
+        memset(T, 0, len * sizeof(uint64_t));
+        for (uint32_t g = 1; g < (1u << kt); g++) {
+            // Gray code g ^ (g >> 1) differs from its predecessor in bit ctz(g)
+            uint32_t cur = g ^ (g >> 1), prev = (g - 1) ^ ((g - 1) >> 1);
+            const uint64_t *p = canon_mat_row(S, first + t * k + (uint32_t)__builtin_ctz(g)) + s0;
+            uint64_t *dst = T + (size_t)cur * s->stripe, *src = T + (size_t)prev * s->stripe;
+            for (uint32_t w = 0; w < len; w++) dst[w] = src[w] ^ p[w];
+            if (s0 + len == words) dst[len - 1] &= mask;
+        }
+    }
+
+    for (uint32_t j = j0; j < j1; j++) {
+        // Rows sit a whole stride apart, beyond the hardware prefetcher
+        if (j + M4RI_PREFETCH < j1) {
+            const uint64_t *next = canon_mat_row(C, s->todo[j + M4RI_PREFETCH]) + s0;
+            for (uint32_t w = 0; w < len; w += 8) __builtin_prefetch(next + w, 1);
+        }
+        const uint64_t *src[M4RI_TABLES];
+        uint32_t n = 0;
+        const uint8_t *index = s->index + (size_t)j * M4RI_TABLES;
+        for (uint32_t t = 0; t < ntables; t++) {
+            uint32_t g = index[t];
+            if (g) src[n++] = tables + (((size_t)t << k) + g) * s->stripe;
+        }
+        xor_rows(canon_mat_row(C, s->todo[j]) + s0, src, n, len);
+    }
+}
+
+/*
+ * Add to each row s->todo[j] of C, from word w0 on, the combination of
+ * rows first .. first+count-1 of S selected by s->index; S has C's width
+ * Tables are built one column stripe at a time so they stay in L2
+ */
+static void update_rows(M4RIState *s, GF2Matrix *C, const GF2Matrix *S, uint32_t first, uint32_t count,
+                        uint32_t todo, uint32_t w0) {
+    uint32_t words = canon_mat_words(C);
+    for (uint32_t s0 = w0; s0 < words; s0 += s->stripe) {
+        uint32_t len = words - s0 < s->stripe ? words - s0 : s->stripe;
+        update_tile(s, s->tables, C, S, first, count, 0, todo, s0, len);
+    }
+}
+
+/*
+ * Record row of the next target: its k-bit table indices for bits
+ * [c, c + count); false (nothing recorded) if they are all zero
+ */
+static inline bool add_target(M4RIState *s, uint32_t todo, uint32_t row, const uint64_t *bits, uint32_t c,
+                              uint32_t count) {
+    uint32_t k = s->k;
+    uint8_t *index = s->index + (size_t)todo * M4RI_TABLES, any = 0;
+    if (k == 8 && count == 64 && c % 64 == 0) {
+        // Whole aligned word: the indices are its bytes
+        uint64_t v = bits[c / 64];
+        memcpy(index, &v, sizeof(v));
+        if (v) s->todo[todo] = row;
+        return v != 0;
+    }
+    for (uint32_t t = 0; t * k < count; t++) {
+        uint32_t kt = count - t * k < k ? count - t * k : k;
+        index[t] = (uint8_t)read_bits(bits, c + t * k, kt);
+        any |= index[t];
+    }
+    if (any) s->todo[todo] = row;
+    return any != 0;
+}
+
+/*
+ * Clear pivot columns [c, c + kbar) of every other row (rows above r only
+ * when full) with the identity block in rows r .. r+kbar-1
+ */
+static void eliminate_step(GF2Matrix *A, M4RIState *s, uint32_t r, uint32_t c, uint32_t kbar, bool full) {
+    // Table indices are read before the first stripe changes the pivot columns
+    uint32_t todo = 0;
+    for (uint32_t i = full ? 0 : r + kbar; i < A->nrows; i++) {
+        if (i == r) {
+            i += kbar - 1;
+            continue;
+        }
+        todo += add_target(s, todo, i, canon_mat_row(A, i), c, kbar);
+    }
+    // Pivot rows are zero left of c, so the update starts at c's word
+    if (todo) update_rows(s, A, A, r, kbar, todo, c / 64);
+}
+
+/*
+ * One elimination step spread over a pool: the pivot panel (the identity
+ * block and its Gray tables' source rows) is read-only while it runs, so
+ * it is shared by every task. The targets are cut into row blocks of at
+ * least M4RI_TILE_ROWS. Each block's index task reads the table indices
+ * of its rows and then submits one tile task per column stripe of the
+ * block; a tile builds that stripe's tables in its worker's own buffer
+ * and updates only its rows. A block's tiles depend only on its own
+ * index task, so indexing and updating overlap across blocks.
+ */
+typedef struct M4RIStep M4RIStep;
+
+typedef struct {
+    M4RIStep *step;
+    uint32_t b;             // Row block
+    uint32_t s0, len;       // Column stripe, in words
+} M4RITile;
+
+struct M4RIStep {
+    CanonPool *pool;
+    M4RIState *s;
+    GF2Matrix *A;
+    uint64_t **tables;      // One stripe of tables per pool worker
+    uint32_t r, c, kbar;    // Pivot panel: identity block at rows r.., columns c..
+    uint32_t from, block;   // Targets: rows from .. nrows, block rows at a time
+    uint32_t nstripes;
+    uint32_t *count;        // Targets found in each row block
+    M4RITile *tiles;        // Row block x column stripe
+};
+
+static void tile_task(CanonPool *pool, void *arg) {
+    M4RITile *t = arg;
+    M4RIStep *st = t->step;
+    // Targets of block b fill todo slots from b * block on
+    uint32_t j0 = t->b * st->block;
+    update_tile(st->s, st->tables[canon_pool_worker(pool)], st->A, st->A, st->r, st->kbar, j0,
+                j0 + st->count[t->b], t->s0, t->len);
+}
+
+static void index_task(CanonPool *pool, void *arg) {
+    M4RITile *first = arg;
+    M4RIStep *st = first->step;
+    uint32_t b = first->b, j0 = b * st->block, n = 0;
+    uint32_t i0 = st->from + j0, i1 = st->A->nrows - i0 < st->block ? st->A->nrows : i0 + st->block;
+    for (uint32_t i = i0; i < i1; i++) {
+        if (i >= st->r && i < st->r + st->kbar) continue;
+        n += add_target(st->s, j0 + n, i, canon_mat_row(st->A, i), st->c, st->kbar);
+    }
+    st->count[b] = n;
+    for (uint32_t j = 0; n && j < st->nstripes; j++) canon_pool_submit(pool, tile_task, first + j);
+}
+
+static void eliminate_step_pool(M4RIStep *st, uint32_t r, uint32_t c, uint32_t kbar, bool full) {
+    GF2Matrix *A = st->A;
+    uint32_t stripe = st->s->stripe, words = canon_mat_words(A), w0 = c / 64;
+    st->r = r;
+    st->c = c;
+    st->kbar = kbar;
+    st->from = full ? 0 : r + kbar;
+    if (st->from >= A->nrows) return;
+
+    // A few tiles per worker to balance, but no tile so short that
+    // building its tables outweighs the update
+    uint32_t rows = A->nrows - st->from;
+    st->nstripes = (words - w0 + stripe - 1) / stripe;
+    uint32_t want = (M4RI_TILES_PER_THREAD * (uint32_t)canon_pool_threads(st->pool) + st->nstripes - 1)
+                    / st->nstripes;
+    st->block = (rows + want - 1) / want;
+    if (st->block < M4RI_TILE_ROWS) st->block = M4RI_TILE_ROWS;
+    uint32_t nblocks = (rows + st->block - 1) / st->block;
+
+    for (uint32_t b = 0; b < nblocks; b++) {
+        for (uint32_t j = 0; j < st->nstripes; j++) {
+            uint32_t s0 = w0 + j * stripe;
+            st->tiles[b * st->nstripes + j] = (M4RITile){ st, b, s0, words - s0 < stripe ? words - s0 : stripe };
+        }
+    }
+    for (uint32_t b = 0; b < nblocks; b++) canon_pool_submit(st->pool, index_task, &st->tiles[b * st->nstripes]);
+    canon_pool_wait(st->pool);
+}
+
+/*
+ * k for an nrows x ncols matrix: about 3/4 log2 of the smaller side
+ */
+uint32_t canon_m4ri_opt_k(uint32_t nrows, uint32_t ncols) {
+    uint32_t n = nrows < ncols ? nrows : ncols;
+    int k = (int)lround(0.75 * log2(n > 1 ? n : 2));
+    return k < 1 ? 1 : k > M4RI_MAX_K ? M4RI_MAX_K : (uint32_t)k;
+}
+
+/*
+ * Row echelon form of A in place (reduced when full); returns the rank
+ * k = 0 picks k from the size. pivots, if given, receives the pivot
+ * column of each of the first rank rows.
+ */
+uint32_t canon_m4ri_echelon(GF2Matrix *A, bool full, uint32_t k, uint32_t *pivots) {
+    return canon_m4ri_echelon_pool(NULL, A, full, k, pivots);
+}
+
+/*
+ * canon_m4ri_echelon() with every step's update spread over pool
+ * (NULL: on the calling thread). The pivot search stays serial between
+ * steps; the result is identical either way.
+ */
+uint32_t canon_m4ri_echelon_pool(CanonPool *pool, GF2Matrix *A, bool full, uint32_t k, uint32_t *pivots) {
+    if (A->nrows == 0 || A->ncols == 0) return 0;
+    if (k == 0) k = canon_m4ri_opt_k(A->nrows, A->ncols);
+    if (k > M4RI_MAX_K) k = M4RI_MAX_K;
+
+    M4RIState s;
+    if (!state_init(&s, k, A->nrows, canon_mat_words(A))) return 0;
+
+    M4RIStep st = { .pool = pool, .s = &s, .A = A };
+    int threads = pool ? canon_pool_threads(pool) : 0;
+    if (pool) {
+        uint32_t blocks = (A->nrows + M4RI_TILE_ROWS - 1) / M4RI_TILE_ROWS;
+        uint32_t stripes = (canon_mat_words(A) + s.stripe - 1) / s.stripe;
+        st.tables = calloc(threads, sizeof(uint64_t *));
+        st.count = malloc(blocks * sizeof(uint32_t));
+        st.tiles = malloc((size_t)blocks * stripes * sizeof(M4RITile));
+        bool ok = st.tables && st.count && st.tiles;
+        for (int t = 0; ok && t < threads; t++) ok = (st.tables[t] = tables_alloc(&s)) != NULL;
+        if (!ok) {
+            fprintf(stderr, "Error: Out of memory for M4RI tiles\n");
+            for (int t = 0; st.tables && t < threads; t++) free(st.tables[t]);
+            free(st.tables);
+            free(st.count);
+            free(st.tiles);
+            state_free(&s);
+            return 0;
+        }
+    }
+
+    uint32_t r = 0, c = 0;
+    while (c < A->ncols && r < A->nrows) {
+        uint32_t n = M4RI_TABLES * k;
+        if (n > A->ncols - c) n = A->ncols - c;
+        uint32_t kbar = gauss_block(A, r, c, n);
+        if (kbar > 0) {
+            if (pivots) {
+                for (uint32_t i = 0; i < kbar; i++) pivots[r + i] = c + i;
+            }
+            if (pool) {
+                eliminate_step_pool(&st, r, c, kbar, full);
+            } else {
+                eliminate_step(A, &s, r, c, kbar, full);
+            }
+            r += kbar;
+        }
+        // Stopping short means column c + kbar has no pivot left: skip it
+        c += kbar < n ? kbar + 1 : kbar;
+    }
+
+    for (int t = 0; t < threads; t++) free(st.tables[t]);
+    free(st.tables);
+    free(st.count);
+    free(st.tiles);
+    state_free(&s);
+    return r;
+}
+
+/*
+ * Rank of A, which is left untouched
+ */
+uint32_t canon_m4ri_rank(const GF2Matrix *A) {
+    GF2Matrix *C = canon_mat_new(A->nrows, A->ncols);
+    if (!C) return 0;
+    canon_mat_copy(C, A);
+    uint32_t rank = canon_m4ri_echelon(C, false, 0, NULL);
+    canon_mat_free(C);
+    return rank;
+}
+
+/*
+ * C += A * B by the Method of Four Russians (M4RM), the base case of
+ * canon_mat_addmul()
+ * A is m x n, B is n x p, C is m x p. For every M4RI_TABLES * k rows of
+ * B, the tables of their combinations are indexed by the matching bits
+ * of each row of A, so each row of C takes one fused pass per group.
+ */
+void canon_mat_addmul_m4rm(GF2Matrix *C, const GF2Matrix *A, const GF2Matrix *B) {
+    if (C->nrows == 0 || C->ncols == 0 || A->ncols == 0) return;
+    // Every row of C reuses the tables, so k follows the row count
+    uint32_t k = canon_m4ri_opt_k(C->nrows, C->nrows);
+    M4RIState s;
+    if (!state_init(&s, k, C->nrows, canon_mat_words(C))) return;
+
+    uint32_t awords = canon_mat_words(A);
+    uint64_t amask = canon_mat_last_mask(A);
+    for (uint32_t a0 = 0; a0 < A->ncols; a0 += M4RI_TABLES * k) {
+        uint32_t count = A->ncols - a0 < M4RI_TABLES * k ? A->ncols - a0 : M4RI_TABLES * k;
+        uint32_t w0 = a0 / 64, w1 = (a0 + count - 1) / 64;
+        uint32_t todo = 0;
+        for (uint32_t i = 0; i < C->nrows; i++) {
+            // At most two words hold the group; the last may carry a
+            // neighbouring window's bits
+            const uint64_t *row = canon_mat_row(A, i);
+            uint64_t bits[2] = { row[w0], w1 > w0 ? row[w1] : 0 };
+            if (w1 == awords - 1) bits[w1 - w0] &= amask;
+            todo += add_target(&s, todo, i, bits, a0 % 64, count);
+        }
+        if (todo) update_rows(&s, C, B, a0, count, todo, 0);
+    }
+    state_free(&s);
+}
@@ -0,0 +1,574 @@
+/*
+ * CANON - Dense bit-packed GF(2) matrices
+ *
+ * Author: Francesco Pedulli
+ * Date: February 26, 2026
+ *
+ * GF2Matrix packs 64 entries per uint64_t word, column c of a row in
+ * bit c % 64 of word c / 64. Rows start on 64-byte boundaries and the
+ * stride is padded to whole cache lines, so a row is always a run of
+ * aligned vectors and row operations never straddle a line shared with
+ * the next row.
+ *
+ * A window is a GF2Matrix by value that points into another matrix's
+ * storage: no allocation, no copy, and writes land in the parent. Row
+ * offsets are arbitrary; column offsets must be multiples of 64 so a
+ * window's rows are still whole words. The last word of a window row may
+ * hold bits that belong to columns right of the window, so every write
+ * masks it with canon_mat_last_mask(). Owning matrices keep their padding
+ * bits zero.
+ *
+ * Blocked and recursive algorithms (elimination, multiplication,
+ * transposition) split matrices into windows and recurse on them.
+ *
+ * `canon matrix` benchmarks those algorithms on random matrices and, with
+ * --check, compares them against plain row-by-row Gaussian elimination.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "canon.h"
+
+#define WORD_BITS 64
+#define LINE_WORDS (CANON_MAT_ALIGN / sizeof(uint64_t))
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/*
+ * Zeroed nrows x ncols matrix; NULL if the allocation fails
+ */
+GF2Matrix* canon_mat_new(uint32_t nrows, uint32_t ncols) {
+    GF2Matrix *M = calloc(1, sizeof(GF2Matrix));
+    if (!M) return NULL;
+    uint32_t words = (ncols + WORD_BITS - 1) / WORD_BITS;
+    M->nrows = nrows;
+    M->ncols = ncols;
+    M->stride = (uint32_t)((words + LINE_WORDS - 1) / LINE_WORDS * LINE_WORDS);
+    if (M->stride == 0) M->stride = LINE_WORDS;
+
+    size_t bytes = (size_t)(nrows ? nrows : 1) * M->stride * sizeof(uint64_t);
+    M->block = aligned_alloc(CANON_MAT_ALIGN, bytes);
+    if (!M->block) {
+        free(M);
+        return NULL;
+    }
+    memset(M->block, 0, bytes);
+    M->rows = M->block;
+    return M;
+}
+
+void canon_mat_free(GF2Matrix *M) {
+    if (M) {
+        free(M->block);
+        free(M);
+    }
+}
+
+/*
+ * View of nrows x ncols starting at (row, col) of M; col % 64 == 0
+ * Shares M's storage: valid as long as M is, never freed itself
+ */
+GF2Matrix canon_mat_window(const GF2Matrix *M, uint32_t row, uint32_t col,
+                           uint32_t nrows, uint32_t ncols) {
+    GF2Matrix W = { nrows, ncols, M->stride, M->rows + (size_t)row * M->stride + col / WORD_BITS,
+                    NULL };
+    return W;
+}
+
+/*
+ * Clear M (only its own columns when it is a window)
+ */
+void canon_mat_zero(GF2Matrix *M) {
+    uint32_t words = canon_mat_words(M);
+    if (words == 0) return;
+    uint64_t mask = canon_mat_last_mask(M);
+    for (uint32_t r = 0; r < M->nrows; r++) {
+        uint64_t *row = canon_mat_row(M, r);
+        memset(row, 0, (words - 1) * sizeof(uint64_t));
+        row[words - 1] &= ~mask;
+    }
+}
+
+/*
+ * dst = src; same dimensions
+ */
+void canon_mat_copy(GF2Matrix *dst, const GF2Matrix *src) {
+    uint32_t words = canon_mat_words(src);
+    if (words == 0) return;
+    uint64_t mask = canon_mat_last_mask(src);
+    for (uint32_t r = 0; r < src->nrows; r++) {
+        uint64_t *d = canon_mat_row(dst, r);
+        const uint64_t *s = canon_mat_row(src, r);
+        memcpy(d, s, (words - 1) * sizeof(uint64_t));
+        d[words - 1] = (d[words - 1] & ~mask) | (s[words - 1] & mask);
+    }
+}
+
+/*
+ * C = A + B (XOR); same dimensions, C may alias A or B
+ */
+void canon_mat_add(GF2Matrix *C, const GF2Matrix *A, const GF2Matrix *B) {
+    uint32_t words = canon_mat_words(C);
+    if (words == 0) return;
+    uint64_t mask = canon_mat_last_mask(C);
+    for (uint32_t r = 0; r < C->nrows; r++) {
+        uint64_t *c = canon_mat_row(C, r);
+        const uint64_t *a = canon_mat_row(A, r), *b = canon_mat_row(B, r);
+        for (uint32_t w = 0; w + 1 < words; w++) c[w] = a[w] ^ b[w];
+        c[words - 1] = (c[words - 1] & ~mask) | ((a[words - 1] ^ b[words - 1]) & mask);
+    }
+}
+
+bool canon_mat_equal(const GF2Matrix *A, const GF2Matrix *B) {
+    if (A->nrows != B->nrows || A->ncols != B->ncols) return false;
+    uint32_t words = canon_mat_words(A);
+    if (words == 0) return true;
+    uint64_t mask = canon_mat_last_mask(A);
+    for (uint32_t r = 0; r < A->nrows; r++) {
+        const uint64_t *a = canon_mat_row(A, r), *b = canon_mat_row(B, r);
+        if (memcmp(a, b, (words - 1) * sizeof(uint64_t)) != 0) return false;
+        if ((a[words - 1] ^ b[words - 1]) & mask) return false;
+    }
+    return true;
+}
+
+/*
+ * Uniformly random entries from seed (splitmix64)
+ */
+void canon_mat_random(GF2Matrix *M, uint64_t seed) {
+    uint32_t words = canon_mat_words(M);
+    if (words == 0) return;
+    uint64_t mask = canon_mat_last_mask(M);
+    for (uint32_t r = 0; r < M->nrows; r++) {
+        uint64_t *row = canon_mat_row(M, r);
+        for (uint32_t w = 0; w < words; w++) {
+            uint64_t z = (seed += 0x9e3779b97f4a7c15ull);
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+            z ^= z >> 31;
+            row[w] = w + 1 < words ? z : (row[w] & ~mask) | (z & mask);
+        }
+    }
+}
+
+void canon_mat_swap_rows(GF2Matrix *M, uint32_t a, uint32_t b) {
+    if (a == b) return;
+    uint32_t words = canon_mat_words(M);
+    if (words == 0) return;
+    uint64_t mask = canon_mat_last_mask(M);
+    uint64_t *x = canon_mat_row(M, a), *y = canon_mat_row(M, b);
+    for (uint32_t w = 0; w + 1 < words; w++) {
+        uint64_t t = x[w];
+        x[w] = y[w];
+        y[w] = t;
+    }
+    uint64_t t = (x[words - 1] ^ y[words - 1]) & mask;
+    x[words - 1] ^= t;
+    y[words - 1] ^= t;
+}
+
+/*
+ * Transpose a 64x64 bit block in place (row i, bit j) -> (row j, bit i)
+ * Six rounds swapping 32x32, 16x16, ... 1x1 sub-blocks
+ */
+static void transpose64(uint64_t *a) {
+    static const uint64_t masks[6] = {
+        0x00000000ffffffffull, 0x0000ffff0000ffffull, 0x00ff00ff00ff00ffull,
+        0x0f0f0f0f0f0f0f0full, 0x3333333333333333ull, 0x5555555555555555ull,
+    };
+    for (int level = 0, j = 32; j; level++, j >>= 1) {
+        uint64_t m = masks[level];
+        for (int k = 0; k < 64; k = (k + j + 1) & ~j) {
+            uint64_t t = ((a[k] >> j) ^ a[k + j]) & m;
+            a[k] ^= t << j;
+            a[k + j] ^= t;
+        }
+    }
+}
+
+/*
+ * dst = src^T; dst is src->ncols x src->nrows
+ * Works in 64x64 blocks: one pass over src, each block written once
+ */
+void canon_mat_transpose(GF2Matrix *dst, const GF2Matrix *src) {
+    uint64_t block[64];
+    for (uint32_t r0 = 0; r0 < src->nrows; r0 += WORD_BITS) {
+        uint32_t rows = src->nrows - r0 < WORD_BITS ? src->nrows - r0 : WORD_BITS;
+        for (uint32_t c0 = 0; c0 < src->ncols; c0 += WORD_BITS) {
+            uint32_t cols = src->ncols - c0 < WORD_BITS ? src->ncols - c0 : WORD_BITS;
+            uint64_t in_mask = cols == WORD_BITS ? ~0ull : (1ull << cols) - 1;
+            for (uint32_t i = 0; i < rows; i++) block[i] = canon_mat_row(src, r0 + i)[c0 / WORD_BITS] & in_mask;
+            for (uint32_t i = rows; i < WORD_BITS; i++) block[i] = 0;
+            transpose64(block);
+
+            // Row c0+j of dst, word r0/64, gets bits 0..rows-1 of block[j]
+            uint64_t out_mask = rows == WORD_BITS ? ~0ull : (1ull << rows) - 1;
+            for (uint32_t j = 0; j < cols; j++) {
+                uint64_t *w = &canon_mat_row(dst, c0 + j)[r0 / WORD_BITS];
+                *w = (*w & ~out_mask) | (block[j] & out_mask);
+            }
+        }
+    }
+}
+
+/*
+ * rank x 8 matrix of a basis: row k holds the bits of element k
+ */
+GF2Matrix* canon_mat_from_basis(const GF2_Basis *B) {
+    GF2Matrix *M = canon_mat_new(B->rank, 8);
+    if (!M) return NULL;
+    for (uint32_t k = 0; k < B->rank; k++) canon_mat_row(M, k)[0] = B->basis[k];
+    return M;
+}
+
+/*
+ * Reference elimination: one pivot at a time, one row XOR per cleared row
+ * Same result as canon_m4ri_echelon() (the reduced form is unique)
+ */
+static uint32_t gauss_reference(GF2Matrix *A, bool full) {
+    uint32_t words = canon_mat_words(A);
+    uint64_t mask = canon_mat_last_mask(A);
+    uint32_t r = 0;
+    for (uint32_t c = 0; c < A->ncols && r < A->nrows; c++) {
+        uint32_t p = r;
+        while (p < A->nrows && !canon_mat_get(A, p, c)) p++;
+        if (p == A->nrows) continue;
+        canon_mat_swap_rows(A, p, r);
+        const uint64_t *pivot = canon_mat_row(A, r);
+        for (uint32_t i = full ? 0 : r + 1; i < A->nrows; i++) {
+            if (i == r || !canon_mat_get(A, i, c)) continue;
+            uint64_t *row = canon_mat_row(A, i);
+            for (uint32_t w = c / 64; w + 1 < words; w++) row[w] ^= pivot[w];
+            row[words - 1] ^= pivot[words - 1] & mask;
+        }
+        r++;
+    }
+    return r;
+}
+
+typedef struct {
+    uint32_t nrows, ncols;
+    uint32_t rank;          // Generate a matrix of at most this rank, 0 = uniform
+    uint32_t k;
+    uint32_t width;         // mul: columns of B
+    uint32_t cutoff;        // mul: Strassen-Winograd cutoff, 0 = default
+    uint64_t seed;
+    int threads;            // rank/rref: pool workers, 0 = one per CPU, 1 = serial
+    bool check;
+} MatrixOptions;
+
+/*
+ * Random test matrix: uniform, or X * Y through an inner dimension of rank
+ */
+static GF2Matrix* test_matrix(const MatrixOptions *o) {
+    GF2Matrix *A = canon_mat_new(o->nrows, o->ncols);
+    if (!A || o->rank == 0) {
+        if (A) canon_mat_random(A, o->seed);
+        return A;
+    }
+    GF2Matrix *X = canon_mat_new(o->nrows, o->rank), *Y = canon_mat_new(o->rank, o->ncols);
+    if (X && Y) {
+        canon_mat_random(X, o->seed);
+        canon_mat_random(Y, o->seed + 1);
+        canon_mat_addmul(A, X, Y);
+    } else {
+        canon_mat_free(A);
+        A = NULL;
+    }
+    canon_mat_free(X);
+    canon_mat_free(Y);
+    return A;
+}
+
+/*
+ * `matrix rank|rref`: M4RI (tile-parallel on a pool unless one thread),
+ * checked against gauss_reference()
+ */
+static int run_echelon(const MatrixOptions *o, bool full) {
+    GF2Matrix *A = test_matrix(o);
+    GF2Matrix *R = o->check ? canon_mat_new(o->nrows, o->ncols) : NULL;
+    if (!A || (o->check && !R)) {
+        fprintf(stderr, "Error: Cannot allocate %u x %u matrix\n", o->nrows, o->ncols);
+        canon_mat_free(A);
+        canon_mat_free(R);
+        return 1;
+    }
+    if (R) canon_mat_copy(R, A);
+    uint32_t k = o->k ? o->k : canon_m4ri_opt_k(o->nrows, o->ncols);
+    int threads = o->threads > 0 ? o->threads : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    // Without workers the elimination runs serially
+    CanonPool *pool = threads > 1 ? canon_pool_create(threads, 0) : NULL;
+    if (pool) threads = canon_pool_threads(pool);
+
+    uint64_t t0 = now_ns();
+    uint32_t rank = canon_m4ri_echelon_pool(pool, A, full, k, NULL);
+    double sec = (now_ns() - t0) / 1e9;
+    printf("M4RI %s (k = %u, %d thread%s): rank %u in %.3f seconds\n",
+           full ? "reduced echelon form" : "echelon form", k, pool ? threads : 1, pool ? "s" : "", rank, sec);
+    canon_pool_destroy(pool);
+
+    int status = 0;
+    if (R) {
+        t0 = now_ns();
+        uint32_t want = gauss_reference(R, full);
+        double ref = (now_ns() - t0) / 1e9;
+        printf("Reference elimination: rank %u in %.3f seconds (%.1fx)\n", want, ref, sec > 0 ? ref / sec : 0.0);
+        // Echelon forms differ with the pivot order; only the reduced one is unique
+        if (rank == want && (!full || canon_mat_equal(A, R))) {
+            printf("✓ M4RI matches the reference\n");
+        } else {
+            printf("✗ M4RI disagrees with the reference\n");
+            status = 1;
+        }
+    }
+
+    canon_mat_free(A);
+    canon_mat_free(R);
+    return status;
+}
+
+#define PLUQ_CHECK_BITS (1ull << 28)    // Largest matrix whose L * U is rebuilt
+#define PLUQ_CHECK_RHS 8                // Right-hand sides in the solve check
+
+/*
+ * L (m x r) and U (r x n) out of the packed PLUQ, times each other
+ */
+static GF2Matrix* pluq_product(const GF2Matrix *LU, uint32_t r) {
+    uint32_t m = LU->nrows, n = LU->ncols;
+    GF2Matrix *L = canon_mat_new(m, r ? r : 1), *U = canon_mat_new(r ? r : 1, n), *P = canon_mat_new(m, n);
+    if (!L || !U || !P) {
+        canon_mat_free(L);
+        canon_mat_free(U);
+        canon_mat_free(P);
+        return NULL;
+    }
+    if (r > 0) {
+        GF2Matrix Lsrc = canon_mat_window(LU, 0, 0, m, r), Usrc = canon_mat_window(LU, 0, 0, r, n);
+        canon_mat_copy(L, &Lsrc);
+        canon_mat_copy(U, &Usrc);
+        for (uint32_t i = 0; i < r; i++) {
+            uint64_t *l = canon_mat_row(L, i), *u = canon_mat_row(U, i);
+            for (uint32_t w = 0; w < canon_mat_words(L); w++) {
+                if (w * 64 + 63 >= i) l[w] &= w * 64 >= i ? 0 : (1ull << (i % 64)) - 1;
+            }
+            for (uint32_t w = 0; w <= i / 64; w++) u[w] &= w < i / 64 ? 0 : ~((1ull << (i % 64)) - 1);
+            canon_mat_set(L, i, i, 1);
+            canon_mat_set(U, i, i, 1);
+        }
+        canon_mat_addmul(P, L, U);
+    }
+    canon_mat_free(L);
+    canon_mat_free(U);
+    return P;
+}
+
+/*
+ * `matrix pluq`: factor, then check rank, A = P L U Q and a solve
+ */
+static int run_pluq(const MatrixOptions *o) {
+    uint32_t m = o->nrows, n = o->ncols;
+    GF2Matrix *A = test_matrix(o);
+    GF2Matrix *O = o->check ? canon_mat_new(m, n) : NULL;
+    uint32_t *rows = malloc(((size_t)m + n) * sizeof(uint32_t));
+    if (!A || (o->check && !O) || !rows) {
+        fprintf(stderr, "Error: Cannot allocate %u x %u matrix\n", m, n);
+        canon_mat_free(A);
+        canon_mat_free(O);
+        free(rows);
+        return 1;
+    }
+    uint32_t *cols = rows + m;
+    if (O) canon_mat_copy(O, A);
+
+    uint64_t t0 = now_ns();
+    uint32_t r = canon_pluq(A, rows, cols);
+    double sec = (now_ns() - t0) / 1e9;
+    printf("PLUQ: rank %u in %.3f seconds\n", r, sec);
+    printf("Column rank profile:");
+    for (uint32_t c = 0; c < r && c < 8; c++) printf(" %u", cols[c]);
+    printf("%s\n", r > 8 ? " ..." : "");
+
+    int status = 0;
+    if (O) {
+        uint32_t want = canon_m4ri_rank(O);
+        printf("%s Rank matches M4RI (%u)\n", want == r ? "✓" : "✗", want);
+        status |= want != r;
+
+        if ((uint64_t)m * n <= PLUQ_CHECK_BITS) {
+            GF2Matrix *LU = pluq_product(A, r), *PA = canon_mat_new(m, n);
+            bool same = LU && PA;
+            if (same) {
+                for (uint32_t i = 0; i < m; i++) {
+                    for (uint32_t c = 0; c < n; c++) canon_mat_set(PA, i, c, canon_mat_get(O, rows[i], cols[c]));
+                }
+                same = canon_mat_equal(LU, PA);
+            }
+            printf("%s L * U reproduces A in the reported row and column order\n", same ? "✓" : "✗");
+            status |= !same;
+            canon_mat_free(LU);
+            canon_mat_free(PA);
+        } else {
+            printf("  L * U check skipped above %llu entries\n", PLUQ_CHECK_BITS);
+        }
+
+        // A X = A X0 always has a solution; any X it returns must satisfy it
+        GF2Matrix *X0 = canon_mat_new(n, PLUQ_CHECK_RHS), *X = canon_mat_new(n, PLUQ_CHECK_RHS);
+        GF2Matrix *B = canon_mat_new(m, PLUQ_CHECK_RHS), *AX = canon_mat_new(m, PLUQ_CHECK_RHS);
+        bool solved = X0 && X && B && AX;
+        if (solved) {
+            canon_mat_random(X0, o->seed + 2);
+            canon_mat_addmul(B, O, X0);
+            solved = canon_pluq_solve(A, r, rows, cols, B, X);
+            if (solved) {
+                canon_mat_addmul(AX, O, X);
+                solved = canon_mat_equal(AX, B);
+            }
+        }
+        printf("%s Solve of A X = B from the factorization\n", solved ? "✓" : "✗");
+        status |= !solved;
+        canon_mat_free(X0);
+        canon_mat_free(X);
+        canon_mat_free(B);
+        canon_mat_free(AX);
+    }
+
+    canon_mat_free(A);
+    canon_mat_free(O);
+    free(rows);
+    return status;
+}
+
+#define MUL_CHECK_VECTORS 64    // Random columns in the Freivalds check
+
+/*
+ * `matrix mul`: C = A * B, checked by Freivalds' test C X = A (B X) on
+ * random vectors and against the plain M4RM product
+ */
+static int run_mul(const MatrixOptions *o) {
+    uint32_t m = o->nrows, k = o->ncols, n = o->width;
+    GF2Matrix *A = canon_mat_new(m, k), *B = canon_mat_new(k, n), *C = canon_mat_new(m, n);
+    if (!A || !B || !C) {
+        fprintf(stderr, "Error: Cannot allocate %u x %u x %u product\n", m, k, n);
+        canon_mat_free(A);
+        canon_mat_free(B);
+        canon_mat_free(C);
+        return 1;
+    }
+    canon_mat_random(A, o->seed);
+    canon_mat_random(B, o->seed + 1);
+    canon_mat_zero(C);
+    uint32_t cutoff = o->cutoff ? o->cutoff : CANON_MUL_CUTOFF;
+
+    uint64_t t0 = now_ns();
+    canon_mat_addmul_cutoff(C, A, B, cutoff);
+    double sec = (now_ns() - t0) / 1e9;
+    printf("Strassen-Winograd (cutoff %u): %u x %u times %u x %u in %.3f seconds\n", cutoff, m, k, k, n, sec);
+
+    int status = 0;
+    if (o->check) {
+        GF2Matrix *X = canon_mat_new(n, MUL_CHECK_VECTORS), *BX = canon_mat_new(k, MUL_CHECK_VECTORS);
+        GF2Matrix *ABX = canon_mat_new(m, MUL_CHECK_VECTORS), *CX = canon_mat_new(m, MUL_CHECK_VECTORS);
+        bool same = X && BX && ABX && CX;
+        if (same) {
+            canon_mat_random(X, o->seed + 2);
+            canon_mat_zero(BX);
+            canon_mat_zero(ABX);
+            canon_mat_zero(CX);
+            canon_mat_addmul_m4rm(BX, B, X);
+            canon_mat_addmul_m4rm(ABX, A, BX);
+            canon_mat_addmul_m4rm(CX, C, X);
+            same = canon_mat_equal(CX, ABX);
+        }
+        printf("%s C X = A (B X) for %d random vectors\n", same ? "✓" : "✗", MUL_CHECK_VECTORS);
+        status |= !same;
+        canon_mat_free(X);
+        canon_mat_free(BX);
+        canon_mat_free(ABX);
+        canon_mat_free(CX);
+
+        GF2Matrix *D = canon_mat_new(m, n);
+        same = D != NULL;
+        if (same) {
+            canon_mat_zero(D);
+            t0 = now_ns();
+            canon_mat_addmul_m4rm(D, A, B);
+            double ref = (now_ns() - t0) / 1e9;
+            printf("M4RM alone: %.3f seconds (%.2fx)\n", ref, sec > 0 ? ref / sec : 0.0);
+            same = canon_mat_equal(C, D);
+        }
+        printf("%s Strassen-Winograd matches M4RM\n", same ? "✓" : "✗");
+        status |= !same;
+        canon_mat_free(D);
+    }
+
+    canon_mat_free(A);
+    canon_mat_free(B);
+    canon_mat_free(C);
+    return status;
+}
+
+/*
+ * `canon matrix <rank|rref|pluq|mul> <rows> [cols [width]] [--rank R] [--k K] [--cutoff C] [--seed S]
+ *  [--threads N] [--check]`
+ */
+int canon_matrix_main(int argc, char **argv) {
+    if (argc < 3) {
+        fprintf(stderr, "Usage: canon matrix <rank|rref|pluq|mul> <rows> [cols [width]] [--rank R] [--k K]\n"
+                        "                    [--cutoff C] [--seed S] [--threads N] [--check]\n");
+        return 1;
+    }
+    const char *op = argv[1];
+    if (strcmp(op, "rank") != 0 && strcmp(op, "rref") != 0 && strcmp(op, "pluq") != 0 && strcmp(op, "mul") != 0) {
+        fprintf(stderr, "Error: Unknown matrix operation '%s'\n", op);
+        return 1;
+    }
+    MatrixOptions o = { .seed = 1 };
+    o.nrows = o.ncols = (uint32_t)strtoul(argv[2], NULL, 10);
+    int i = 3;
+    if (i < argc && argv[i][0] != '-') o.ncols = (uint32_t)strtoul(argv[i++], NULL, 10);
+    // mul: A is rows x cols, B is cols x width
+    o.width = o.ncols;
+    if (strcmp(op, "mul") == 0 && i < argc && argv[i][0] != '-') o.width = (uint32_t)strtoul(argv[i++], NULL, 10);
+    for (; i < argc; i++) {
+        if (strcmp(argv[i], "--rank") == 0 && i + 1 < argc) {
+            o.rank = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--k") == 0 && i + 1 < argc) {
+            o.k = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--cutoff") == 0 && i + 1 < argc) {
+            o.cutoff = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            o.seed = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            o.threads = (int)strtol(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--check") == 0) {
+            o.check = true;
+        } else {
+            fprintf(stderr, "Error: Unknown option '%s'\n", argv[i]);
+            return 1;
+        }
+    }
+    if (o.nrows == 0 || o.ncols == 0 || o.width == 0) {
+        fprintf(stderr, "Error: Matrix dimensions must be positive\n");
+        return 1;
+    }
+
+    printf("Matrix: %u x %u, random (seed %lu", o.nrows, o.ncols, o.seed);
+    if (o.rank) printf(", rank at most %u", o.rank);
+    printf("), %.1f MB\n", (double)o.nrows * ((o.ncols + 511) / 512 * 8) * sizeof(uint64_t) / 1048576.0);
+
+    if (strcmp(op, "mul") == 0) return run_mul(&o);
+    if (strcmp(op, "pluq") == 0) return run_pluq(&o);
+    return run_echelon(&o, strcmp(op, "rref") == 0);
+}
@@ -0,0 +1,373 @@
+/*
+ * CANON - Latency histograms and Prometheus metrics
+ *
+ * Author: Francesco Pedulli
+ * Date: February 26, 2026
+ *
+ * Each thread records into its own HDR-style log-linear histograms
+ * (128 linear sub-buckets per power of two, < 0.8% relative error),
+ * so the hot path is two relaxed loads and stores with no locks and
+ * no shared cache lines. Readers merge all thread histograms on demand.
+ *
+ * Enabled through the environment:
+ *   CANON_METRICS=<file.prom>      merged into file at exit; the raw
+ *                                  histograms live in <file.prom>.hdr so
+ *                                  successive jobs on a host accumulate
+ *   CANON_METRICS_SOCKET=<path>    Unix socket answering every connect
+ *                                  with the current exposition text
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <time.h>
+#include <signal.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "canon.h"
+
+#define HDR_SUB_BITS 7
+#define HDR_SUB_COUNT (1u << HDR_SUB_BITS)    // 128 linear buckets
+#define HDR_HALF (HDR_SUB_COUNT / 2)
+#define HDR_MAX_BITS 44                       // ~4.9 hours in ns
+#define HDR_BUCKETS (HDR_SUB_COUNT + (HDR_MAX_BITS - HDR_SUB_BITS) * HDR_HALF)
+#define HDR_FILE_MAGIC "CNHDR1\n"
+
+static const char *metric_names[METRIC_OP_COUNT] = {
+    "compress", "decompress", "load", "save", "estimate"
+};
+
+/*
+ * One operation's histogram plus byte counters
+ * Written only by the owning thread, read by anyone.
+ */
+typedef struct {
+    _Atomic uint64_t count;
+    _Atomic uint64_t sum_ns;
+    _Atomic uint64_t bytes_in;
+    _Atomic uint64_t bytes_out;
+    _Atomic uint64_t buckets[HDR_BUCKETS];
+} MetricsHist;
+
+typedef struct MetricsThread {
+    MetricsHist ops[METRIC_OP_COUNT];
+    struct MetricsThread *next;
+} MetricsThread;
+
+/*
+ * Plain (non-atomic) merged view
+ */
+typedef struct {
+    uint64_t count, sum_ns, bytes_in, bytes_out;
+    uint64_t buckets[HDR_BUCKETS];
+} MetricsTotals;
+
+bool canon_metrics_enabled;
+
+static _Atomic(MetricsThread *) metrics_threads;
+static _Thread_local MetricsThread *metrics_self;
+static const char *metrics_file;
+static const char *metrics_socket;
+
+uint64_t canon_metrics_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/*
+ * Value -> bucket: linear below 128, then 64 buckets per power of two
+ */
+static uint32_t hdr_index(uint64_t v) {
+    if (v < HDR_SUB_COUNT) return (uint32_t)v;
+    int msb = 63 - __builtin_clzll(v);
+    if (msb >= HDR_MAX_BITS) return HDR_BUCKETS - 1;
+    int shift = msb - (HDR_SUB_BITS - 1);
+    return HDR_SUB_COUNT + (uint32_t)(shift - 1) * HDR_HALF +
+           (uint32_t)((v >> shift) - HDR_HALF);
+}
+
+/*
+ * Bucket -> representative value (midpoint of its range)
+ */
+static uint64_t hdr_value(uint32_t idx) {
+    if (idx < HDR_SUB_COUNT) return idx;
+    uint32_t shift = (idx - HDR_SUB_COUNT) / HDR_HALF + 1;
+    uint64_t sub = (idx - HDR_SUB_COUNT) % HDR_HALF + HDR_HALF;
+    return (sub << shift) + ((1ull << shift) >> 1);
+}
+
+static MetricsThread* metrics_thread(void) {
+    if (metrics_self) return metrics_self;
+
+    MetricsThread *t = calloc(1, sizeof(MetricsThread));
+    if (!t) return NULL;
+
+    // Lock-free push; threads are never unlinked so totals survive exit
+    t->next = atomic_load(&metrics_threads);
+    while (!atomic_compare_exchange_weak(&metrics_threads, &t->next, t)) {}
+    metrics_self = t;
+    return t;
+}
+
+static inline void bump(_Atomic uint64_t *c, uint64_t v) {
+    // Single writer: a plain load/store pair, no locked RMW needed
+    atomic_store_explicit(c, atomic_load_explicit(c, memory_order_relaxed) + v,
+                          memory_order_relaxed);
+}
+
+/*
+ * Record one operation (no-op unless metrics are enabled)
+ */
+void canon_metrics_record(CanonMetricOp op, uint64_t latency_ns,
+                          uint64_t bytes_in, uint64_t bytes_out) {
+    if (!canon_metrics_enabled || op >= METRIC_OP_COUNT) return;
+    MetricsThread *t = metrics_thread();
+    if (!t) return;
+
+    MetricsHist *h = &t->ops[op];
+    bump(&h->buckets[hdr_index(latency_ns)], 1);
+    bump(&h->sum_ns, latency_ns);
+    bump(&h->bytes_in, bytes_in);
+    bump(&h->bytes_out, bytes_out);
+    bump(&h->count, 1);
+}
+
+static void metrics_merge(MetricsTotals totals[METRIC_OP_COUNT]) {
+    memset(totals, 0, METRIC_OP_COUNT * sizeof(MetricsTotals));
+    for (MetricsThread *t = atomic_load(&metrics_threads); t; t = t->next) {
+        for (int op = 0; op < METRIC_OP_COUNT; op++) {
+            MetricsHist *h = &t->ops[op];
+            MetricsTotals *m = &totals[op];
+            m->count += atomic_load_explicit(&h->count, memory_order_relaxed);
+            m->sum_ns += atomic_load_explicit(&h->sum_ns, memory_order_relaxed);
+            m->bytes_in += atomic_load_explicit(&h->bytes_in, memory_order_relaxed);
+            m->bytes_out += atomic_load_explicit(&h->bytes_out, memory_order_relaxed);
+            for (uint32_t b = 0; b < HDR_BUCKETS; b++) {
+                m->buckets[b] += atomic_load_explicit(&h->buckets[b], memory_order_relaxed);
+            }
+        }
+    }
+}
+
+static double quantile_seconds(const MetricsTotals *m, double q) {
+    if (m->count == 0) return 0.0;
+    uint64_t target = (uint64_t)(q * m->count);
+    if (target >= m->count) target = m->count - 1;
+
+    uint64_t seen = 0;
+    for (uint32_t b = 0; b < HDR_BUCKETS; b++) {
+        seen += m->buckets[b];
+        if (seen > target) return hdr_value(b) / 1e9;
+    }
+    return hdr_value(HDR_BUCKETS - 1) / 1e9;
+}
+
+/*
+ * Prometheus text exposition of merged totals
+ */
+static void metrics_expose(FILE *f, const MetricsTotals totals[METRIC_OP_COUNT]) {
+    static const double quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+
+    fprintf(f, "# HELP canon_operation_duration_seconds Latency of canon operations.\n");
+    fprintf(f, "# TYPE canon_operation_duration_seconds summary\n");
+    for (int op = 0; op < METRIC_OP_COUNT; op++) {
+        const MetricsTotals *m = &totals[op];
+        if (m->count == 0) continue;
+        for (size_t q = 0; q < sizeof(quantiles) / sizeof(quantiles[0]); q++) {
+            fprintf(f, "canon_operation_duration_seconds{op=\"%s\",quantile=\"%g\"} %.9g\n",
+                    metric_names[op], quantiles[q], quantile_seconds(m, quantiles[q]));
+        }
+        fprintf(f, "canon_operation_duration_seconds_sum{op=\"%s\"} %.9g\n",
+                metric_names[op], m->sum_ns / 1e9);
+        fprintf(f, "canon_operation_duration_seconds_count{op=\"%s\"} %lu\n",
+                metric_names[op], m->count);
+    }
+
+    fprintf(f, "# HELP canon_operation_bytes_in_total Bytes consumed by canon operations.\n");
+    fprintf(f, "# TYPE canon_operation_bytes_in_total counter\n");
+    for (int op = 0; op < METRIC_OP_COUNT; op++) {
+        if (totals[op].count == 0) continue;
+        fprintf(f, "canon_operation_bytes_in_total{op=\"%s\"} %lu\n",
+                metric_names[op], totals[op].bytes_in);
+    }
+
+    fprintf(f, "# HELP canon_operation_bytes_out_total Bytes produced by canon operations.\n");
+    fprintf(f, "# TYPE canon_operation_bytes_out_total counter\n");
+    for (int op = 0; op < METRIC_OP_COUNT; op++) {
+        if (totals[op].count == 0) continue;
+        fprintf(f, "canon_operation_bytes_out_total{op=\"%s\"} %lu\n",
+                metric_names[op], totals[op].bytes_out);
+    }
+}
+
+/*
+ * Write this process's metrics as Prometheus text
+ */
+void canon_metrics_write(FILE *f) {
+    MetricsTotals *totals = malloc(METRIC_OP_COUNT * sizeof(MetricsTotals));
+    if (!totals) return;
+    metrics_merge(totals);
+    metrics_expose(f, totals);
+    free(totals);
+}
+
+/*
+ * Merge into <path>.hdr under flock, then rewrite <path> atomically
+ * so node exporters never see a partial file
+ */
+bool canon_metrics_write_file(const char *path) {
+    char raw_path[4096], tmp_path[4096];
+    snprintf(raw_path, sizeof(raw_path), "%s.hdr", path);
+    snprintf(tmp_path, sizeof(tmp_path), "%s.%d.tmp", path, (int)getpid());
+
+    MetricsTotals *totals = malloc(2 * METRIC_OP_COUNT * sizeof(MetricsTotals));
+    if (!totals) return false;
+    MetricsTotals *prior = totals + METRIC_OP_COUNT;
+    metrics_merge(totals);
+
+    int fd = open(raw_path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0 || flock(fd, LOCK_EX) < 0) {
+        perror("Error opening metrics state");
+        if (fd >= 0) close(fd);
+        free(totals);
+        return false;
+    }
+
+    // Accumulate what earlier jobs left behind
+    char magic[sizeof(HDR_FILE_MAGIC) - 1];
+    uint32_t nops, nbuckets;
+    if (read(fd, magic, sizeof(magic)) == (ssize_t)sizeof(magic) &&
+        memcmp(magic, HDR_FILE_MAGIC, sizeof(magic)) == 0 &&
+        read(fd, &nops, 4) == 4 && read(fd, &nbuckets, 4) == 4 &&
+        nops == METRIC_OP_COUNT && nbuckets == HDR_BUCKETS &&
+        read(fd, prior, METRIC_OP_COUNT * sizeof(MetricsTotals)) ==
+            (ssize_t)(METRIC_OP_COUNT * sizeof(MetricsTotals))) {
+        for (int op = 0; op < METRIC_OP_COUNT; op++) {
+            totals[op].count += prior[op].count;
+            totals[op].sum_ns += prior[op].sum_ns;
+            totals[op].bytes_in += prior[op].bytes_in;
+            totals[op].bytes_out += prior[op].bytes_out;
+            for (uint32_t b = 0; b < HDR_BUCKETS; b++) {
+                totals[op].buckets[b] += prior[op].buckets[b];
+            }
+        }
+    }
+
+    nops = METRIC_OP_COUNT;
+    nbuckets = HDR_BUCKETS;
+    bool ok = ftruncate(fd, 0) == 0 && lseek(fd, 0, SEEK_SET) == 0 &&
+              write(fd, HDR_FILE_MAGIC, sizeof(magic)) == (ssize_t)sizeof(magic) &&
+              write(fd, &nops, 4) == 4 && write(fd, &nbuckets, 4) == 4 &&
+              write(fd, totals, METRIC_OP_COUNT * sizeof(MetricsTotals)) ==
+                  (ssize_t)(METRIC_OP_COUNT * sizeof(MetricsTotals));
+
+    FILE *f = ok ? fopen(tmp_path, "w") : NULL;
+    if (f) {
+        metrics_expose(f, totals);
+        ok = fclose(f) == 0 && rename(tmp_path, path) == 0;
+    } else {
+        ok = false;
+    }
+    if (!ok) {
+        perror("Error writing metrics");
+        unlink(tmp_path);
+    }
+
+    close(fd);  // Releases the lock
+    free(totals);
+    return ok;
+}
+
+static void metrics_at_exit(void) {
+    if (metrics_file) canon_metrics_write_file(metrics_file);
+    if (metrics_socket) unlink(metrics_socket);
+}
+
+/*
+ * Exporter thread: each connection receives one exposition
+ */
+static void* metrics_socket_thread(void *arg) {
+    int listen_fd = (int)(intptr_t)arg;
+    for (;;) {
+        int conn = accept(listen_fd, NULL, NULL);
+        if (conn < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            break;
+        }
+        FILE *f = fdopen(conn, "w");
+        if (f) {
+            canon_metrics_write(f);
+            fclose(f);
+        } else {
+            close(conn);
+        }
+    }
+    return NULL;
+}
+
+static bool metrics_listen(const char *path) {
+    struct sockaddr_un addr;
+    if (strlen(path) >= sizeof(addr.sun_path)) return false;
+
+    struct stat st;
+    if (stat(path, &st) == 0 && S_ISSOCK(st.st_mode)) unlink(path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return false;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 16) < 0) {
+        close(fd);
+        return false;
+    }
+
+    // The exporter must never take signals meant for sigwait() callers
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    pthread_t t;
+    int rc = pthread_create(&t, NULL, metrics_socket_thread, (void *)(intptr_t)fd);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (rc != 0) {
+        close(fd);
+        return false;
+    }
+    pthread_detach(t);
+    return true;
+}
+
+/*
+ * Read CANON_METRICS / CANON_METRICS_SOCKET and enable recording
+ */
+void canon_metrics_init(void) {
+    const char *file = getenv("CANON_METRICS");
+    const char *sock = getenv("CANON_METRICS_SOCKET");
+
+    if (file && *file) {
+        metrics_file = file;
+        canon_metrics_enabled = true;
+    }
+    if (sock && *sock) {
+        if (metrics_listen(sock)) {
+            metrics_socket = sock;
+            canon_metrics_enabled = true;
+        } else {
+            fprintf(stderr, "Warning: Cannot serve metrics on %s\n", sock);
+        }
+    }
+    if (canon_metrics_enabled) atexit(metrics_at_exit);
+}
@@ -0,0 +1,152 @@
+/*
+ * CANON - Strassen-Winograd matrix multiplication over GF(2)
+ *
+ * Author: Francesco Pedulli
+ * Date: February 26, 2026
+ *
+ * canon_mat_addmul() computes C += A * B. Above a cutoff it splits every
+ * operand into 2 x 2 blocks and uses Winograd's variant of Strassen's
+ * algorithm: 7 block products and 15 block additions instead of 8
+ * products. Over GF(2) addition and subtraction are both XOR, and the
+ * additions are plain row XORs on packed words, so they cost almost
+ * nothing next to the products they save. Below the cutoff the products
+ * run in the Four-Russians kernel (canon_mat_addmul_m4rm()), whose
+ * Gray-code tables and fused AVX-512/AVX2 row XORs are the fastest way
+ * to multiply blocks that fit the cache.
+ *
+ * The schedule accumulates straight into the four blocks of C with three
+ * temporaries (one block each of A, B and C), so C += A * B never needs
+ * a full-size product buffer:
+ *
+ *     Z  = A11 B11                 C11 += Z + A12 B21
+ *     Z += S2 T2,  S2 = A11 + A21 + A22,  T2 = B11 + B12 + B22
+ *     C12 += Z + (A12 + S2) B22    C21 += A22 (T2 + B21)
+ *     Z += S3 T3,  S3 = A11 + A21,  T3 = B12 + B22
+ *     C21 += Z,  C22 += Z
+ *     Z  = S1 T1,  S1 = A21 + A22,  T1 = B11 + B12
+ *     C12 += Z,  C22 += Z
+ *
+ * Column splits fall on multiples of 64 so every block is a window. The
+ * dimensions that do not split evenly leave a last row, up to 127
+ * columns of B or C and up to 127 inner columns. These are "peeled" off
+ * and added with M4RM.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "canon.h"
+
+static void addmul_rec(GF2Matrix *C, const GF2Matrix *A, const GF2Matrix *B, uint32_t cutoff);
+
+/*
+ * One Winograd level on the 2m x 2k by 2k x 2n cores of A, B and C;
+ * false (nothing done) when the temporaries cannot be allocated
+ */
+static bool winograd(GF2Matrix *C, const GF2Matrix *A, const GF2Matrix *B, uint32_t m, uint32_t k, uint32_t n,
+                     uint32_t cutoff) {
+    GF2Matrix *X = canon_mat_new(m, k), *Y = canon_mat_new(k, n), *Z = canon_mat_new(m, n);
+    if (!X || !Y || !Z) {
+        canon_mat_free(X);
+        canon_mat_free(Y);
+        canon_mat_free(Z);
+        return false;
+    }
+    GF2Matrix A11 = canon_mat_window(A, 0, 0, m, k), A12 = canon_mat_window(A, 0, k, m, k);
+    GF2Matrix A21 = canon_mat_window(A, m, 0, m, k), A22 = canon_mat_window(A, m, k, m, k);
+    GF2Matrix B11 = canon_mat_window(B, 0, 0, k, n), B12 = canon_mat_window(B, 0, n, k, n);
+    GF2Matrix B21 = canon_mat_window(B, k, 0, k, n), B22 = canon_mat_window(B, k, n, k, n);
+    GF2Matrix C11 = canon_mat_window(C, 0, 0, m, n), C12 = canon_mat_window(C, 0, n, m, n);
+    GF2Matrix C21 = canon_mat_window(C, m, 0, m, n), C22 = canon_mat_window(C, m, n, m, n);
+
+    canon_mat_zero(Z);
+    addmul_rec(Z, &A11, &B11, cutoff);         // Z = P1
+    canon_mat_add(&C11, &C11, Z);
+    addmul_rec(&C11, &A12, &B21, cutoff);      // C11 = P1 + P2
+
+    canon_mat_add(X, &A21, &A22);
+    canon_mat_add(X, X, &A11);                  // X = S2
+    canon_mat_add(Y, &B11, &B12);
+    canon_mat_add(Y, Y, &B22);                  // Y = T2
+    addmul_rec(Z, X, Y, cutoff);                // Z = P1 + P6
+    canon_mat_add(&C12, &C12, Z);
+    canon_mat_add(X, X, &A12);                  // X = S4
+    addmul_rec(&C12, X, &B22, cutoff);         // C12 += P3
+    canon_mat_add(Y, Y, &B21);                  // Y = T4
+    addmul_rec(&C21, &A22, Y, cutoff);         // C21 += P4
+
+    canon_mat_add(X, &A11, &A21);               // X = S3
+    canon_mat_add(Y, &B12, &B22);               // Y = T3
+    addmul_rec(Z, X, Y, cutoff);                // Z = P1 + P6 + P7
+    canon_mat_add(&C21, &C21, Z);
+    canon_mat_add(&C22, &C22, Z);
+
+    canon_mat_add(X, &A21, &A22);               // X = S1
+    canon_mat_add(Y, &B11, &B12);               // Y = T1
+    canon_mat_zero(Z);
+    addmul_rec(Z, X, Y, cutoff);                // Z = P5
+    canon_mat_add(&C12, &C12, Z);
+    canon_mat_add(&C22, &C22, Z);
+
+    canon_mat_free(X);
+    canon_mat_free(Y);
+    canon_mat_free(Z);
+    return true;
+}
+
+static void addmul_rec(GF2Matrix *C, const GF2Matrix *A, const GF2Matrix *B, uint32_t cutoff) {
+    uint32_t m = C->nrows, k = A->ncols, n = C->ncols;
+    if (m < cutoff || k < cutoff || n < cutoff) {
+        canon_mat_addmul_m4rm(C, A, B);
+        return;
+    }
+    // Halves of the columns are whole words; an odd remainder is peeled
+    uint32_t mh = m / 2, kh = k / 128 * 64, nh = n / 128 * 64;
+    GF2Matrix Cc = canon_mat_window(C, 0, 0, 2 * mh, 2 * nh);
+    GF2Matrix Ac = canon_mat_window(A, 0, 0, 2 * mh, 2 * kh), Bc = canon_mat_window(B, 0, 0, 2 * kh, 2 * nh);
+    if (!winograd(&Cc, &Ac, &Bc, mh, kh, nh, cutoff)) {
+        canon_mat_addmul_m4rm(&Cc, &Ac, &Bc);
+    }
+
+    if (k > 2 * kh) {
+        GF2Matrix Ak = canon_mat_window(A, 0, 2 * kh, 2 * mh, k - 2 * kh);
+        GF2Matrix Bk = canon_mat_window(B, 2 * kh, 0, k - 2 * kh, 2 * nh);
+        canon_mat_addmul_m4rm(&Cc, &Ak, &Bk);
+    }
+    if (n > 2 * nh) {
+        GF2Matrix Cn = canon_mat_window(C, 0, 2 * nh, m, n - 2 * nh);
+        GF2Matrix Bn = canon_mat_window(B, 0, 2 * nh, k, n - 2 * nh);
+        canon_mat_addmul_m4rm(&Cn, A, &Bn);
+    }
+    if (m > 2 * mh) {
+        GF2Matrix Cm = canon_mat_window(C, 2 * mh, 0, 1, 2 * nh);
+        GF2Matrix Am = canon_mat_window(A, 2 * mh, 0, 1, k);
+        GF2Matrix Bm = canon_mat_window(B, 0, 0, k, 2 * nh);
+        canon_mat_addmul_m4rm(&Cm, &Am, &Bm);
+    }
+}
+
+/*
+ * C += A * B with Strassen-Winograd down to cutoff (0 = CANON_MUL_CUTOFF)
+ * A is m x n, B is n x p, C is m x p; any of them may be a window. The
+ * recursion continues while all three dimensions are at least cutoff.
+ */
+void canon_mat_addmul_cutoff(GF2Matrix *C, const GF2Matrix *A, const GF2Matrix *B, uint32_t cutoff) {
+    if (C->nrows == 0 || C->ncols == 0 || A->ncols == 0) return;
+    if (cutoff == 0) cutoff = CANON_MUL_CUTOFF;
+    // Each half must keep at least a word of columns
+    if (cutoff < 128) cutoff = 128;
+    addmul_rec(C, A, B, cutoff);
+}
+
+/*
+ * C += A * B
+ */
+void canon_mat_addmul(GF2Matrix *C, const GF2Matrix *A, const GF2Matrix *B) {
+    canon_mat_addmul_cutoff(C, A, B, CANON_MUL_CUTOFF);
+}
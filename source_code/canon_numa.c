@@ -0,0 +1,170 @@
+/*
+ * CANON - NUMA topology, placement and pinning
+ *
+ * Author: Francesco Pedulli
+ * Date: February 26, 2026
+ *
+ * Topology comes from /sys/devices/system/node and page placement from
+ * the move_pages/mbind syscalls directly, so there is no libnuma
+ * dependency. On single-node hosts (or without sysfs) everything
+ * degrades to one node containing every allowed CPU.
+ *
+ * Workers are spread over nodes by interleaving each node's CPUs, so a
+ * pool of N workers on a dual-socket host gets N/2 per socket. Buffer
+ * pools are bound to a node with MPOL_PREFERRED, which means they are
+ * placed locally when possible and never fail when a node is full.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <sched.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include "canon.h"
+
+#define MPOL_PREFERRED 1
+
+static int numa_nodes = 1;
+static int cpu_node[CPU_SETSIZE];
+static int worker_cpus[CPU_SETSIZE];    // Allowed CPUs, nodes interleaved
+static int nworker_cpus;
+static cpu_set_t node_cpus[CANON_MAX_NODES];
+static int node_kernel[CANON_MAX_NODES];   // Our node index -> kernel node
+static int kernel_index[CANON_MAX_NODES];  // Kernel node -> our index, -1 if none
+static pthread_once_t numa_once = PTHREAD_ONCE_INIT;
+
+/*
+ * Parse a sysfs CPU list such as "0-15,32-47" into a set
+ */
+static void parse_cpulist(const char *s, cpu_set_t *set) {
+    CPU_ZERO(set);
+    while (*s) {
+        char *end;
+        long a = strtol(s, &end, 10);
+        if (end == s) break;
+        long b = a;
+        if (*end == '-') b = strtol(end + 1, &end, 10);
+        for (long c = a; c <= b && c < CPU_SETSIZE; c++) CPU_SET(c, set);
+        s = *end == ',' ? end + 1 : end;
+        if (*s == '\n') break;
+    }
+}
+
+static void numa_discover(void) {
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        CPU_ZERO(&allowed);
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        for (long c = 0; c < n && c < CPU_SETSIZE; c++) CPU_SET(c, &allowed);
+    }
+
+    numa_nodes = 0;
+    for (int k = 0; k < CANON_MAX_NODES; k++) kernel_index[k] = -1;
+    for (int node = 0; node < CANON_MAX_NODES; node++) {
+        char path[96], buf[4096];
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+        FILE *f = fopen(path, "r");
+        if (!f) continue;
+        bool ok = fgets(buf, sizeof(buf), f) != NULL;
+        fclose(f);
+        if (!ok) continue;
+
+        cpu_set_t set;
+        parse_cpulist(buf, &set);
+        CPU_AND(&set, &set, &allowed);
+        if (CPU_COUNT(&set) == 0) continue;     // Memory-only or not ours
+        node_cpus[numa_nodes] = set;
+        node_kernel[numa_nodes] = node;
+        kernel_index[node] = numa_nodes;
+        for (int c = 0; c < CPU_SETSIZE; c++) {
+            if (CPU_ISSET(c, &set)) cpu_node[c] = numa_nodes;
+        }
+        numa_nodes++;
+    }
+    if (numa_nodes == 0) {
+        numa_nodes = 1;
+        node_cpus[0] = allowed;
+        node_kernel[0] = 0;
+    }
+
+    // Interleave: first CPU of every node, then the second, ...
+    int next[CANON_MAX_NODES] = {0};
+    for (bool more = true; more;) {
+        more = false;
+        for (int node = 0; node < numa_nodes; node++) {
+            while (next[node] < CPU_SETSIZE && !CPU_ISSET(next[node], &node_cpus[node])) next[node]++;
+            if (next[node] < CPU_SETSIZE) {
+                worker_cpus[nworker_cpus++] = next[node]++;
+                more = true;
+            }
+        }
+    }
+}
+
+int canon_numa_nodes(void) {
+    pthread_once(&numa_once, numa_discover);
+    return numa_nodes;
+}
+
+/*
+ * CPU and node for pool worker i (wraps when workers exceed CPUs)
+ */
+int canon_numa_worker_cpu(int worker) {
+    pthread_once(&numa_once, numa_discover);
+    return nworker_cpus ? worker_cpus[worker % nworker_cpus] : 0;
+}
+
+int canon_numa_cpu_node(int cpu) {
+    pthread_once(&numa_once, numa_discover);
+    return cpu >= 0 && cpu < CPU_SETSIZE ? cpu_node[cpu] : 0;
+}
+
+/*
+ * Pin the calling thread to one CPU, or to every CPU of its node
+ */
+bool canon_numa_pin(int cpu, bool single_cpu) {
+    pthread_once(&numa_once, numa_discover);
+    cpu_set_t set;
+    if (single_cpu) {
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+    } else {
+        set = node_cpus[canon_numa_cpu_node(cpu)];
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+/*
+ * Node holding the page at addr, or -1 if not resident / unknown
+ * Returned as a pool node index, not the kernel node number
+ */
+int canon_numa_page_node(const void *addr) {
+    if (canon_numa_nodes() == 1) return 0;
+    void *page = (void *)((uintptr_t)addr & ~(uintptr_t)4095);
+    int status = -1;
+    if (syscall(__NR_move_pages, 0, 1UL, &page, NULL, &status, 0) != 0 || status < 0) {
+        return -1;
+    }
+    return status < CANON_MAX_NODES ? kernel_index[status] : -1;
+}
+
+/*
+ * Prefer node for [addr, addr+len); pages land there on first touch
+ */
+bool canon_numa_bind(void *addr, size_t len, int node) {
+    if (canon_numa_nodes() == 1) return true;
+
+    int kernel_node = node_kernel[node];
+    unsigned long mask[CANON_MAX_NODES / (8 * sizeof(unsigned long)) + 1] = {0};
+    mask[kernel_node / (8 * sizeof(unsigned long))] |= 1UL << (kernel_node % (8 * sizeof(unsigned long)));
+    return syscall(__NR_mbind, addr, len, MPOL_PREFERRED, mask,
+                   (unsigned long)(sizeof(mask) * 8), 0) == 0;
+}
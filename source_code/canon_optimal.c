@@ -16,38 +16,20 @@
  * β(Ω) = GF(2) basis of Ω
  */
 
+#define _GNU_SOURCE
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
 #include <stdbool.h>
 #include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
-#define MAX_RANK 65536  // Maximum basis size (64KB)
-#define CHUNK_SIZE 4096 // Process in 4KB chunks
-
-/*
- * GF(2) Basis Structure
- * Represents the canonical form (what survives closure)
- */
-typedef struct {
-    uint8_t *basis;           // Basis elements (size rank)
-    uint32_t rank;            // Number of linearly independent elements
-    uint32_t *derivation;     // How each position derives from basis
-    uint64_t *span_signature; // Fast span membership testing
-} GF2_Basis;
-
-/*
- * Statistics for analysis
- */
-typedef struct {
-    uint64_t input_size;
-    uint64_t basis_size;
-    uint64_t derivation_size;
-    double compression_ratio;
-    double time_seconds;
-    uint32_t rank;
-} CompressionStats;
+#include "canon.h"
 
 /*
  * Initialize GF(2) basis structure
@@ -61,13 +43,50 @@ GF2_Basis* basis_init(void) {
     return B;
 }
 
+/*
+ * Reset basis to rank 0 so the allocation can be reused
+ * Time: O(1) - clears the 256-entry signature table only
+ */
+void basis_reset(GF2_Basis *B) {
+    B->rank = 0;
+    B->input_size = 0;
+    memset(B->span_signature, 0, 256 * sizeof(uint64_t));
+}
+
+/*
+ * Shrink basis storage to its rank for long-lived, read-only bases
+ * The basis must not grow afterwards
+ */
+void basis_trim(GF2_Basis *B) {
+    uint32_t keep = B->rank ? B->rank : 1;
+    B->basis = realloc(B->basis, keep);
+    B->derivation = realloc(B->derivation, keep * sizeof(uint32_t));
+}
+
+/*
+ * Recompute span_signature from the basis elements, e.g. after loading
+ * Marks exactly what the add_to_basis() calls that built B marked
+ */
+void basis_rebuild_signature(GF2_Basis *B) {
+    memset(B->span_signature, 0, 256 * sizeof(uint64_t));
+    for (uint32_t k = 0; k < B->rank; k++) {
+        uint8_t x = B->basis[k];
+        B->span_signature[x] = 1;
+        for (uint32_t i = 0; i < k; i++) B->span_signature[B->basis[i] ^ x] = 1;
+    }
+}
+
 /*
  * Free GF(2) basis structure
  */
 void basis_free(GF2_Basis *B) {
     if (B) {
-        free(B->basis);
-        free(B->derivation);
+        if (B->mapping) {
+            munmap(B->mapping, B->mapping_len);
+        } else {
+            free(B->basis);
+            free(B->derivation);
+        }
         free(B->span_signature);
         free(B);
     }
@@ -142,6 +161,34 @@ bool add_to_basis(GF2_Basis *B, uint8_t x, uint32_t position) {
     return true;
 }
 
+/*
+ * Feed one block of input into an existing basis
+ * Time: Θ(len·r)
+ *
+ * offset is the absolute position of data[0] in the input, so the
+ * derivation map stays correct when a stream is processed in pieces.
+ * Silent: callers decide whether to report progress.
+ */
+void canon_compress_block(GF2_Basis *B, const uint8_t *data, uint64_t size,
+                          uint64_t offset) {
+    for (uint64_t i = 0; i < size; i++) {
+        // Check if data[i] is in span - O(r) per check
+        // Add to basis if independent - O(r) per addition
+        add_to_basis(B, data[i], (uint32_t)(offset + i));
+    }
+    if (size > 0 && offset + size > B->input_size) B->input_size = offset + size;
+}
+
+/*
+ * Derivations record input positions as uint32_t, so longer inputs
+ * cannot be described; reports them and returns false
+ */
+bool canon_input_fits(const char *name, uint64_t size) {
+    if (size <= CANON_MAX_INPUT) return true;
+    fprintf(stderr, "Error: %s: %lu bytes exceeds the %llu-byte input limit\n", name, size, CANON_MAX_INPUT);
+    return false;
+}
+
 /*
  * CANON OPTIMAL - The Main Algorithm
  * Time: Θ(n·r) where n = input size, r = final rank
@@ -151,40 +198,90 @@ bool add_to_basis(GF2_Basis *B, uint8_t x, uint32_t position) {
  * Derived from GF(2) algebra, not arbitrary implementation
  */
 GF2_Basis* canon_compress(const uint8_t *data, uint64_t size) {
+    uint64_t t0 = canon_metrics_now();
     GF2_Basis *B = basis_init();
 
-    // Single pass over data - O(n) iterations
-    for (uint64_t i = 0; i < size; i++) {
-        // Check if data[i] is in span - O(r) per check
-        // Add to basis if independent - O(r) per addition
-        add_to_basis(B, data[i], i);
+    // Single pass over data - O(n) iterations, in 1MB blocks
+    for (uint64_t i = 0; i < size; i += CANON_BLOCK_SIZE) {
+        uint64_t len = size - i < CANON_BLOCK_SIZE ? size - i : CANON_BLOCK_SIZE;
+        canon_compress_block(B, data + i, len, i);
 
         // Progress indicator (every 1MB)
-        if ((i & 0xFFFFF) == 0 && i > 0) {
-            printf("\rProcessed: %lu MB, Rank: %u", i >> 20, B->rank);
+        if (i + len < size) {
+            printf("\rProcessed: %lu MB, Rank: %u", (i + len) >> 20, B->rank);
             fflush(stdout);
         }
     }
     // Total: O(n) × O(r) = O(n·r)
 
     printf("\rProcessed: %lu bytes, Final Rank: %u\n", size, B->rank);
+    canon_metrics_record(METRIC_COMPRESS, canon_metrics_now() - t0, size,
+                         canon_encoded_size(B));
     return B;
 }
 
+/*
+ * Reconstruct input bytes [from, from+len) into out
+ * Time: O(r + len)
+ *
+ * Only positions recorded in the derivation map are determined by the
+ * archive; those are written to out and marked in known (len bytes,
+ * may be NULL). Everything else in out is left alone. Returns the
+ * number of determined bytes in the range.
+ */
+uint64_t canon_reconstruct(const GF2_Basis *B, uint64_t from, uint64_t len,
+                           uint8_t *out, uint8_t *known) {
+    if (known) memset(known, 0, len);
+    uint64_t n = 0;
+    for (uint32_t k = 0; k < B->rank; k++) {
+        uint64_t pos = B->derivation[k];
+        if (pos < from || pos - from >= len) continue;
+        out[pos - from] = B->basis[k];
+        if (known) known[pos - from] = 1;
+        n++;
+    }
+    return n;
+}
+
+/*
+ * Input length the archive describes: its size trailer, or else up to
+ * the last recorded position
+ */
+uint64_t canon_reconstructed_size(const GF2_Basis *B) {
+    if (B->input_size) return B->input_size;
+    uint64_t n = 0;
+    for (uint32_t k = 0; k < B->rank; k++) {
+        if (B->derivation[k] + 1ull > n) n = B->derivation[k] + 1ull;
+    }
+    return n;
+}
+
 /*
  * Decompress: reconstruct original data from basis
- * Time: Θ(n·r)
+ * Time: Θ(n + r)
  *
- * Note: This is reading the closure, not "decompression"
+ * When the derivation map determines every input byte the output is
+ * the input. Otherwise it is the closure (the basis bytes), as the
+ * rest of the input cannot be recovered from the archive; callers tell
+ * the two apart by comparing *output_size with the input size.
  */
 uint8_t* canon_decompress(GF2_Basis *B, uint64_t *output_size) {
-    // For full implementation, would reconstruct using derivation map
-    // For now, just return basis
-    *output_size = B->rank;
+    uint64_t t0 = canon_metrics_now();
 
-    uint8_t *output = malloc(B->rank);
-    memcpy(output, B->basis, B->rank);
+    uint64_t n = canon_reconstructed_size(B);
+    uint8_t *output = n ? calloc(n, 1) : NULL;
+    if (output && canon_reconstruct(B, 0, n, output, NULL) == n) {
+        *output_size = n;
+    } else {
+        // Reading the closure, not "decompression"
+        free(output);
+        *output_size = B->rank;
+        output = malloc(B->rank ? B->rank : 1);
+        memcpy(output, B->basis, B->rank);
+    }
 
+    canon_metrics_record(METRIC_DECOMPRESS, canon_metrics_now() - t0,
+                         canon_encoded_size(B), *output_size);
     return output;
 }
 
@@ -237,61 +334,274 @@ void print_stats(CompressionStats stats) {
     printf("═══════════════════════════════════════════════════════\n\n");
 }
 
+static uint64_t align_section(uint64_t x) {
+    return (x + CANON_ALIGN - 1) & ~(uint64_t)(CANON_ALIGN - 1);
+}
+
+/*
+ * Header for a basis of the given rank: section offsets and sizes
+ */
+static void header_layout(CanonHeader *h, uint32_t rank, uint64_t input_size) {
+    memset(h, 0, sizeof(*h));
+    memcpy(h->magic, CANON_V2_MAGIC, 4);
+    h->version = CANON_VERSION;
+    h->width = 8;
+    h->flags = input_size ? CANON_FLAG_INPUT_SIZE : 0;
+    h->rank = rank;
+    h->input_size = input_size;
+    h->basis_offset = sizeof(CanonHeader);
+    h->derivation_offset = align_section(h->basis_offset + rank);
+    h->checksum_offset = align_section(h->derivation_offset + (uint64_t)rank * sizeof(uint32_t));
+    h->crc_block = CANON_CRC_BLOCK;
+    h->crc_count = canon_crc_blocks(h->checksum_offset);
+}
+
+/*
+ * Size of the serialized form: header + basis + derivation map + checksum
+ * table, each section aligned
+ */
+uint64_t canon_encoded_size(const GF2_Basis *B) {
+    CanonHeader h;
+    header_layout(&h, B->rank, B->input_size);
+    return h.checksum_offset + (uint64_t)h.crc_count * sizeof(uint32_t);
+}
+
+/*
+ * Serialize basis into out (canon_encoded_size(B) bytes)
+ * Returns number of bytes written
+ */
+uint64_t canon_encode(const GF2_Basis *B, uint8_t *out) {
+    CanonHeader h;
+    header_layout(&h, B->rank, B->input_size);
+    uint64_t len = h.checksum_offset + (uint64_t)h.crc_count * sizeof(uint32_t);
+
+    // Padding between sections is zero, so the checksums are deterministic
+    memset(out, 0, h.checksum_offset);
+    memcpy(out, &h, sizeof(h));
+    memcpy(out + h.basis_offset, B->basis, B->rank);
+    memcpy(out + h.derivation_offset, B->derivation, B->rank * sizeof(uint32_t));
+    uint32_t *sums = malloc(h.crc_count * sizeof(uint32_t));   // out may be unaligned
+    canon_crc_sign(out, h.checksum_offset, sums);
+    memcpy(out + h.checksum_offset, sums, h.crc_count * sizeof(uint32_t));
+    free(sums);
+    return len;
+}
+
+/*
+ * Check len bytes of data against their checksum table
+ */
+static bool verify_checksums(const uint8_t *in, uint64_t len, const uint32_t *sums,
+                             const char *name) {
+    int64_t bad = canon_crc_verify(in, len, sums);
+    if (bad < 0) return true;
+    uint64_t at = (uint64_t)bad * CANON_CRC_BLOCK;
+    uint64_t end = at + CANON_CRC_BLOCK < len ? at + CANON_CRC_BLOCK : len;
+    fprintf(stderr, "Error: %s: checksum mismatch in block %ld (bytes %lu-%lu)\n",
+            name, bad, at, end - 1);
+    return false;
+}
+
+/*
+ * Validate a version 2 image: header, section bounds and checksums
+ */
+static bool check_v2(const uint8_t *in, uint64_t len, const char *name, CanonHeader *h) {
+    const char *why = NULL;
+    memcpy(h, in, sizeof(*h));
+    if (h->version != CANON_VERSION) {
+        why = "unsupported format version";
+    } else if (h->width != 8 || (h->flags & ~CANON_FLAG_INPUT_SIZE)) {
+        why = "unsupported element width or flags";
+    } else {
+        CanonHeader expect;
+        header_layout(&expect, h->rank, h->input_size);
+        if (h->rank > MAX_RANK || h->basis_offset != expect.basis_offset ||
+            h->derivation_offset != expect.derivation_offset ||
+            h->checksum_offset != expect.checksum_offset || h->crc_block != CANON_CRC_BLOCK ||
+            h->crc_count != expect.crc_count ||
+            len != h->checksum_offset + (uint64_t)h->crc_count * sizeof(uint32_t)) {
+            why = "truncated or corrupt header";
+        }
+    }
+    if (why) {
+        fprintf(stderr, "Error: %s: %s\n", name, why);
+        return false;
+    }
+    return verify_checksums(in, h->checksum_offset, (const uint32_t *)(in + h->checksum_offset),
+                            name);
+}
+
+/*
+ * Parse a version 1 file: optional size and checksum trailers
+ * Files without the checksums are accepted when their length is exact
+ */
+static GF2_Basis* decode_v1(const uint8_t *in, uint64_t len, const char *name) {
+    uint32_t rank;
+    memcpy(&rank, in + 5, sizeof(uint32_t));
+    uint64_t body = 5 + sizeof(uint32_t) + rank + (uint64_t)rank * sizeof(uint32_t);
+    if (rank > MAX_RANK || body > len) {
+        fprintf(stderr, "Error: %s is truncated or corrupt (rank %u, %lu bytes)\n", name, rank, len);
+        return NULL;
+    }
+
+    // Optional trailers: size, then checksums over everything before them
+    uint64_t input_size = 0, covered = body;
+    if (len >= body + 12 && memcmp(in + body, CANON_SIZE_MAGIC, 4) == 0) {
+        memcpy(&input_size, in + body + 4, sizeof(uint64_t));
+        covered = body + 12;
+    }
+    if (len >= covered + 12 && memcmp(in + covered, CANON_CRC_MAGIC, 4) == 0) {
+        uint32_t block, count;
+        memcpy(&block, in + covered + 4, sizeof(uint32_t));
+        memcpy(&count, in + covered + 8, sizeof(uint32_t));
+        if (block != CANON_CRC_BLOCK || count != canon_crc_blocks(covered) ||
+            len != covered + 12 + (uint64_t)count * sizeof(uint32_t)) {
+            fprintf(stderr, "Error: %s: corrupt checksum table\n", name);
+            return NULL;
+        }
+        uint32_t *sums = malloc(count * sizeof(uint32_t));
+        memcpy(sums, in + covered + 12, count * sizeof(uint32_t));
+        bool ok = verify_checksums(in, covered, sums, name);
+        free(sums);
+        if (!ok) return NULL;
+    } else if (len != covered) {
+        fprintf(stderr, "Error: %s is truncated or corrupt (%lu bytes, expected %lu)\n",
+                name, len, covered);
+        return NULL;
+    }
+
+    GF2_Basis *B = basis_init();
+    B->rank = rank;
+    B->input_size = input_size;
+    memcpy(B->basis, in + 5 + sizeof(uint32_t), rank);
+    memcpy(B->derivation, in + 5 + sizeof(uint32_t) + rank, rank * sizeof(uint32_t));
+    return B;
+}
+
+/*
+ * Parse a serialized basis (version 2, or version 1), checking its
+ * checksums first. in must be 4-byte aligned. Returns NULL and reports
+ * what is wrong with name otherwise.
+ */
+GF2_Basis* canon_decode(const uint8_t *in, uint64_t len, const char *name) {
+    if (len >= sizeof(CanonHeader) && memcmp(in, CANON_V2_MAGIC, 4) == 0) {
+        CanonHeader h;
+        if (!check_v2(in, len, name, &h)) return NULL;
+        GF2_Basis *B = basis_init();
+        B->rank = h.rank;
+        B->input_size = h.input_size;
+        memcpy(B->basis, in + h.basis_offset, h.rank);
+        memcpy(B->derivation, in + h.derivation_offset, h.rank * sizeof(uint32_t));
+        return B;
+    }
+    if (len >= 5 + sizeof(uint32_t) && memcmp(in, "CANON", 5) == 0) {
+        return decode_v1(in, len, name);
+    }
+    fprintf(stderr, "Error: %s: Not a CANON compressed file\n", name);
+    return NULL;
+}
+
 /*
  * Save compressed data to file
  */
 bool save_compressed(const char *filename, GF2_Basis *B) {
+    uint64_t t0 = canon_metrics_now();
     FILE *f = fopen(filename, "wb");
     if (!f) {
         perror("Error opening output file");
         return false;
     }
 
-    // Write header
-    fwrite("CANON", 1, 5, f);
-    fwrite(&B->rank, sizeof(uint32_t), 1, f);
-
-    // Write basis
-    fwrite(B->basis, 1, B->rank, f);
+    uint64_t len = canon_encoded_size(B);
+    uint8_t *buf = malloc(len);
+    if (!buf) {
+        fprintf(stderr, "Error: Out of memory\n");
+        fclose(f);
+        return false;
+    }
+    canon_encode(B, buf);
 
-    // Write derivation map
-    fwrite(B->derivation, sizeof(uint32_t), B->rank, f);
+    bool ok = fwrite(buf, 1, len, f) == len;
+    free(buf);
 
-    fclose(f);
-    return true;
+    if (fclose(f) != 0) ok = false;
+    if (!ok) perror("Error writing output file");
+    if (ok) canon_metrics_record(METRIC_SAVE, canon_metrics_now() - t0, 0, len);
+    return ok;
 }
 
 /*
  * Load compressed data from file
+ * The whole file is read and checksummed before anything is decoded
  */
 GF2_Basis* load_compressed(const char *filename) {
+    uint64_t t0 = canon_metrics_now();
     FILE *f = fopen(filename, "rb");
     if (!f) {
         perror("Error opening input file");
         return NULL;
     }
 
-    // Verify header
-    char header[6] = {0};
-    fread(header, 1, 5, f);
-    if (strcmp(header, "CANON") != 0) {
-        fprintf(stderr, "Error: Not a CANON compressed file\n");
-        fclose(f);
+    struct stat st;
+    uint8_t *buf = NULL;
+    uint64_t len = 0;
+    if (fstat(fileno(f), &st) == 0) {
+        len = (uint64_t)st.st_size;
+        buf = malloc(len ? len : 1);
+    }
+    bool ok = buf && fread(buf, 1, len, f) == len;
+    fclose(f);
+    if (!ok) {
+        perror("Error reading input file");
+        free(buf);
         return NULL;
     }
 
-    GF2_Basis *B = basis_init();
-
-    // Read rank
-    fread(&B->rank, sizeof(uint32_t), 1, f);
-
-    // Read basis
-    fread(B->basis, 1, B->rank, f);
+    GF2_Basis *B = canon_decode(buf, len, filename);
+    free(buf);
+    if (B) canon_metrics_record(METRIC_LOAD, canon_metrics_now() - t0, len, 0);
+    return B;
+}
 
-    // Read derivation map
-    fread(B->derivation, sizeof(uint32_t), B->rank, f);
+/*
+ * Map a compressed file and use its sections in place
+ * Time: O(file) for the checksums; nothing is copied or parsed
+ *
+ * The basis and derivation map point into a read-only mapping, so the
+ * result must not be extended (span_signature is left empty); release
+ * it with basis_free() as usual. Version 1 files are loaded instead.
+ */
+GF2_Basis* canon_map_compressed(const char *filename) {
+    uint64_t t0 = canon_metrics_now();
+    int fd = open(filename, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        perror("Error opening input file");
+        if (fd >= 0) close(fd);
+        return NULL;
+    }
+    uint64_t len = (uint64_t)st.st_size;
+    void *map = len >= sizeof(CanonHeader) ? mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0)
+                                           : MAP_FAILED;
+    close(fd);
+    if (map == MAP_FAILED || memcmp(map, CANON_V2_MAGIC, 4) != 0) {
+        if (map != MAP_FAILED) munmap(map, len);
+        return load_compressed(filename);
+    }
 
-    fclose(f);
+    CanonHeader h;
+    if (!check_v2(map, len, filename, &h)) {
+        munmap(map, len);
+        return NULL;
+    }
+    GF2_Basis *B = calloc(1, sizeof(GF2_Basis));
+    B->basis = (uint8_t *)map + h.basis_offset;
+    B->derivation = (uint32_t *)((uint8_t *)map + h.derivation_offset);
+    B->span_signature = calloc(256, sizeof(uint64_t));
+    B->rank = h.rank;
+    B->input_size = h.input_size;
+    B->mapping = map;
+    B->mapping_len = len;
+    canon_metrics_record(METRIC_LOAD, canon_metrics_now() - t0, len, 0);
     return B;
 }
 
@@ -326,6 +636,9 @@ uint8_t* read_file(const char *filename, uint64_t *size) {
  * Main entry point
  */
 int main(int argc, char **argv) {
+    canon_metrics_init();
+    canon_trace_init();
+
     printf("═══════════════════════════════════════════════════════\n");
     printf("  CANON - Universal Canonicalization (Optimal Θ(n·r))\n");
     printf("  Francesco Pedulli, 2026\n");
@@ -333,8 +646,31 @@ int main(int argc, char **argv) {
 
     if (argc < 3) {
         printf("Usage:\n");
-        printf("  Compress:   %s compress <input> [output]\n", argv[0]);
+        printf("  Compress:   %s compress <input> [output] [--blocks N] [--read-workers N]\n", argv[0]);
+        printf("                     [--pipeline-report] [--direct [--buffers 2|3]]\n");
+        printf("                     [--hugepages off|thp|hugetlb]\n");
+        printf("                     [--checkpoint-every BYTES] [--resume]\n");
+        printf("                     [--cache DIR [--cache-size BYTES]]\n");
         printf("  Decompress: %s decompress <input> [output]\n", argv[0]);
+        printf("  Verify:     %s verify <archive.canon> <original> [--threads N] [--block BYTES]\n", argv[0]);
+        printf("  Append:     %s append <archive.canon> <input> [--from OFFSET]\n", argv[0]);
+        printf("  Daemon:     %s serve <socket> [--threads N]\n", argv[0]);
+        printf("  Request:    %s request <socket> <compress|estimate> <input> [output]\n", argv[0]);
+        printf("  Ring:       %s ring <socket> [--slots N] [--slot-size BYTES] [--threads N]\n", argv[0]);
+        printf("  Ring feed:  %s ring-submit <socket> <input>...\n", argv[0]);
+        printf("  Batch:      %s batch-lines <input> [--max-batch N] [--max-delay-us US] [--check]\n", argv[0]);
+        printf("  Replay:     %s replay <trace> [--speed X] [--concurrency N] [--sample FILE]\n", argv[0]);
+        printf("                     [--binary PATH | --socket PATH]\n");
+        printf("  Queue:      %s queue <joblist|-> [--threads N] [--block BYTES] [--aging-ms MS]\n", argv[0]);
+        printf("  Many files: %s compress-many <input>... [--threads N] [--chunk BYTES] [--split]\n", argv[0]);
+        printf("                     [--io mmap|uring|threads] [--queue-depth N] [--pin]\n");
+        printf("                     [--hugepages off|thp|hugetlb] [--cache DIR [--cache-size BYTES]]\n");
+        printf("  Tree:       %s compress-dir <dir> | --files-from LIST [--out-dir DIR] [--corpus FILE]\n", argv[0]);
+        printf("  Archive:    %s pack <archive> <input>... [--corpus] [compress-many options]\n", argv[0]);
+        printf("              %s unpack <archive> [member...] [--out-dir DIR] [--threads N]\n", argv[0]);
+        printf("              %s list <archive>\n", argv[0]);
+        printf("  Matrix:     %s matrix <rank|rref|pluq|mul> <rows> [cols [width]] [--rank R] [--k K]\n", argv[0]);
+        printf("                     [--cutoff C] [--seed S] [--threads N] [--check]\n");
         printf("\n");
         printf("Complexity: Θ(n·r) where n=size, r=rank\n");
         printf("  - Highly compressible: r << n → Θ(n) linear\n");
@@ -346,21 +682,98 @@ int main(int argc, char **argv) {
     if (strcmp(argv[1], "compress") == 0) {
         // Compress mode
         const char *input_file = argv[2];
-        const char *output_file = (argc > 3) ? argv[3] : "output.canon";
+        const char *output_file = "output.canon";
+        bool direct = false, report = false;
+        uint32_t buffers = 3;
+        const char *cache_dir = NULL;
+        uint64_t cache_size = 0;
+        CanonPipelineConfig pcfg = { 8, 1, { NULL, 0, false } };
+        for (int i = 3; i < argc; i++) {
+            if (strcmp(argv[i], "--direct") == 0) {
+                direct = true;
+            } else if (strcmp(argv[i], "--buffers") == 0 && i + 1 < argc) {
+                buffers = (uint32_t)strtoul(argv[++i], NULL, 10);
+            } else if (strcmp(argv[i], "--blocks") == 0 && i + 1 < argc) {
+                pcfg.blocks = (uint32_t)strtoul(argv[++i], NULL, 10);
+            } else if (strcmp(argv[i], "--read-workers") == 0 && i + 1 < argc) {
+                pcfg.read_workers = (int)strtol(argv[++i], NULL, 10);
+            } else if (strcmp(argv[i], "--pipeline-report") == 0) {
+                report = true;
+            } else if (strcmp(argv[i], "--hugepages") == 0 && i + 1 < argc) {
+                if (!canon_huge_option(argv[++i])) return 1;
+            } else if (strcmp(argv[i], "--checkpoint-every") == 0 && i + 1 < argc) {
+                pcfg.checkpoint.every = strtoull(argv[++i], NULL, 10);
+            } else if (strcmp(argv[i], "--resume") == 0) {
+                pcfg.checkpoint.resume = true;
+            } else if (strcmp(argv[i], "--cache") == 0 && i + 1 < argc) {
+                cache_dir = argv[++i];
+            } else if (strcmp(argv[i], "--cache-size") == 0 && i + 1 < argc) {
+                cache_size = strtoull(argv[++i], NULL, 10);
+            } else {
+                output_file = argv[i];
+            }
+        }
+
+        // Sidecar next to the output, on by either option
+        char *ckpt_path = NULL;
+        if (pcfg.checkpoint.every || pcfg.checkpoint.resume) {
+            size_t len = strlen(output_file) + 6;
+            ckpt_path = malloc(len);
+            snprintf(ckpt_path, len, "%s.ckpt", output_file);
+            pcfg.checkpoint.path = ckpt_path;
+            if (!pcfg.checkpoint.every) pcfg.checkpoint.every = CANON_CHECKPOINT_EVERY;
+        }
 
         printf("Compressing: %s\n", input_file);
         printf("Output: %s\n\n", output_file);
 
-        // Read input
-        uint64_t size;
-        uint8_t *data = read_file(input_file, &size);
-        if (!data) return 1;
+        uint64_t trace_start = canon_trace_clock();
+        uint64_t t_begin = canon_metrics_now();
+
+        // Input is streamed by the pipeline (or the direct reader)
+        struct stat st;
+        if (stat(input_file, &st) != 0) {
+            perror("Error opening file");
+            free(ckpt_path);
+            return 1;
+        }
+        uint64_t size = (uint64_t)st.st_size;
+        if (!canon_input_fits(input_file, size)) {
+            free(ckpt_path);
+            return 1;
+        }
 
         printf("Input size: %lu bytes (%.2f MB)\n\n", size, size / 1048576.0);
 
-        // Compress
+        // Compress: read -> eliminate -> encode -> write overlap
         clock_t start = clock();
-        GF2_Basis *basis = canon_compress(data, size);
+        uint64_t t_compute = canon_metrics_now();
+        CanonPipeline *pipeline = NULL;
+        GF2_Basis *basis = NULL;
+        bool saved = false, cached = false;
+
+        // Same content seen before: load its basis instead
+        CanonCache *cache = cache_dir ? canon_cache_open(cache_dir, cache_size) : NULL;
+        uint64_t hash = 0, hashed_size = 0;
+        if (cache && canon_cache_hash_file(input_file, &hash, &hashed_size)) {
+            basis = canon_cache_get(cache, hash, hashed_size);
+            cached = basis != NULL;
+        }
+        if (cached) {
+            printf("Cache hit: %016lx-%lu\n", hash, hashed_size);
+        } else if (direct) {
+            basis = canon_compress_direct(input_file, buffers, &pcfg.checkpoint);
+        } else {
+            pipeline = canon_pipeline_create(&pcfg);
+            basis = canon_pipeline_run(pipeline, input_file, output_file, &saved);
+        }
+        if (!basis) {
+            if (pipeline) canon_pipeline_destroy(pipeline);
+            if (cache) canon_cache_close(cache);
+            free(ckpt_path);
+            return 1;
+        }
+        t_compute = canon_metrics_now() - t_compute;
         clock_t end = clock();
 
         double time_sec = (double)(end - start) / CLOCKS_PER_SEC;
@@ -368,15 +781,33 @@ int main(int argc, char **argv) {
         // Statistics
         CompressionStats stats = compute_stats(size, basis, time_sec);
         print_stats(stats);
+        if (report && pipeline) {
+            canon_pipeline_report(pipeline, stdout);
+        } else if (report) {
+            printf("Pipeline stages: not used (%s)\n", cached ? "cache hit" : "--direct");
+        }
 
-        // Save
-        if (save_compressed(output_file, basis)) {
+        // Save (already written by the pipeline's write stage)
+        if (direct || cached) saved = save_compressed(output_file, basis);
+        if (cache && !cached && hashed_size == size && basis->input_size == size) {
+            canon_cache_put(cache, hash, size, basis);
+        }
+        if (saved) {
             printf("✓ Compressed file saved: %s\n", output_file);
+            canon_checkpoint_finish(&pcfg.checkpoint);
         }
+        canon_trace_record(METRIC_COMPRESS, trace_start, size, canon_encoded_size(basis),
+                           basis->rank, t_compute, canon_metrics_now() - t_begin);
 
         // Cleanup
-        free(data);
         basis_free(basis);
+        if (pipeline) canon_pipeline_destroy(pipeline);
+        canon_huge_report(stdout);
+        if (cache) {
+            canon_cache_report(cache, stdout);
+            canon_cache_close(cache);
+        }
+        free(ckpt_path);
 
     } else if (strcmp(argv[1], "decompress") == 0) {
         // Decompress mode
@@ -386,15 +817,24 @@ int main(int argc, char **argv) {
         printf("Decompressing: %s\n", input_file);
         printf("Output: %s\n\n", output_file);
 
-        // Load compressed
-        GF2_Basis *basis = load_compressed(input_file);
+        uint64_t trace_start = canon_trace_clock();
+        uint64_t t_begin = canon_metrics_now();
+
+        // Map compressed; sections are used in place
+        GF2_Basis *basis = canon_map_compressed(input_file);
         if (!basis) return 1;
 
         printf("Rank: %u\n", basis->rank);
 
         // Decompress
         uint64_t output_size;
+        uint64_t t_compute = canon_metrics_now();
         uint8_t *output = canon_decompress(basis, &output_size);
+        t_compute = canon_metrics_now() - t_compute;
+        if (output_size != canon_reconstructed_size(basis)) {
+            printf("Note: the archive does not determine every input byte; "
+                   "writing its basis (the closure) instead\n");
+        }
 
         // Save
         FILE *f = fopen(output_file, "wb");
@@ -403,11 +843,59 @@ int main(int argc, char **argv) {
             fclose(f);
             printf("✓ Decompressed file saved: %s\n", output_file);
         }
+        canon_trace_record(METRIC_DECOMPRESS, trace_start, canon_encoded_size(basis),
+                           output_size, basis->rank, t_compute,
+                           canon_metrics_now() - t_begin);
 
         // Cleanup
         free(output);
         basis_free(basis);
 
+    } else if (strcmp(argv[1], "verify") == 0) {
+        return canon_verify_main(argc - 1, argv + 1);
+
+    } else if (strcmp(argv[1], "append") == 0) {
+        return canon_append_main(argc - 1, argv + 1);
+
+    } else if (strcmp(argv[1], "serve") == 0) {
+        return canon_serve_main(argc - 1, argv + 1);
+
+    } else if (strcmp(argv[1], "request") == 0) {
+        return canon_request_main(argc - 1, argv + 1);
+
+    } else if (strcmp(argv[1], "ring") == 0) {
+        return canon_ring_main(argc - 1, argv + 1);
+
+    } else if (strcmp(argv[1], "ring-submit") == 0) {
+        return canon_ring_submit_main(argc - 1, argv + 1);
+
+    } else if (strcmp(argv[1], "batch-lines") == 0) {
+        return canon_batch_lines_main(argc - 1, argv + 1);
+
+    } else if (strcmp(argv[1], "replay") == 0) {
+        return canon_replay_main(argc - 1, argv + 1);
+
+    } else if (strcmp(argv[1], "queue") == 0) {
+        return canon_queue_main(argc - 1, argv + 1);
+
+    } else if (strcmp(argv[1], "compress-many") == 0) {
+        return canon_compress_many_main(argc - 1, argv + 1);
+
+    } else if (strcmp(argv[1], "compress-dir") == 0) {
+        return canon_compress_dir_main(argc - 1, argv + 1);
+
+    } else if (strcmp(argv[1], "pack") == 0) {
+        return canon_pack_main(argc - 1, argv + 1);
+
+    } else if (strcmp(argv[1], "unpack") == 0) {
+        return canon_unpack_main(argc - 1, argv + 1);
+
+    } else if (strcmp(argv[1], "list") == 0) {
+        return canon_list_main(argc - 1, argv + 1);
+
+    } else if (strcmp(argv[1], "matrix") == 0) {
+        return canon_matrix_main(argc - 1, argv + 1);
+
     } else {
         fprintf(stderr, "Error: Unknown command '%s'\n", argv[1]);
         return 1;
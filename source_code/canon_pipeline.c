@@ -0,0 +1,553 @@
+/*
+ * CANON - Staged compression pipeline
+ *
+ * Author: Francesco Pedulli
+ * Date: February 26, 2026
+ *
+ * `canon compress` runs as a pipeline of stages connected by bounded
+ * lock-free MPMC queues of block buffers:
+ *
+ *   read (N) -> transform... (N each) -> eliminate (1) -> encode (1) -> write (1)
+ *
+ * A fixed pool of 1 MB blocks is the only memory: readers take a free
+ * block before claiming the next file offset, so the run never holds
+ * more than --blocks of input (backpressure). Elimination is inherently
+ * sequential, so it has one worker and a small reorder window for blocks
+ * that overtake each other in parallel stages. Transform stages are
+ * inserted with canon_pipeline_add_transform(); each gets its own
+ * queue and workers and never serializes the others.
+ *
+ * With a checkpoint config the eliminate stage saves its state every
+ * `every` input bytes, and a resumed run starts reading at the
+ * checkpointed offset (canon_checkpoint.c).
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "canon.h"
+
+#define PIPE_MAX_STAGES 16
+#define PIPE_ALIGN 64
+
+/*
+ * Bounded MPMC queue of pointers (Vyukov), same scheme as the ring
+ */
+typedef struct {
+    _Atomic uint64_t seq;
+    void *value;
+} PipeCell;
+
+typedef struct {
+    _Alignas(PIPE_ALIGN) _Atomic uint64_t enqueue_pos;
+    _Alignas(PIPE_ALIGN) _Atomic uint64_t dequeue_pos;
+    _Alignas(PIPE_ALIGN) atomic_int producers;   // Open until this reaches 0
+    uint64_t mask;
+    PipeCell *cells;
+} PipeQueue;
+
+typedef struct {
+    uint64_t seq;
+    uint64_t offset;        // In the input file
+    uint64_t len;
+    uint8_t *data;
+} PipeBlock;
+
+typedef struct {
+    uint8_t *data;
+    uint64_t len;
+    uint64_t t0;
+} PipeOutput;
+
+typedef enum { STAGE_READ, STAGE_TRANSFORM, STAGE_ELIMINATE, STAGE_ENCODE, STAGE_WRITE } StageKind;
+
+typedef struct {
+    CanonPipeline *p;
+    StageKind kind;
+    const char *name;
+    int workers;
+    CanonTransformFn fn;
+    void *user;
+    PipeQueue *in, *out;
+    atomic_uint_fast64_t items;
+    atomic_uint_fast64_t busy_ns;
+    atomic_uint_fast64_t stall_ns;  // Waiting on a full or empty queue
+} PipeStage;
+
+typedef struct {
+    const char *name;
+    CanonTransformFn fn;
+    void *user;
+    int workers;
+} PipeTransform;
+
+struct CanonPipeline {
+    CanonPipelineConfig cfg;
+    PipeTransform transforms[PIPE_MAX_STAGES - 4];
+    int ntransforms;
+    PipeStage stages[PIPE_MAX_STAGES];  // Built per run, kept for the report
+    int nstages;
+    PipeQueue free_q;
+
+    // Per run
+    int fd;
+    uint64_t size;
+    const char *output;
+    atomic_uint_fast64_t next_seq;
+    atomic_bool failed;
+    GF2_Basis *basis;
+    bool saved;
+    CanonCheckpoint ckpt;   // Eliminate stage only once running
+    GF2_Basis *start;       // Basis to continue (fresh or resumed)
+    uint64_t first;         // Input offset it covers
+    PipeBlock *blocks;
+    uint8_t *arena;
+};
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void pipe_backoff(uint32_t *idle) {
+    uint32_t n = (*idle)++;
+    if (n < 256) {
+        // Spin
+    } else if (n < 512) {
+        sched_yield();
+    } else {
+        struct timespec ts = { 0, 50000 };
+        nanosleep(&ts, NULL);
+    }
+}
+
+static void queue_init(PipeQueue *q, uint32_t capacity, int producers) {
+    uint32_t cap = 2;
+    while (cap < capacity) cap <<= 1;
+    q->cells = malloc(cap * sizeof(PipeCell));
+    for (uint64_t i = 0; i < cap; i++) atomic_init(&q->cells[i].seq, i);
+    atomic_init(&q->enqueue_pos, 0);
+    atomic_init(&q->dequeue_pos, 0);
+    atomic_init(&q->producers, producers);
+    q->mask = cap - 1;
+}
+
+static bool queue_try_push(PipeQueue *q, void *value) {
+    uint64_t pos = atomic_load_explicit(&q->enqueue_pos, memory_order_relaxed);
+    for (;;) {
+        PipeCell *c = &q->cells[pos & q->mask];
+        uint64_t seq = atomic_load_explicit(&c->seq, memory_order_acquire);
+        int64_t diff = (int64_t)seq - (int64_t)pos;
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&q->enqueue_pos, &pos, pos + 1,
+                                                      memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                c->value = value;
+                atomic_store_explicit(&c->seq, pos + 1, memory_order_release);
+                return true;
+            }
+        } else if (diff < 0) {
+            return false;  // Full
+        } else {
+            pos = atomic_load_explicit(&q->enqueue_pos, memory_order_relaxed);
+        }
+    }
+}
+
+static bool queue_try_pop(PipeQueue *q, void **value) {
+    uint64_t pos = atomic_load_explicit(&q->dequeue_pos, memory_order_relaxed);
+    for (;;) {
+        PipeCell *c = &q->cells[pos & q->mask];
+        uint64_t seq = atomic_load_explicit(&c->seq, memory_order_acquire);
+        int64_t diff = (int64_t)seq - (int64_t)(pos + 1);
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&q->dequeue_pos, &pos, pos + 1,
+                                                      memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                *value = c->value;
+                atomic_store_explicit(&c->seq, pos + q->mask + 1, memory_order_release);
+                return true;
+            }
+        } else if (diff < 0) {
+            return false;  // Empty
+        } else {
+            pos = atomic_load_explicit(&q->dequeue_pos, memory_order_relaxed);
+        }
+    }
+}
+
+/*
+ * Blocking push: backpressure from a slow downstream stage lands here
+ */
+static void queue_push(PipeStage *s, PipeQueue *q, void *value) {
+    uint32_t idle = 0;
+    uint64_t t0 = 0;
+    while (!queue_try_push(q, value)) {
+        if (idle == 0) t0 = now_ns();
+        pipe_backoff(&idle);
+    }
+    if (idle) atomic_fetch_add(&s->stall_ns, now_ns() - t0);
+}
+
+/*
+ * Blocking pop: NULL once the queue is empty and all producers closed
+ */
+static void* queue_pop(PipeStage *s, PipeQueue *q) {
+    uint32_t idle = 0;
+    uint64_t t0 = 0;
+    void *value = NULL;
+    while (!queue_try_pop(q, &value)) {
+        if (atomic_load(&q->producers) == 0) {
+            // Producers close after their last push; one more look
+            if (!queue_try_pop(q, &value)) value = NULL;
+            break;
+        }
+        if (idle == 0) t0 = now_ns();
+        pipe_backoff(&idle);
+    }
+    if (idle && s) atomic_fetch_add(&s->stall_ns, now_ns() - t0);
+    return value;
+}
+
+static void queue_close(PipeQueue *q) {
+    atomic_fetch_sub(&q->producers, 1);
+}
+
+/*
+ * Blocking pop of a free block for a reader; NULL once the run has
+ * failed, as blocks held by a stage without workers never come back
+ */
+static PipeBlock* free_block(PipeStage *s) {
+    CanonPipeline *p = s->p;
+    uint32_t idle = 0;
+    uint64_t t0 = 0;
+    void *value = NULL;
+    while (!queue_try_pop(&p->free_q, &value)) {
+        if (atomic_load(&p->failed)) {
+            value = NULL;
+            break;
+        }
+        if (idle == 0) t0 = now_ns();
+        pipe_backoff(&idle);
+    }
+    if (idle) atomic_fetch_add(&s->stall_ns, now_ns() - t0);
+    return value;
+}
+
+/* ---- Stages ---- */
+
+static void stage_read(PipeStage *s) {
+    CanonPipeline *p = s->p;
+    uint64_t block = CANON_BLOCK_SIZE;
+
+    for (;;) {
+        // Buffer first, then offset: every claimed offset has a buffer
+        PipeBlock *b = free_block(s);
+        if (!b) break;
+        uint64_t seq = atomic_fetch_add(&p->next_seq, 1);
+        uint64_t offset = p->first + seq * block;
+        if (offset >= p->size || atomic_load(&p->failed)) {
+            queue_push(s, &p->free_q, b);
+            break;
+        }
+
+        uint64_t t0 = now_ns();
+        uint64_t want = p->size - offset < block ? p->size - offset : block;
+        uint64_t got = 0;
+        while (got < want) {
+            ssize_t k = pread(p->fd, b->data + got, want - got, offset + got);
+            if (k < 0 && errno == EINTR) continue;
+            if (k <= 0) break;
+            got += (uint64_t)k;
+        }
+        if (got < want) {
+            perror("Error reading input file");
+            atomic_store(&p->failed, true);
+        }
+        b->seq = seq;
+        b->offset = offset;
+        b->len = got;
+        atomic_fetch_add(&s->busy_ns, now_ns() - t0);
+        atomic_fetch_add(&s->items, 1);
+        queue_push(s, s->out, b);
+    }
+}
+
+static void stage_transform(PipeStage *s) {
+    PipeBlock *b;
+    while ((b = queue_pop(s, s->in))) {
+        uint64_t t0 = now_ns();
+        if (!s->fn(b->data, &b->len, CANON_BLOCK_SIZE, s->user)) {
+            fprintf(stderr, "Error: Transform '%s' failed at offset %lu\n", s->name, b->offset);
+            atomic_store(&s->p->failed, true);
+        }
+        atomic_fetch_add(&s->busy_ns, now_ns() - t0);
+        atomic_fetch_add(&s->items, 1);
+        queue_push(s, s->out, b);
+    }
+}
+
+static void stage_eliminate(PipeStage *s) {
+    CanonPipeline *p = s->p;
+    uint32_t window = p->cfg.blocks;
+    PipeBlock **pending = calloc(window, sizeof(PipeBlock *));
+    uint64_t next = 0, position = p->ckpt.position;
+    GF2_Basis *B = p->start;
+    uint64_t t_begin = canon_metrics_now();
+
+    PipeBlock *b;
+    while ((b = queue_pop(s, s->in))) {
+        // Reorder: at most `window` blocks exist, so seq % window is free
+        pending[b->seq % window] = b;
+        while ((b = pending[next % window]) && b->seq == next) {
+            pending[next % window] = NULL;
+            uint64_t t0 = now_ns();
+            // Positions follow the (possibly transformed) stream
+            canon_compress_block(B, b->data, b->len, position);
+            position += b->len;
+            next++;
+            atomic_fetch_add(&s->busy_ns, now_ns() - t0);
+            atomic_fetch_add(&s->items, 1);
+            uint64_t done = b->offset + CANON_BLOCK_SIZE;
+            queue_push(s, &p->free_q, b);
+
+            // Input before `done` is now part of B
+            if (!atomic_load(&p->failed)) {
+                canon_checkpoint_update(&p->cfg.checkpoint, p->fd, B, &p->ckpt,
+                                        done < p->size ? done : p->size, position);
+            }
+
+            // Progress indicator (every 1MB)
+            if (done < p->size) {
+                printf("\rProcessed: %lu MB, Rank: %u", done >> 20, B->rank);
+                fflush(stdout);
+            }
+        }
+    }
+    free(pending);
+
+    if (!atomic_load(&p->failed)) {
+        printf("\rProcessed: %lu bytes, Final Rank: %u\n", p->size, B->rank);
+        canon_metrics_record(METRIC_COMPRESS, canon_metrics_now() - t_begin, p->size,
+                             canon_encoded_size(B));
+        p->basis = B;
+        queue_push(s, s->out, B);
+    } else {
+        basis_free(B);
+    }
+}
+
+static void stage_encode(PipeStage *s) {
+    GF2_Basis *B;
+    while ((B = queue_pop(s, s->in))) {
+        uint64_t t0 = now_ns();
+        PipeOutput *o = malloc(sizeof(PipeOutput));
+        o->t0 = canon_metrics_now();
+        o->len = canon_encoded_size(B);
+        o->data = malloc(o->len);
+        canon_encode(B, o->data);
+        atomic_fetch_add(&s->busy_ns, now_ns() - t0);
+        atomic_fetch_add(&s->items, 1);
+        queue_push(s, s->out, o);
+    }
+}
+
+static void stage_write(PipeStage *s) {
+    CanonPipeline *p = s->p;
+    PipeOutput *o;
+    while ((o = queue_pop(s, s->in))) {
+        uint64_t t0 = now_ns();
+        FILE *f = fopen(p->output, "wb");
+        if (!f) {
+            perror("Error opening output file");
+        } else {
+            bool ok = fwrite(o->data, 1, o->len, f) == o->len;
+            if (fclose(f) != 0) ok = false;
+            if (!ok) perror("Error writing output file");
+            if (ok) canon_metrics_record(METRIC_SAVE, canon_metrics_now() - o->t0, 0, o->len);
+            p->saved = ok;
+        }
+        atomic_fetch_add(&s->busy_ns, now_ns() - t0);
+        atomic_fetch_add(&s->items, 1);
+        free(o->data);
+        free(o);
+    }
+}
+
+static void* stage_worker(void *arg) {
+    PipeStage *s = arg;
+    switch (s->kind) {
+    case STAGE_READ:      stage_read(s); break;
+    case STAGE_TRANSFORM: stage_transform(s); break;
+    case STAGE_ELIMINATE: stage_eliminate(s); break;
+    case STAGE_ENCODE:    stage_encode(s); break;
+    case STAGE_WRITE:     stage_write(s); break;
+    }
+    if (s->out) queue_close(s->out);
+    return NULL;
+}
+
+/* ---- Construction ---- */
+
+static PipeStage* add_stage(CanonPipeline *p, StageKind kind, const char *name, int workers) {
+    PipeStage *s = &p->stages[p->nstages++];
+    memset(s, 0, sizeof(*s));
+    s->p = p;
+    s->kind = kind;
+    s->name = name;
+    s->workers = workers < 1 ? 1 : workers;
+    return s;
+}
+
+CanonPipeline* canon_pipeline_create(const CanonPipelineConfig *cfg) {
+    CanonPipeline *p = calloc(1, sizeof(CanonPipeline));
+    p->cfg = *cfg;
+    if (p->cfg.blocks < 2) p->cfg.blocks = 2;
+    return p;
+}
+
+/*
+ * Insert a transform stage after the ones already added; fn rewrites a
+ * block in place (len may change, up to the 1 MB block capacity)
+ */
+bool canon_pipeline_add_transform(CanonPipeline *p, const char *name,
+                                  CanonTransformFn fn, void *user, int workers) {
+    if (p->ntransforms == PIPE_MAX_STAGES - 4) {
+        fprintf(stderr, "Error: Too many pipeline stages\n");
+        return false;
+    }
+    p->transforms[p->ntransforms++] = (PipeTransform){ name, fn, user, workers };
+    return true;
+}
+
+/*
+ * Compress input into output through the pipeline
+ * Returns the basis (caller frees) or NULL; *saved reports the write
+ */
+GF2_Basis* canon_pipeline_run(CanonPipeline *p, const char *input, const char *output,
+                              bool *saved) {
+    *saved = false;
+    p->fd = open(input, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (p->fd < 0 || fstat(p->fd, &st) < 0) {
+        perror("Error opening file");
+        if (p->fd >= 0) close(p->fd);
+        return NULL;
+    }
+    posix_fadvise(p->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    p->size = (uint64_t)st.st_size;
+    if (!canon_checkpoint_start(&p->cfg.checkpoint, p->fd, &p->start, &p->ckpt)) {
+        close(p->fd);
+        return NULL;
+    }
+    p->first = p->ckpt.offset;
+    p->output = output;
+    atomic_store(&p->next_seq, 0);
+    atomic_store(&p->failed, false);
+    p->basis = NULL;
+    p->saved = false;
+
+    p->nstages = 0;
+    add_stage(p, STAGE_READ, "read", p->cfg.read_workers);
+    for (int i = 0; i < p->ntransforms; i++) {
+        PipeTransform *x = &p->transforms[i];
+        PipeStage *s = add_stage(p, STAGE_TRANSFORM, x->name, x->workers);
+        s->fn = x->fn;
+        s->user = x->user;
+    }
+    add_stage(p, STAGE_ELIMINATE, "eliminate", 1);
+    add_stage(p, STAGE_ENCODE, "encode", 1);
+    add_stage(p, STAGE_WRITE, "write", 1);
+
+    uint32_t nblocks = p->cfg.blocks;
+    p->arena = canon_huge_alloc((size_t)nblocks * CANON_BLOCK_SIZE);
+    p->blocks = calloc(nblocks, sizeof(PipeBlock));
+    queue_init(&p->free_q, nblocks, 1);    // Never closed
+    for (uint32_t i = 0; i < nblocks; i++) {
+        p->blocks[i].data = p->arena + (size_t)i * CANON_BLOCK_SIZE;
+        queue_try_push(&p->free_q, &p->blocks[i]);
+    }
+
+    // Queue i connects stage i to stage i+1
+    PipeQueue *queues = calloc(p->nstages, sizeof(PipeQueue));
+    for (int i = 0; i + 1 < p->nstages; i++) {
+        queue_init(&queues[i], nblocks, p->stages[i].workers);
+        p->stages[i].out = &queues[i];
+        p->stages[i + 1].in = &queues[i];
+    }
+
+    int nthreads = 0;
+    for (int i = 0; i < p->nstages; i++) nthreads += p->stages[i].workers;
+    pthread_t *threads = malloc(nthreads * sizeof(pthread_t));
+    int t = 0;
+    bool eliminating = false;
+    for (int i = 0; i < p->nstages; i++) {
+        PipeStage *s = &p->stages[i];
+        int started = 0;
+        for (int w = 0; w < s->workers; w++) {
+            if (pthread_create(&threads[t], NULL, stage_worker, s) == 0) {
+                t++;
+                started++;
+            } else if (s->out) {
+                // Stand in for the missing producer, or downstream waits forever
+                queue_close(s->out);
+            }
+        }
+        if (started < s->workers) {
+            fprintf(stderr, "Error: Cannot start %s stage workers (%d of %d running)\n",
+                    s->name, started, s->workers);
+            // A stage with no workers would hold its blocks; wind the run down
+            if (started == 0) atomic_store(&p->failed, true);
+            s->workers = started;
+        }
+        if (s->kind == STAGE_ELIMINATE) eliminating = started > 0;
+    }
+    for (int i = 0; i < t; i++) pthread_join(threads[i], NULL);
+    free(threads);
+    if (!eliminating) basis_free(p->start);
+
+    close(p->fd);
+    for (int i = 0; i + 1 < p->nstages; i++) free(queues[i].cells);
+    free(queues);
+    free(p->free_q.cells);
+    canon_huge_free(p->arena, (size_t)nblocks * CANON_BLOCK_SIZE);
+    free(p->blocks);
+
+    *saved = p->saved;
+    if (atomic_load(&p->failed)) {
+        basis_free(p->basis);
+        return NULL;
+    }
+    return p->basis;
+}
+
+/*
+ * Per-stage workers, items, busy time and queue stalls of the last run
+ */
+void canon_pipeline_report(CanonPipeline *p, FILE *f) {
+    fprintf(f, "Pipeline stages:\n");
+    for (int i = 0; i < p->nstages; i++) {
+        PipeStage *s = &p->stages[i];
+        fprintf(f, "  %-10s x%d: %lu item(s), busy %.1f ms, stalled %.1f ms\n",
+                s->name, s->workers, (uint64_t)atomic_load(&s->items),
+                atomic_load(&s->busy_ns) / 1e6, atomic_load(&s->stall_ns) / 1e6);
+    }
+}
+
+void canon_pipeline_destroy(CanonPipeline *p) {
+    free(p);
+}
@@ -0,0 +1,460 @@
+/*
+ * CANON - Recursive PLUQ factorization over GF(2)
+ *
+ * Author: Francesco Pedulli
+ * Date: February 26, 2026
+ *
+ * canon_pluq() factors an m x n GF2Matrix A in place as
+ *
+ *     A[rows[i]][cols[c]] = (L * U)[i][c]
+ *
+ * with L unit lower triangular (m x r) and U unit upper triangular (r x n),
+ * r the rank. L is stored below the diagonal of the first r columns, U on
+ * and above it in the first r rows. cols[0 .. r-1] is the column rank
+ * profile: the first r linearly independent columns, in order.
+ *
+ * The work is a recursive PLE decomposition (A = P * L * E, E in echelon
+ * form) splitting the columns in halves, as in M4RI:
+ *
+ *     [A0 | A1]:  PLE of A0 (rank r1)
+ *                 A01 <- L11^-1 A01            (triangular solve)
+ *                 A11 <- A11 + L21 * A01       (Schur complement)
+ *                 PLE of A11 (rank r2), then move its L next to L1
+ *
+ * so nearly all of the work is matrix multiplication and triangular
+ * solves, which are themselves recursive and end in Four-Russians table
+ * kernels (canon_mat_addmul(), Strassen-Winograd over M4RM). Every level
+ * works on windows in place. The recursion touches ever smaller blocks,
+ * so it uses whatever cache levels there are without being tuned to
+ * them; once a column block is at most CANON_PLUQ_PANEL wide it is
+ * copied into a contiguous panel (one cache line per row) so the narrow
+ * levels below stream instead of striding through the full matrix.
+ *
+ * The 64-column leaves find their pivots column by column, reducing rows
+ * lazily against the pivots found so far, and then compute the L entries
+ * of all remaining rows at once from eight byte-indexed tables.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+
+#ifdef __BMI2__
+#include <immintrin.h>
+#endif
+
+#include "canon.h"
+
+#define PANEL_WORDS (CANON_PLUQ_PANEL / 64)
+#define TRSM_STRIPE 512         // Words of B per stripe: 64 rows stay in L2
+
+/*
+ * n <= 64 bits of a row starting at column col, bit 0 = column col
+ */
+static inline uint64_t read_bits(const uint64_t *row, uint32_t col, uint32_t n) {
+    uint32_t w = col / 64, s = col % 64;
+    uint64_t v = row[w] >> s;
+    if (s && s + n > 64) v |= row[w + 1] << (64 - s);
+    return n == 64 ? v : v & ((1ull << n) - 1);
+}
+
+/*
+ * Overwrite n <= 64 bits of a row starting at column col with v
+ */
+static inline void write_bits(uint64_t *row, uint32_t col, uint32_t n, uint64_t v) {
+    uint32_t w = col / 64, s = col % 64;
+    uint64_t m = n == 64 ? ~0ull : (1ull << n) - 1;
+    v &= m;
+    row[w] = (row[w] & ~(m << s)) | (v << s);
+    if (s && s + n > 64) row[w + 1] = (row[w + 1] & ~(m >> (64 - s))) | (v >> (64 - s));
+}
+
+/*
+ * row |= v << col, for v no wider than the bits left in the row
+ */
+static inline void or_bits(uint64_t *row, uint32_t col, uint64_t v) {
+    if (!v) return;
+    uint32_t w = col / 64, s = col % 64;
+    row[w] |= v << s;
+    if (s && (v >> (64 - s))) row[w + 1] |= v >> (64 - s);
+}
+
+/*
+ * dst ^= src over words [from, to); word words-1 only inside mask
+ */
+static inline void row_xor(uint64_t *dst, const uint64_t *src, uint32_t from, uint32_t to, uint32_t words,
+                           uint64_t mask) {
+    uint32_t end = to < words ? to : words - 1;
+    for (uint32_t w = from; w < end; w++) dst[w] ^= src[w];
+    if (to == words) dst[words - 1] ^= src[words - 1] & mask;
+}
+
+/*
+ * Bits of v selected by m, packed to the bottom
+ */
+static inline uint64_t extract(uint64_t v, uint64_t m) {
+#ifdef __BMI2__
+    return _pext_u64(v, m);
+#else
+    uint64_t out = 0;
+    for (uint32_t n = 0; m; m &= m - 1, n++) out |= ((v >> __builtin_ctzll(m)) & 1) << n;
+    return out;
+#endif
+}
+
+/*
+ * B <- L^-1 B for L unit lower triangular (r x r, upper part ignored)
+ */
+void canon_mat_trsm_lower(const GF2Matrix *L, GF2Matrix *B) {
+    uint32_t r = B->nrows, words = canon_mat_words(B);
+    if (r == 0 || words == 0) return;
+    if (r > 64) {
+        uint32_t r0 = (r / 2 + 63) / 64 * 64;
+        GF2Matrix L00 = canon_mat_window(L, 0, 0, r0, r0), L10 = canon_mat_window(L, r0, 0, r - r0, r0);
+        GF2Matrix L11 = canon_mat_window(L, r0, r0, r - r0, r - r0);
+        GF2Matrix B0 = canon_mat_window(B, 0, 0, r0, B->ncols), B1 = canon_mat_window(B, r0, 0, r - r0, B->ncols);
+        canon_mat_trsm_lower(&L00, &B0);
+        canon_mat_addmul(&B1, &L10, &B0);
+        canon_mat_trsm_lower(&L11, &B1);
+        return;
+    }
+
+    uint64_t mask = canon_mat_last_mask(B);
+    for (uint32_t s0 = 0; s0 < words; s0 += TRSM_STRIPE) {
+        uint32_t s1 = words - s0 < TRSM_STRIPE ? words : s0 + TRSM_STRIPE;
+        for (uint32_t i = 1; i < r; i++) {
+            uint64_t *bi = canon_mat_row(B, i);
+            for (uint64_t l = canon_mat_row(L, i)[0] & ((1ull << i) - 1); l; l &= l - 1) {
+                row_xor(bi, canon_mat_row(B, (uint32_t)__builtin_ctzll(l)), s0, s1, words, mask);
+            }
+        }
+    }
+}
+
+/*
+ * B <- U^-1 B for U unit upper triangular (r x r, lower part ignored)
+ */
+void canon_mat_trsm_upper(const GF2Matrix *U, GF2Matrix *B) {
+    uint32_t r = B->nrows, words = canon_mat_words(B);
+    if (r == 0 || words == 0) return;
+    if (r > 64) {
+        uint32_t r0 = (r / 2 + 63) / 64 * 64;
+        GF2Matrix U00 = canon_mat_window(U, 0, 0, r0, r0), U01 = canon_mat_window(U, 0, r0, r0, r - r0);
+        GF2Matrix U11 = canon_mat_window(U, r0, r0, r - r0, r - r0);
+        GF2Matrix B0 = canon_mat_window(B, 0, 0, r0, B->ncols), B1 = canon_mat_window(B, r0, 0, r - r0, B->ncols);
+        canon_mat_trsm_upper(&U11, &B1);
+        canon_mat_addmul(&B0, &U01, &B1);
+        canon_mat_trsm_upper(&U00, &B0);
+        return;
+    }
+
+    uint64_t mask = canon_mat_last_mask(B);
+    uint64_t below = r == 64 ? ~0ull : (1ull << r) - 1;
+    for (uint32_t s0 = 0; s0 < words; s0 += TRSM_STRIPE) {
+        uint32_t s1 = words - s0 < TRSM_STRIPE ? words : s0 + TRSM_STRIPE;
+        for (uint32_t i = r - 1; i-- > 0;) {
+            uint64_t *bi = canon_mat_row(B, i);
+            for (uint64_t u = canon_mat_row(U, i)[0] & below & ~((2ull << i) - 1); u; u &= u - 1) {
+                row_xor(bi, canon_mat_row(B, (uint32_t)__builtin_ctzll(u)), s0, s1, words, mask);
+            }
+        }
+    }
+}
+
+/*
+ * Swap rows i and P[i] of W for i in [from, to), in order
+ */
+static void apply_swaps(GF2Matrix *W, const uint32_t *P, uint32_t from, uint32_t to) {
+    if (W->ncols == 0) return;
+    for (uint32_t i = from; i < to; i++) canon_mat_swap_rows(W, i, P[i]);
+}
+
+/*
+ * PLE of a matrix at most 64 columns wide (one word per row)
+ * Pivots are searched column by column; a row is only reduced against
+ * the pivots found since it was last looked at. The L entries of the
+ * rows that end up below the pivots are then l = x * M for their original
+ * word x, where M maps pivot column Q[s] to row s of T^-1 and T is the
+ * unit upper triangular pivot block. x * M runs on eight byte tables.
+ */
+static uint32_t ple_leaf(GF2Matrix *A, uint32_t *P, uint32_t *Q) {
+    uint32_t m = A->nrows, w = A->ncols;
+    uint64_t mask = canon_mat_last_mask(A);
+    uint64_t *x = malloc((size_t)m * 3 * sizeof(uint64_t));
+    uint8_t *upto = calloc(m, 1);
+    if (!x || !upto) {
+        fprintf(stderr, "Error: Out of memory for PLUQ leaf\n");
+        free(x);
+        free(upto);
+        return 0;
+    }
+    uint64_t *y = x + m, *lb = y + m;   // Reduced word and L bits so far
+
+    uint64_t any = 0;
+    for (uint32_t i = 0; i < m; i++) {
+        x[i] = y[i] = canon_mat_row(A, i)[0] & mask;
+        lb[i] = 0;
+        any |= x[i];
+    }
+
+    uint64_t E[64];
+    uint32_t r = 0;
+    for (uint32_t j = 0; j < w && r < m; j++) {
+        if (!((any >> j) & 1)) continue;
+        for (uint32_t i = r; i < m; i++) {
+            for (uint32_t s = upto[i]; s < r; s++) {
+                if ((y[i] >> Q[s]) & 1) {
+                    y[i] ^= E[s];
+                    lb[i] |= 1ull << s;
+                }
+            }
+            upto[i] = (uint8_t)r;
+            if (!((y[i] >> j) & 1)) continue;
+
+            uint64_t t;
+            t = x[i], x[i] = x[r], x[r] = t;
+            t = y[i], y[i] = y[r], y[r] = t;
+            t = lb[i], lb[i] = lb[r], lb[r] = t;
+            upto[i] = upto[r];
+            P[r] = i;
+            Q[r] = j;
+            E[r] = y[r];
+            r++;
+            break;
+        }
+    }
+
+    // Row s of T^-1, T[s][u] = bit Q[u] of E[s]: Inv_s = e_s + sum T[s][u] Inv_u
+    uint64_t inv[64], M[64] = { 0 }, tab[8][256];
+    for (uint32_t s = r; s-- > 0;) {
+        inv[s] = 1ull << s;
+        for (uint32_t u = s + 1; u < r; u++) {
+            if ((E[s] >> Q[u]) & 1) inv[s] ^= inv[u];
+        }
+        M[Q[s]] = inv[s];
+    }
+    uint32_t bytes = (w + 7) / 8;
+    for (uint32_t q = 0; q < bytes; q++) {
+        tab[q][0] = 0;
+        for (uint32_t v = 1; v < 256; v++) tab[q][v] = tab[q][v & (v - 1)] ^ M[8 * q + __builtin_ctz(v)];
+    }
+
+    for (uint32_t i = 0; i < m; i++) {
+        uint64_t word;
+        if (i < r) {
+            word = y[i] | lb[i];
+        } else {
+            word = 0;
+            for (uint32_t q = 0; q < bytes; q++) word ^= tab[q][(x[i] >> (8 * q)) & 0xff];
+        }
+        uint64_t *row = canon_mat_row(A, i);
+        row[0] = (row[0] & ~mask) | (word & mask);
+    }
+    free(x);
+    free(upto);
+    return r;
+}
+
+/*
+ * Move len bits of a row from column src down to column dst < src and
+ * clear the source bits the destination does not cover
+ */
+static void move_bits(uint64_t *row, uint32_t dst, uint32_t src, uint32_t len) {
+    // Ascending chunks never overwrite source bits still to be read
+    for (uint32_t o = 0; o < len; o += 64) {
+        uint32_t n = len - o < 64 ? len - o : 64;
+        write_bits(row, dst + o, n, read_bits(row, src + o, n));
+    }
+    for (uint32_t c = dst + len > src ? dst + len : src; c < src + len; c += 64) {
+        write_bits(row, c, src + len - c < 64 ? src + len - c : 64, 0);
+    }
+}
+
+/*
+ * PLE decomposition of A in place; returns the rank r
+ * P[i] (i < r): row swapped with row i, in order. Q[i]: pivot column of
+ * row i, increasing. L is left below the diagonal of columns 0 .. r-1,
+ * E in rows 0 .. r-1 at its own columns; everything else is zero.
+ */
+static uint32_t ple(GF2Matrix *A, uint32_t *P, uint32_t *Q) {
+    uint32_t m = A->nrows, n = A->ncols;
+    if (m == 0 || n == 0) return 0;
+    if (n <= 64) return ple_leaf(A, P, Q);
+
+    if (n <= CANON_PLUQ_PANEL && A->stride > PANEL_WORDS) {
+        GF2Matrix *C = canon_mat_new(m, n);
+        if (C) {
+            canon_mat_copy(C, A);
+            uint32_t r = ple(C, P, Q);
+            canon_mat_copy(A, C);
+            canon_mat_free(C);
+            return r;
+        }
+    }
+
+    uint32_t n1 = (n / 2 + 63) / 64 * 64;
+    GF2Matrix A0 = canon_mat_window(A, 0, 0, m, n1), A1 = canon_mat_window(A, 0, n1, m, n - n1);
+    uint32_t r1 = ple(&A0, P, Q);
+    apply_swaps(&A1, P, 0, r1);
+    if (r1 > 0) {
+        GF2Matrix L11 = canon_mat_window(A, 0, 0, r1, r1), A01 = canon_mat_window(A, 0, n1, r1, n - n1);
+        canon_mat_trsm_lower(&L11, &A01);
+        if (r1 < m) {
+            GF2Matrix L21 = canon_mat_window(A, r1, 0, m - r1, r1);
+            GF2Matrix A11 = canon_mat_window(A, r1, n1, m - r1, n - n1);
+            canon_mat_addmul(&A11, &L21, &A01);
+        }
+    }
+    if (r1 == m) return r1;
+
+    GF2Matrix A11 = canon_mat_window(A, r1, n1, m - r1, n - n1);
+    uint32_t r2 = ple(&A11, P + r1, Q + r1);
+    for (uint32_t i = r1; i < r1 + r2; i++) {
+        P[i] += r1;
+        Q[i] += n1;
+    }
+    if (r1 > 0) {
+        GF2Matrix L1 = canon_mat_window(A, 0, 0, m, r1);
+        apply_swaps(&L1, P, r1, r1 + r2);
+    }
+
+    // L2 sits in columns n1 .. n1+r2-1; the columns r1 .. n1-1 below row r1 are zero
+    if (r1 < n1) {
+        for (uint32_t i = r1 + 1; i < m; i++) {
+            uint32_t len = i - r1 < r2 ? i - r1 : r2;
+            if (len) move_bits(canon_mat_row(A, i), r1, n1, len);
+        }
+    }
+    return r1 + r2;
+}
+
+/*
+ * E -> U: rewrite the part of rows 0 .. r-1 on and above the diagonal
+ * with the pivot columns first and the others after them, both in order
+ */
+static bool echelon_to_upper(GF2Matrix *A, uint32_t r, const uint32_t *Q) {
+    uint32_t words = canon_mat_words(A);
+    uint64_t *pm = calloc((size_t)words * 2, sizeof(uint64_t));
+    if (!pm) return false;
+    uint64_t *out = pm + words;
+    for (uint32_t t = 0; t < r; t++) pm[Q[t] / 64] |= 1ull << (Q[t] % 64);
+    uint64_t mask = canon_mat_last_mask(A);
+
+    for (uint32_t i = 0; i < r; i++) {
+        uint64_t *row = canon_mat_row(A, i);
+        memset(out, 0, (size_t)words * sizeof(uint64_t));
+        // L bits left of the diagonal stay; E is zero there and left of Q[i]
+        for (uint32_t w = 0; w <= i / 64 && w < words; w++) {
+            uint64_t keep = w < i / 64 ? ~0ull : (1ull << (i % 64)) - 1;
+            out[w] = row[w] & keep;
+        }
+        uint32_t pos = 0, npos = r;
+        for (uint32_t w = 0; w < words; w++) {
+            uint64_t valid = w + 1 < words ? ~0ull : mask;
+            uint64_t e = w < i / 64 ? 0 : w > i / 64 ? row[w] : row[w] & ~((1ull << (i % 64)) - 1);
+            uint32_t np = (uint32_t)__builtin_popcountll(pm[w]);
+            uint32_t nn = (uint32_t)__builtin_popcountll(valid & ~pm[w]);
+            or_bits(out, pos, extract(e, pm[w]));
+            or_bits(out, npos, extract(e, valid & ~pm[w]));
+            pos += np;
+            npos += nn;
+        }
+        memcpy(row, out, (size_t)(words - 1) * sizeof(uint64_t));
+        row[words - 1] = (row[words - 1] & ~mask) | (out[words - 1] & mask);
+    }
+    free(pm);
+    return true;
+}
+
+/*
+ * PLUQ of A in place; returns the rank r
+ * rows (m entries) and cols (n entries) receive the row and column order
+ * of L * U in A: A[rows[i]][cols[c]] = (L * U)[i][c]. Either may be NULL.
+ */
+uint32_t canon_pluq(GF2Matrix *A, uint32_t *rows, uint32_t *cols) {
+    uint32_t m = A->nrows, n = A->ncols, most = m < n ? m : n;
+    uint32_t *P = malloc(((size_t)most + 1) * 2 * sizeof(uint32_t));
+    if (!P) {
+        fprintf(stderr, "Error: Out of memory for PLUQ\n");
+        return 0;
+    }
+    uint32_t *Q = P + most + 1;
+    uint32_t r = ple(A, P, Q);
+
+    if (rows) {
+        for (uint32_t i = 0; i < m; i++) rows[i] = i;
+        for (uint32_t i = 0; i < r; i++) {
+            uint32_t t = rows[i];
+            rows[i] = rows[P[i]];
+            rows[P[i]] = t;
+        }
+    }
+    if (cols) {
+        uint32_t next = r;
+        for (uint32_t c = 0, t = 0; c < n; c++) {
+            if (t < r && Q[t] == c) {
+                cols[t++] = c;
+            } else {
+                cols[next++] = c;
+            }
+        }
+    }
+    if (!echelon_to_upper(A, r, Q)) fprintf(stderr, "Error: Out of memory for PLUQ\n");
+    free(P);
+    return r;
+}
+
+/*
+ * Solve A X = B from the PLUQ of A (LU, rank, rows, cols)
+ * B is m x c, X is n x c; the free variables are set to zero. Returns
+ * false, leaving X unspecified, if the system has no solution.
+ */
+bool canon_pluq_solve(const GF2Matrix *LU, uint32_t rank, const uint32_t *rows, const uint32_t *cols,
+                      const GF2Matrix *B, GF2Matrix *X) {
+    uint32_t m = LU->nrows, c = B->ncols;
+    GF2Matrix *Y = canon_mat_new(m, c);
+    if (!Y) {
+        fprintf(stderr, "Error: Out of memory for PLUQ solve\n");
+        return false;
+    }
+    for (uint32_t i = 0; i < m; i++) {
+        GF2Matrix dst = canon_mat_window(Y, i, 0, 1, c), src = canon_mat_window(B, rows[i], 0, 1, c);
+        canon_mat_copy(&dst, &src);
+    }
+
+    // L * (U * W) = B[rows]: forward substitution, then the rows past the
+    // rank must vanish, then back substitution on the pivot block
+    bool ok = true;
+    GF2Matrix Y0 = canon_mat_window(Y, 0, 0, rank, c);
+    if (rank > 0) {
+        GF2Matrix L11 = canon_mat_window(LU, 0, 0, rank, rank);
+        canon_mat_trsm_lower(&L11, &Y0);
+    }
+    if (rank < m) {
+        GF2Matrix Y1 = canon_mat_window(Y, rank, 0, m - rank, c);
+        if (rank > 0) {
+            GF2Matrix L21 = canon_mat_window(LU, rank, 0, m - rank, rank);
+            canon_mat_addmul(&Y1, &L21, &Y0);
+        }
+        GF2Matrix *Z = canon_mat_new(m - rank, c);
+        ok = Z && canon_mat_equal(&Y1, Z);
+        canon_mat_free(Z);
+    }
+    if (ok) {
+        if (rank > 0) {
+            GF2Matrix U11 = canon_mat_window(LU, 0, 0, rank, rank);
+            canon_mat_trsm_upper(&U11, &Y0);
+        }
+        canon_mat_zero(X);
+        for (uint32_t t = 0; t < rank; t++) {
+            GF2Matrix dst = canon_mat_window(X, cols[t], 0, 1, c), src = canon_mat_window(Y, t, 0, 1, c);
+            canon_mat_copy(&dst, &src);
+        }
+    }
+    canon_mat_free(Y);
+    return ok;
+}
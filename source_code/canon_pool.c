@@ -0,0 +1,870 @@
+/*
+ * CANON - Work-stealing thread pool and many-file batch compression
+ *
+ * Author: Francesco Pedulli
+ * Date: February 26, 2026
+ *
+ * Every worker owns a Chase-Lev deque: it pushes and pops tasks at the
+ * bottom, idle workers steal from the top of a random victim. Tasks
+ * submitted from outside the pool go to a small shared injection list.
+ * Idle workers sleep on a condition variable only after a failed steal
+ * sweep, and a submit wakes one sleeper.
+ *
+ * `canon compress-many` feeds it one task per file, largest first. Files
+ * larger than --chunk become chains of chunk tasks: each chunk continues
+ * the file's basis and then pushes the next chunk onto its own deque,
+ * so huge files start early and the rest of the pool steals the small
+ * files around them. Output is identical to `canon compress`. With
+ * --split the chunks of a file are eliminated independently and their
+ * bases merged in order, which spreads one large file over all cores.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "canon.h"
+
+#define POOL_DEQUE_INITIAL 256
+#define POOL_STEAL_ROUNDS 4
+
+typedef struct {
+    CanonTaskFn fn;
+    void *arg;
+} PoolTask;
+
+typedef struct DequeArray {
+    int64_t size;                   // Power of two
+    _Atomic(PoolTask *) *slots;
+    struct DequeArray *retired;     // Older arrays, freed at destroy
+} DequeArray;
+
+typedef struct {
+    _Alignas(64) atomic_int_fast64_t top;
+    _Alignas(64) atomic_int_fast64_t bottom;
+    _Atomic(DequeArray *) array;
+} Deque;
+
+typedef struct {
+    CanonPool *pool;
+    int id;
+    int cpu, node;
+    pthread_t thread;
+    Deque deque;
+    uint32_t rng;
+    uint64_t executed;
+    uint64_t stolen;
+    uint64_t busy_ns;
+} PoolWorker;
+
+typedef struct {
+    pthread_mutex_t lock;
+    PoolTask **tasks;
+    atomic_uint n;                  // Read unlocked as a hint
+    uint32_t cap;
+} PoolInject;
+
+struct CanonPool {
+    PoolWorker *workers;
+    int nworkers;
+
+    // Per-node injection lists: outside submissions and node-targeted tasks
+    PoolInject inject[CANON_MAX_NODES];
+    int nnodes;
+    atomic_uint next_node;          // Round-robin for untargeted outside tasks
+    bool pin;
+
+    // Sleep/wake: queued counts submitted-but-untaken tasks
+    atomic_long queued;
+    atomic_int sleepers;
+    pthread_mutex_t sleep_lock;
+    pthread_cond_t sleep_cond;
+    atomic_bool stop;
+
+    // Completion: outstanding counts submitted-but-unfinished tasks
+    atomic_long outstanding;
+    pthread_mutex_t done_lock;
+    pthread_cond_t done_cond;
+
+    uint64_t start_ns;
+};
+
+static _Thread_local PoolWorker *current_worker;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static DequeArray* deque_array_new(int64_t size) {
+    DequeArray *a = malloc(sizeof(DequeArray));
+    a->size = size;
+    a->slots = calloc(size, sizeof(a->slots[0]));
+    a->retired = NULL;
+    return a;
+}
+
+static void deque_init(Deque *d) {
+    atomic_init(&d->top, 0);
+    atomic_init(&d->bottom, 0);
+    atomic_init(&d->array, deque_array_new(POOL_DEQUE_INITIAL));
+}
+
+static void deque_free(Deque *d) {
+    DequeArray *a = atomic_load(&d->array);
+    while (a) {
+        DequeArray *next = a->retired;
+        free(a->slots);
+        free(a);
+        a = next;
+    }
+}
+
+/*
+ * Owner only: push at the bottom, doubling the array when full
+ * Thieves may still read the old array, so it is retired, not freed
+ */
+static void deque_push(Deque *d, PoolTask *task) {
+    int64_t b = atomic_load_explicit(&d->bottom, memory_order_relaxed);
+    int64_t t = atomic_load_explicit(&d->top, memory_order_acquire);
+    DequeArray *a = atomic_load_explicit(&d->array, memory_order_relaxed);
+
+    if (b - t > a->size - 1) {
+        DequeArray *grown = deque_array_new(a->size * 2);
+        for (int64_t i = t; i < b; i++) {
+            atomic_store_explicit(&grown->slots[i & (grown->size - 1)],
+                                  atomic_load_explicit(&a->slots[i & (a->size - 1)],
+                                                       memory_order_relaxed),
+                                  memory_order_relaxed);
+        }
+        grown->retired = a;
+        atomic_store_explicit(&d->array, grown, memory_order_release);
+        a = grown;
+    }
+
+    atomic_store_explicit(&a->slots[b & (a->size - 1)], task, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+}
+
+/*
+ * Owner only: pop at the bottom (LIFO, cache-warm)
+ */
+static PoolTask* deque_pop(Deque *d) {
+    int64_t b = atomic_load_explicit(&d->bottom, memory_order_relaxed) - 1;
+    DequeArray *a = atomic_load_explicit(&d->array, memory_order_relaxed);
+    atomic_store_explicit(&d->bottom, b, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t t = atomic_load_explicit(&d->top, memory_order_relaxed);
+
+    if (t > b) {
+        atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+        return NULL;
+    }
+
+    PoolTask *task = atomic_load_explicit(&a->slots[b & (a->size - 1)], memory_order_relaxed);
+    if (t == b) {
+        // Last task: race the thieves for it
+        if (!atomic_compare_exchange_strong_explicit(&d->top, &t, t + 1,
+                                                     memory_order_seq_cst,
+                                                     memory_order_relaxed)) {
+            task = NULL;
+        }
+        atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+    }
+    return task;
+}
+
+/*
+ * Any thread: steal from the top (FIFO, oldest and usually largest)
+ */
+static PoolTask* deque_steal(Deque *d) {
+    int64_t t = atomic_load_explicit(&d->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t b = atomic_load_explicit(&d->bottom, memory_order_acquire);
+    if (t >= b) return NULL;
+
+    DequeArray *a = atomic_load_explicit(&d->array, memory_order_acquire);
+    PoolTask *task = atomic_load_explicit(&a->slots[t & (a->size - 1)], memory_order_relaxed);
+    if (!atomic_compare_exchange_strong_explicit(&d->top, &t, t + 1,
+                                                 memory_order_seq_cst,
+                                                 memory_order_relaxed)) {
+        return NULL;  // Lost the race; caller moves on to another victim
+    }
+    return task;
+}
+
+static PoolTask* inject_take(PoolInject *in) {
+    if (atomic_load_explicit(&in->n, memory_order_relaxed) == 0) return NULL;
+    PoolTask *task = NULL;
+    pthread_mutex_lock(&in->lock);
+    if (in->n > 0) task = in->tasks[--in->n];
+    pthread_mutex_unlock(&in->lock);
+    return task;
+}
+
+static void inject_put(PoolInject *in, PoolTask *task) {
+    pthread_mutex_lock(&in->lock);
+    if (in->n == in->cap) {
+        in->cap = in->cap ? in->cap * 2 : 64;
+        in->tasks = realloc(in->tasks, in->cap * sizeof(PoolTask *));
+    }
+    // LIFO take: callers submit in reverse priority order
+    in->tasks[in->n++] = task;
+    pthread_mutex_unlock(&in->lock);
+}
+
+/*
+ * Steal sweep over victims on one node (local) or all other nodes
+ */
+static PoolTask* steal_sweep(PoolWorker *w, bool local) {
+    CanonPool *pool = w->pool;
+    w->rng = w->rng * 1103515245u + 12345u;
+    int first = (int)((w->rng >> 16) % (uint32_t)pool->nworkers);
+    for (int k = 0; k < pool->nworkers; k++) {
+        PoolWorker *victim = &pool->workers[(first + k) % pool->nworkers];
+        if (victim == w || (victim->node == w->node) != local) continue;
+        PoolTask *task = deque_steal(&victim->deque);
+        if (task) {
+            w->stolen++;
+            return task;
+        }
+    }
+    return NULL;
+}
+
+static PoolTask* find_task(PoolWorker *w) {
+    CanonPool *pool = w->pool;
+    PoolTask *task = deque_pop(&w->deque);
+    if (task) return task;
+
+    // Node-local work first: our node's list, then same-node victims
+    if ((task = inject_take(&pool->inject[w->node]))) return task;
+
+    // Random victim order, a few sweeps before giving up
+    for (int round = 0; round < POOL_STEAL_ROUNDS; round++) {
+        if ((task = steal_sweep(w, true))) return task;
+        if ((task = inject_take(&pool->inject[w->node]))) return task;
+        if (pool->nnodes > 1) {
+            for (int k = 1; k < pool->nnodes; k++) {
+                if ((task = inject_take(&pool->inject[(w->node + k) % pool->nnodes]))) {
+                    return task;
+                }
+            }
+            if ((task = steal_sweep(w, false))) return task;
+        }
+        sched_yield();
+    }
+    return NULL;
+}
+
+static void run_task(PoolWorker *w, PoolTask *task) {
+    CanonPool *pool = w->pool;
+    atomic_fetch_sub(&pool->queued, 1);
+
+    uint64_t t0 = now_ns();
+    task->fn(pool, task->arg);
+    w->busy_ns += now_ns() - t0;
+    w->executed++;
+    free(task);
+
+    if (atomic_fetch_sub(&pool->outstanding, 1) == 1) {
+        pthread_mutex_lock(&pool->done_lock);
+        pthread_cond_broadcast(&pool->done_cond);
+        pthread_mutex_unlock(&pool->done_lock);
+    }
+}
+
+static void* pool_worker(void *arg) {
+    PoolWorker *w = arg;
+    CanonPool *pool = w->pool;
+    current_worker = w;
+
+    // Held by canon_pool_create() until nworkers counts only started threads
+    pthread_mutex_lock(&pool->sleep_lock);
+    pthread_mutex_unlock(&pool->sleep_lock);
+
+    // Multi-node hosts keep each worker on its node; --pin narrows to one CPU
+    if (pool->pin || pool->nnodes > 1) canon_numa_pin(w->cpu, pool->pin);
+
+    while (!atomic_load(&pool->stop)) {
+        PoolTask *task = find_task(w);
+        if (task) {
+            run_task(w, task);
+            continue;
+        }
+
+        // Nothing to steal: sleep until a submit bumps queued
+        pthread_mutex_lock(&pool->sleep_lock);
+        atomic_fetch_add(&pool->sleepers, 1);
+        while (atomic_load(&pool->queued) == 0 && !atomic_load(&pool->stop)) {
+            pthread_cond_wait(&pool->sleep_cond, &pool->sleep_lock);
+        }
+        atomic_fetch_sub(&pool->sleepers, 1);
+        pthread_mutex_unlock(&pool->sleep_lock);
+    }
+    return NULL;
+}
+
+/*
+ * Create a pool of threads workers (0 = one per online CPU), spread
+ * over NUMA nodes; CANON_POOL_PIN pins each worker to one CPU
+ * Runs with the workers that could be started; NULL if none could.
+ */
+CanonPool* canon_pool_create(int threads, unsigned flags) {
+    if (threads <= 0) threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads < 1) threads = 1;
+
+    CanonPool *pool = calloc(1, sizeof(CanonPool));
+    pool->nworkers = threads;
+    pool->workers = calloc(threads, sizeof(PoolWorker));
+    pool->nnodes = canon_numa_nodes();
+    pool->pin = flags & CANON_POOL_PIN;
+    for (int n = 0; n < pool->nnodes; n++) pthread_mutex_init(&pool->inject[n].lock, NULL);
+    pthread_mutex_init(&pool->sleep_lock, NULL);
+    pthread_cond_init(&pool->sleep_cond, NULL);
+    pthread_mutex_init(&pool->done_lock, NULL);
+    pthread_cond_init(&pool->done_cond, NULL);
+    pool->start_ns = now_ns();
+
+    for (int i = 0; i < threads; i++) {
+        PoolWorker *w = &pool->workers[i];
+        w->pool = pool;
+        w->id = i;
+        w->rng = 0x9e3779b9u * (uint32_t)(i + 1);
+        w->cpu = canon_numa_worker_cpu(i);
+        w->node = canon_numa_cpu_node(w->cpu);
+        deque_init(&w->deque);
+    }
+    int started = 0;
+    pthread_mutex_lock(&pool->sleep_lock);
+    while (started < threads &&
+           pthread_create(&pool->workers[started].thread, NULL, pool_worker, &pool->workers[started]) == 0) {
+        started++;
+    }
+    for (int i = started; i < threads; i++) deque_free(&pool->workers[i].deque);
+    pool->nworkers = started;
+    pthread_mutex_unlock(&pool->sleep_lock);
+
+    if (started < threads) {
+        fprintf(stderr, "Error: Cannot start pool workers (%d of %d running)\n", started, threads);
+    }
+    if (started == 0) {
+        canon_pool_destroy(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+static void pool_enqueue(CanonPool *pool, int node, PoolTask *task) {
+    atomic_fetch_add(&pool->outstanding, 1);
+
+    PoolWorker *w = current_worker;
+    if (w && w->pool == pool && (node < 0 || node == w->node)) {
+        deque_push(&w->deque, task);
+    } else {
+        if (node < 0 || node >= pool->nnodes) {
+            node = (int)(atomic_fetch_add(&pool->next_node, 1) % (unsigned)pool->nnodes);
+        }
+        inject_put(&pool->inject[node], task);
+    }
+
+    atomic_fetch_add(&pool->queued, 1);
+    if (atomic_load(&pool->sleepers) > 0) {
+        // Any woken worker can take it: remote lists are the last resort
+        pthread_mutex_lock(&pool->sleep_lock);
+        pthread_cond_signal(&pool->sleep_cond);
+        pthread_mutex_unlock(&pool->sleep_lock);
+    }
+}
+
+/*
+ * Submit a task. From inside a task it goes onto the calling worker's
+ * own deque (run next unless stolen); from outside onto a node's list.
+ */
+void canon_pool_submit(CanonPool *pool, CanonTaskFn fn, void *arg) {
+    canon_pool_submit_node(pool, -1, fn, arg);
+}
+
+/*
+ * Submit a task preferring workers on node (-1 = anywhere); idle
+ * workers elsewhere still steal it rather than sit idle
+ */
+void canon_pool_submit_node(CanonPool *pool, int node, CanonTaskFn fn, void *arg) {
+    PoolTask *task = malloc(sizeof(PoolTask));
+    task->fn = fn;
+    task->arg = arg;
+    pool_enqueue(pool, node, task);
+}
+
+/*
+ * Block until every submitted task, including ones submitted by tasks,
+ * has finished
+ */
+void canon_pool_wait(CanonPool *pool) {
+    pthread_mutex_lock(&pool->done_lock);
+    while (atomic_load(&pool->outstanding) > 0) {
+        pthread_cond_wait(&pool->done_cond, &pool->done_lock);
+    }
+    pthread_mutex_unlock(&pool->done_lock);
+}
+
+int canon_pool_threads(const CanonPool *pool) {
+    return pool->nworkers;
+}
+
+/*
+ * Index of the calling worker in pool, -1 outside it; lets a task use
+ * per-worker scratch, as a worker runs one task at a time
+ */
+int canon_pool_worker(const CanonPool *pool) {
+    PoolWorker *w = current_worker;
+    return w && w->pool == pool ? w->id : -1;
+}
+
+/*
+ * Per-worker utilisation since creation: tasks, steals, busy share
+ */
+void canon_pool_report(CanonPool *pool, FILE *f) {
+    double wall = (double)(now_ns() - pool->start_ns);
+    double busy = 0;
+    uint64_t stolen = 0;
+    for (int i = 0; i < pool->nworkers; i++) {
+        PoolWorker *w = &pool->workers[i];
+        fprintf(f, "  worker %2d (cpu %d, node %d): %lu task(s), %lu stolen, %.1f%% busy\n",
+                i, w->cpu, w->node, w->executed, w->stolen,
+                wall > 0 ? 100.0 * w->busy_ns / wall : 0.0);
+        busy += w->busy_ns;
+        stolen += w->stolen;
+    }
+    fprintf(f, "  pool: %d worker(s) on %d node(s)%s, %lu steal(s), %.1f%% average utilisation\n",
+            pool->nworkers, pool->nnodes, pool->pin ? ", pinned" : "", stolen,
+            wall > 0 ? 100.0 * busy / (wall * pool->nworkers) : 0.0);
+}
+
+void canon_pool_destroy(CanonPool *pool) {
+    if (!pool) return;
+    canon_pool_wait(pool);
+    atomic_store(&pool->stop, true);
+    pthread_mutex_lock(&pool->sleep_lock);
+    pthread_cond_broadcast(&pool->sleep_cond);
+    pthread_mutex_unlock(&pool->sleep_lock);
+    for (int i = 0; i < pool->nworkers; i++) pthread_join(pool->workers[i].thread, NULL);
+    for (int i = 0; i < pool->nworkers; i++) deque_free(&pool->workers[i].deque);
+    for (int n = 0; n < pool->nnodes; n++) {
+        pthread_mutex_destroy(&pool->inject[n].lock);
+        free(pool->inject[n].tasks);
+    }
+    pthread_mutex_destroy(&pool->sleep_lock);
+    pthread_cond_destroy(&pool->sleep_cond);
+    pthread_mutex_destroy(&pool->done_lock);
+    pthread_cond_destroy(&pool->done_cond);
+    free(pool->workers);
+    free(pool);
+}
+
+/* ---- Many-file compression on the pool ---- */
+
+typedef struct {
+    CanonFileJob *job;
+    const CanonFilesConfig *cfg;
+    const uint8_t *data;        // mmap'd input
+    uint32_t nchunks;
+    GF2_Basis **parts;          // --split: one basis per chunk
+    atomic_uint remaining;      // --split: chunks not yet eliminated
+    atomic_uint_fast64_t compute_ns;
+} FileState;
+
+typedef struct {
+    FileState *file;
+    uint32_t index;
+} ChunkTask;
+
+static void file_finish(FileState *fs) {
+    CanonFileJob *job = fs->job;
+    uint64_t t0 = now_ns();
+
+    if (fs->parts) {
+        // Merge chunk bases in input order; derivations are absolute
+        job->basis = fs->parts[0];
+        for (uint32_t c = 1; c < fs->nchunks; c++) {
+            GF2_Basis *P = fs->parts[c];
+            for (uint32_t i = 0; i < P->rank; i++) {
+                add_to_basis(job->basis, P->basis[i], P->derivation[i]);
+            }
+            basis_free(P);
+        }
+        free(fs->parts);
+    }
+    job->basis->input_size = job->size;
+    atomic_fetch_add(&fs->compute_ns, now_ns() - t0);
+
+    job->compute_ns = atomic_load(&fs->compute_ns);
+    job->rank = job->basis->rank;
+    job->encoded = canon_encoded_size(job->basis);
+    canon_metrics_record(METRIC_COMPRESS, job->compute_ns, job->size, job->encoded);
+    if (job->output && !save_compressed(job->output, job->basis)) job->failed = true;
+
+    if (fs->data) canon_huge_unmap_file(fs->data, job->size);
+    if (!fs->cfg->keep_bases) {
+        basis_free(job->basis);
+        job->basis = NULL;
+    } else {
+        basis_trim(job->basis);
+    }
+    job->done_ns = now_ns();
+    free(fs);
+}
+
+/*
+ * Node whose memory holds this part of the mapping (-1: anywhere).
+ * Touching the first page faults it in: page-cache hits report where
+ * the cache already lives, cold reads land on the toucher's node.
+ */
+static int data_node(CanonPool *pool, const uint8_t *data) {
+    if (pool->nnodes == 1) return -1;
+    (void)*(volatile const uint8_t *)data;
+    return canon_numa_page_node(data);
+}
+
+static void chunk_task(CanonPool *pool, void *arg) {
+    ChunkTask *ct = arg;
+    FileState *fs = ct->file;
+    uint64_t chunk = fs->cfg->chunk;
+    uint64_t offset = (uint64_t)ct->index * chunk;
+    uint64_t len = fs->job->size - offset < chunk ? fs->job->size - offset : chunk;
+
+    uint64_t t0 = now_ns();
+    // Split parts are allocated here, on the node that owns the chunk
+    if (fs->parts && !fs->parts[ct->index]) fs->parts[ct->index] = basis_init();
+    GF2_Basis *B = fs->parts ? fs->parts[ct->index] : fs->job->basis;
+    canon_compress_block(B, fs->data + offset, len, offset);
+    canon_huge_drop(fs->data + offset, len);
+    atomic_fetch_add(&fs->compute_ns, now_ns() - t0);
+
+    if (fs->parts) {
+        // Whoever eliminates the last chunk merges
+        if (atomic_fetch_sub(&fs->remaining, 1) == 1) file_finish(fs);
+        free(ct);
+    } else if (ct->index + 1 < fs->nchunks) {
+        // Chain: the next chunk needs this basis; stay here unless its
+        // pages live on another node
+        ct->index++;
+        canon_pool_submit_node(pool, data_node(pool, fs->data + (uint64_t)ct->index * chunk),
+                               chunk_task, ct);
+    } else {
+        file_finish(fs);
+        free(ct);
+    }
+}
+
+static void file_task(CanonPool *pool, void *arg) {
+    FileState *fs = arg;
+    CanonFileJob *job = fs->job;
+    job->start_ns = now_ns();
+
+    int fd = open(job->input, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    bool opened = fd >= 0 && fstat(fd, &st) == 0;
+    if (!opened) perror(job->input);
+    if (!opened || !canon_input_fits(job->input, (uint64_t)st.st_size)) {
+        if (fd >= 0) close(fd);
+        job->failed = true;
+        job->done_ns = now_ns();
+        free(fs);
+        return;
+    }
+    job->size = (uint64_t)st.st_size;
+    if (job->size > 0) {
+        const uint8_t *p = canon_huge_map_file(fd, job->size);
+        if (!p) {
+            perror(job->input);
+            close(fd);
+            job->failed = true;
+            job->done_ns = now_ns();
+            free(fs);
+            return;
+        }
+        madvise((void *)p, job->size, MADV_SEQUENTIAL);
+        fs->data = p;
+    }
+    close(fd);
+
+    uint64_t chunk = fs->cfg->chunk;
+    fs->nchunks = job->size == 0 ? 1 : (uint32_t)((job->size + chunk - 1) / chunk);
+
+    if (fs->nchunks == 1) {
+        // Small file: one whole task, no chunk bookkeeping
+        uint64_t t0 = now_ns();
+        job->basis = basis_init();
+        canon_compress_block(job->basis, fs->data, job->size, 0);
+        atomic_store(&fs->compute_ns, now_ns() - t0);
+        file_finish(fs);
+        return;
+    }
+
+    if (fs->cfg->split) {
+        fs->parts = calloc(fs->nchunks, sizeof(GF2_Basis *));
+        atomic_store(&fs->remaining, fs->nchunks);
+        // Pushed last-first so the owner pops chunk 0 and thieves take the tail
+        for (uint32_t c = fs->nchunks; c-- > 0;) {
+            ChunkTask *ct = malloc(sizeof(ChunkTask));
+            ct->file = fs;
+            ct->index = c;
+            canon_pool_submit_node(pool, data_node(pool, fs->data + (uint64_t)c * chunk),
+                                   chunk_task, ct);
+        }
+    } else {
+        job->basis = basis_init();
+        ChunkTask *ct = malloc(sizeof(ChunkTask));
+        ct->file = fs;
+        ct->index = 0;
+        canon_pool_submit_node(pool, data_node(pool, fs->data), chunk_task, ct);
+    }
+}
+
+typedef struct {
+    CanonFileJob *job;
+    CanonCache *cache;
+    bool keep_bases;
+    uint64_t size;          // Size the hash was taken at
+} CacheProbe;
+
+/*
+ * Hash one input and serve it from the cache if possible
+ */
+static void cache_probe_task(CanonPool *pool, void *arg) {
+    (void)pool;
+    CacheProbe *cp = arg;
+    CanonFileJob *job = cp->job;
+    job->start_ns = now_ns();
+    if (!canon_cache_hash_file(job->input, &job->hash, &cp->size)) {
+        job->failed = true;
+        job->done_ns = now_ns();
+        return;
+    }
+    job->size = cp->size;
+    GF2_Basis *B = canon_cache_get(cp->cache, job->hash, cp->size);
+    if (!B) return;
+
+    job->cached = true;
+    job->rank = B->rank;
+    job->encoded = canon_encoded_size(B);
+    if (job->output && !save_compressed(job->output, B)) job->failed = true;
+    if (cp->keep_bases) {
+        job->basis = B;
+    } else {
+        basis_free(B);
+    }
+    job->done_ns = now_ns();
+}
+
+static int by_size_desc(const void *a, const void *b) {
+    uint64_t x = (*(CanonFileJob *const *)a)->size, y = (*(CanonFileJob *const *)b)->size;
+    return (x < y) - (x > y);
+}
+
+/*
+ * Compress n files on pool, largest first (jobs[i].size is used as a
+ * hint and overwritten with the real size). Returns the failure count.
+ */
+int canon_compress_files(CanonPool *pool, CanonFileJob *jobs, uint32_t n,
+                         const CanonFilesConfig *cfg) {
+    CanonFileJob **order = malloc((n + 1) * sizeof(CanonFileJob *));
+    uint32_t total = n, todo = n;
+    bool keep_bases = cfg->keep_bases;
+    for (uint32_t i = 0; i < n; i++) order[i] = &jobs[i];
+
+    // Cache: hash every input first; only misses are compressed, and
+    // their bases are kept until they have been stored
+    CanonFilesConfig run = *cfg;
+    CanonCache *cache = cfg->cache_dir ? canon_cache_open(cfg->cache_dir, cfg->cache_size) : NULL;
+    CacheProbe *probes = NULL;
+    if (cache) {
+        probes = malloc((n + 1) * sizeof(CacheProbe));
+        for (uint32_t i = 0; i < n; i++) {
+            probes[i] = (CacheProbe){ &jobs[i], cache, keep_bases, 0 };
+            canon_pool_submit(pool, cache_probe_task, &probes[i]);
+        }
+        canon_pool_wait(pool);
+        todo = 0;
+        for (uint32_t i = 0; i < n; i++) {
+            if (!jobs[i].cached && !jobs[i].failed) order[todo++] = &jobs[i];
+        }
+        run.keep_bases = true;
+        cfg = &run;
+    }
+    qsort(order, todo, sizeof(CanonFileJob *), by_size_desc);
+    n = todo;
+
+    if (cfg->io != CANON_IO_MMAP) {
+        canon_io_compress_files(pool, order, n, cfg);
+    } else {
+        // The injection list is LIFO: submit smallest first
+        for (uint32_t i = n; i-- > 0;) {
+            FileState *fs = calloc(1, sizeof(FileState));
+            fs->job = order[i];
+            fs->cfg = cfg;
+            canon_pool_submit(pool, file_task, fs);
+        }
+        canon_pool_wait(pool);
+    }
+
+    if (cache) {
+        for (uint32_t i = 0; i < n; i++) {
+            CanonFileJob *job = order[i];
+            if (!job->basis) continue;
+            // Skip inputs that changed size between hashing and compressing
+            if (!job->failed && probes[job - jobs].size == job->size) {
+                canon_cache_put(cache, job->hash, job->size, job->basis);
+            }
+            if (!keep_bases) {
+                basis_free(job->basis);
+                job->basis = NULL;
+            }
+        }
+        canon_cache_report(cache, stdout);
+        canon_cache_close(cache);
+        free(probes);
+    }
+    free(order);
+
+    int failed = 0;
+    for (uint32_t i = 0; i < total; i++) {
+        if (jobs[i].failed) failed++;
+    }
+    return failed;
+}
+
+/*
+ * Parse one option shared by the batch modes; false if argv[*i] is not one
+ */
+bool canon_files_option(CanonFilesConfig *cfg, int *threads, int argc, char **argv, int *i) {
+    const char *a = argv[*i];
+    bool has_value = *i + 1 < argc;
+    if (strcmp(a, "--threads") == 0 && has_value) {
+        *threads = (int)strtol(argv[++*i], NULL, 10);
+    } else if (strcmp(a, "--chunk") == 0 && has_value) {
+        // Page multiples, so finished chunks can be dropped from the mapping
+        cfg->chunk = strtoull(argv[++*i], NULL, 10) & ~4095ull;
+        if (cfg->chunk < 4096) cfg->chunk = 4096;
+    } else if (strcmp(a, "--split") == 0) {
+        cfg->split = true;
+    } else if (strcmp(a, "--pin") == 0) {
+        cfg->pin = true;
+    } else if (strcmp(a, "--hugepages") == 0 && has_value) {
+        if (!canon_huge_option(argv[++*i])) exit(1);
+    } else if (strcmp(a, "--cache") == 0 && has_value) {
+        cfg->cache_dir = argv[++*i];
+    } else if (strcmp(a, "--cache-size") == 0 && has_value) {
+        cfg->cache_size = strtoull(argv[++*i], NULL, 10);
+    } else if (strcmp(a, "--queue-depth") == 0 && has_value) {
+        cfg->queue_depth = (uint32_t)strtoul(argv[++*i], NULL, 10);
+        if (cfg->queue_depth < 2) cfg->queue_depth = 2;
+    } else if (strcmp(a, "--io") == 0 && has_value) {
+        const char *v = argv[++*i];
+        if (strcmp(v, "mmap") == 0) {
+            cfg->io = CANON_IO_MMAP;
+        } else if (strcmp(v, "uring") == 0) {
+            cfg->io = CANON_IO_URING;
+        } else if (strcmp(v, "threads") == 0) {
+            cfg->io = CANON_IO_THREADS;
+        } else {
+            fprintf(stderr, "Error: Unknown I/O backend '%s' (mmap, uring, threads)\n", v);
+            exit(1);
+        }
+    } else {
+        return false;
+    }
+    return true;
+}
+
+/*
+ * `canon compress-many <input>... [--threads N] [--chunk BYTES] [--split]
+ *  [--io mmap|uring|threads] [--queue-depth N] [--pin]
+ *  [--hugepages off|thp|hugetlb] [--cache DIR [--cache-size BYTES]]`
+ */
+int canon_compress_many_main(int argc, char **argv) {
+    CanonFilesConfig cfg = CANON_FILES_DEFAULTS;
+    int threads = 0;
+
+    CanonFileJob *jobs = calloc(argc, sizeof(CanonFileJob));
+    uint32_t n = 0;
+    for (int i = 1; i < argc; i++) {
+        if (canon_files_option(&cfg, &threads, argc, argv, &i)) {
+            continue;
+        } else if (strncmp(argv[i], "--", 2) == 0) {
+            fprintf(stderr, "Error: Unknown option '%s'\n", argv[i]);
+            free(jobs);
+            return 1;
+        } else {
+            jobs[n].input = argv[i];
+            n++;
+        }
+    }
+    if (n == 0) {
+        fprintf(stderr, "Usage: canon compress-many <input>... [--threads N] [--chunk BYTES] [--split]\n"
+                        "       [--io mmap|uring|threads] [--queue-depth N] [--pin]\n"
+                        "       [--hugepages off|thp|hugetlb] [--cache DIR [--cache-size BYTES]]\n");
+        free(jobs);
+        return 1;
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        struct stat st;
+        if (stat(jobs[i].input, &st) == 0) jobs[i].size = (uint64_t)st.st_size;
+        size_t len = strlen(jobs[i].input) + 7;
+        char *out = malloc(len);
+        snprintf(out, len, "%s.canon", jobs[i].input);
+        jobs[i].output = out;
+    }
+
+    CanonPool *pool = canon_pool_create(threads, cfg.pin ? CANON_POOL_PIN : 0);
+    if (!pool) {
+        for (uint32_t i = 0; i < n; i++) free((char *)jobs[i].output);
+        free(jobs);
+        return 1;
+    }
+    printf("Compressing %u file(s) on %d worker(s), %lu-byte chunks%s\n\n",
+           n, pool->nworkers, cfg.chunk, cfg.split ? ", split" : "");
+    fflush(stdout);
+
+    uint64_t t0 = now_ns();
+    int failed = canon_compress_files(pool, jobs, n, &cfg);
+    double sec = (now_ns() - t0) / 1e9;
+
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        CanonFileJob *j = &jobs[i];
+        if (j->failed) {
+            printf("✗ %s\n", j->input);
+            continue;
+        }
+        printf("✓ %s -> %s: %lu bytes, rank %u, %.1f ms%s\n",
+               j->input, j->output, j->size, j->rank, j->compute_ns / 1e6,
+               j->cached ? " (cached)" : "");
+        total += j->size;
+    }
+
+    printf("\nTotal: %lu bytes in %.3f seconds (%.2f MB/s), %d failed\n",
+           total, sec, sec > 0 ? total / 1048576.0 / sec : 0.0, failed);
+    canon_pool_report(pool, stdout);
+    canon_huge_report(stdout);
+    canon_pool_destroy(pool);
+
+    for (uint32_t i = 0; i < n; i++) free((char *)jobs[i].output);
+    free(jobs);
+    return failed ? 1 : 0;
+}
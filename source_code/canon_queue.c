@@ -0,0 +1,479 @@
+/*
+ * CANON - Priority- and deadline-aware job queue
+ *
+ * Author: Francesco Pedulli
+ * Date: February 26, 2026
+ *
+ * `canon queue <joblist>` runs many jobs on one shared worker pool.
+ * Each line of the job list is
+ *
+ *   <class> <deadline_ms|-> <compress|decompress> <input> [output]
+ *
+ * with class interactive (0), normal (1) or bulk (2) and a deadline
+ * relative to the job's arrival. The list is read by a feeder thread as
+ * lines arrive, so `-` (stdin) or a FIFO turns the queue into a live
+ * submission channel. Workers always pick the pending job with the
+ * best key (effective class, then earliest deadline, then list order).
+ * Compress jobs run in --block sized pieces; at every block boundary
+ * the worker requeues its job if a strictly better one is waiting, so
+ * a restore never sits behind a multi-GB archive. Progress (basis and
+ * offset) travels with the job, and a job's effective class improves
+ * by one level per --aging-ms of waiting, so bulk work cannot starve.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <ctype.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "canon.h"
+
+#define QUEUE_CLASSES 3
+#define QUEUE_NO_DEADLINE UINT64_MAX
+
+static const char *class_names[QUEUE_CLASSES] = { "interactive", "normal", "bulk" };
+
+typedef struct {
+    // From the job list
+    int cls;
+    uint64_t deadline_ns;   // Absolute monotonic, or QUEUE_NO_DEADLINE
+    bool decompress;
+    char *input;
+    char *output;
+    uint32_t seq;           // List order, final tie-break
+
+    // Progress, carried across preemptions
+    bool started;
+    const uint8_t *data;    // mmap'd input
+    uint64_t size;
+    uint64_t offset;
+    GF2_Basis *basis;
+    uint64_t submit_ns;
+    uint64_t enqueued_ns;   // Last submit or requeue: aging counts from here
+    int level;              // Class after aging, frozen while the job runs
+    bool running;
+    uint64_t first_run_ns;
+    uint64_t run_ns;
+    uint32_t preemptions;
+
+    // Outcome
+    bool failed;
+    uint64_t done_ns;
+} QueueJob;
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    QueueJob **pending;     // Unordered; picks scan for the best key
+    uint32_t npending;
+    QueueJob **all;         // Every job in list order, for the report
+    uint32_t njobs, cap;
+    bool feeding;           // Feeder has not reached end of list
+    bool parse_error;
+    uint64_t block;
+    uint64_t aging_ns;
+    uint64_t preemptions;
+} JobQueue;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/*
+ * Class after aging: only time spent waiting counts, so a running job
+ * keeps the level it was picked at and a requeued one ages on from there
+ */
+static int effective_class(const JobQueue *q, const QueueJob *j, uint64_t now) {
+    if (q->aging_ns == 0 || j->running) return j->level;
+    uint64_t boost = (now - j->enqueued_ns) / q->aging_ns;
+    return boost >= (uint64_t)j->level ? 0 : j->level - (int)boost;
+}
+
+/*
+ * Scheduling order: class, then deadline (EDF); ties is list order
+ * when with_seq, otherwise equal keys compare as 0 (no preemption)
+ */
+static int job_cmp(const JobQueue *q, const QueueJob *a, const QueueJob *b,
+                   uint64_t now, bool with_seq) {
+    int ca = effective_class(q, a, now), cb = effective_class(q, b, now);
+    if (ca != cb) return ca < cb ? -1 : 1;
+    if (a->deadline_ns != b->deadline_ns) return a->deadline_ns < b->deadline_ns ? -1 : 1;
+    if (!with_seq) return 0;
+    return a->seq < b->seq ? -1 : (a->seq > b->seq);
+}
+
+static uint32_t best_pending(const JobQueue *q, uint64_t now) {
+    uint32_t best = 0;
+    for (uint32_t i = 1; i < q->npending; i++) {
+        if (job_cmp(q, q->pending[i], q->pending[best], now, true) < 0) best = i;
+    }
+    return best;
+}
+
+static QueueJob* take_pending(JobQueue *q, uint32_t i) {
+    QueueJob *j = q->pending[i];
+    q->pending[i] = q->pending[--q->npending];
+    return j;
+}
+
+static bool job_start(QueueJob *j) {
+    j->started = true;
+    j->first_run_ns = now_ns();
+    if (j->decompress) return true;
+
+    int fd = open(j->input, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    bool opened = fd >= 0 && fstat(fd, &st) == 0;
+    if (!opened) perror(j->input);
+    if (!opened || !canon_input_fits(j->input, (uint64_t)st.st_size)) {
+        if (fd >= 0) close(fd);
+        return false;
+    }
+    j->size = (uint64_t)st.st_size;
+    if (j->size > 0) {
+        // Mapped, not read: preempted jobs do not pin their whole input
+        void *p = mmap(NULL, j->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED) {
+            perror(j->input);
+            close(fd);
+            return false;
+        }
+        madvise(p, j->size, MADV_SEQUENTIAL);
+        j->data = p;
+    }
+    close(fd);
+    j->basis = basis_init();
+    return true;
+}
+
+static bool job_finish(QueueJob *j) {
+    if (j->decompress) {
+        GF2_Basis *B = load_compressed(j->input);
+        if (!B) return false;
+        uint64_t out_size;
+        uint8_t *out = canon_decompress(B, &out_size);
+        FILE *f = fopen(j->output, "wb");
+        bool ok = f && fwrite(out, 1, out_size, f) == out_size;
+        if (f && fclose(f) != 0) ok = false;
+        free(out);
+        basis_free(B);
+        return ok;
+    }
+
+    canon_metrics_record(METRIC_COMPRESS, j->run_ns, j->size, canon_encoded_size(j->basis));
+    bool ok = save_compressed(j->output, j->basis);
+    if (j->data) munmap((void *)j->data, j->size);
+    j->data = NULL;
+    basis_free(j->basis);
+    j->basis = NULL;
+    return ok;
+}
+
+/*
+ * Worker: run the best job block by block, yielding it back to the
+ * queue whenever a strictly better job is waiting
+ */
+static void* queue_worker(void *arg) {
+    JobQueue *q = arg;
+
+    pthread_mutex_lock(&q->lock);
+    for (;;) {
+        while (q->npending == 0 && q->feeding) pthread_cond_wait(&q->wake, &q->lock);
+        if (q->npending == 0) break;
+
+        uint64_t now = now_ns();
+        QueueJob *j = take_pending(q, best_pending(q, now));
+        j->level = effective_class(q, j, now);
+        j->running = true;
+        pthread_mutex_unlock(&q->lock);
+
+        bool finished = false;
+        if (!j->started && !job_start(j)) {
+            j->failed = true;
+            finished = true;
+        }
+
+        while (!finished) {
+            if (j->decompress || j->offset >= j->size) {
+                uint64_t t0 = now_ns();
+                if (!job_finish(j)) j->failed = true;
+                j->run_ns += now_ns() - t0;
+                finished = true;
+                break;
+            }
+
+            uint64_t len = j->size - j->offset < q->block ? j->size - j->offset : q->block;
+            uint64_t t0 = now_ns();
+            canon_compress_block(j->basis, j->data + j->offset, len, j->offset);
+            madvise((void *)(j->data + (j->offset & ~(uint64_t)4095)),
+                    len + (j->offset & 4095), MADV_DONTNEED);
+            j->offset += len;
+            j->run_ns += now_ns() - t0;
+
+            // Block boundary: yield to a strictly better waiting job
+            if (j->offset < j->size) {
+                pthread_mutex_lock(&q->lock);
+                uint64_t now = now_ns();
+                if (q->npending > 0 &&
+                    job_cmp(q, q->pending[best_pending(q, now)], j, now, false) < 0) {
+                    j->preemptions++;
+                    q->preemptions++;
+                    j->running = false;
+                    j->enqueued_ns = now;
+                    q->pending[q->npending++] = j;
+                    pthread_cond_signal(&q->wake);
+                    pthread_mutex_unlock(&q->lock);
+                    j = NULL;
+                    break;
+                }
+                pthread_mutex_unlock(&q->lock);
+            }
+        }
+
+        if (finished) j->done_ns = now_ns();
+        pthread_mutex_lock(&q->lock);
+    }
+    pthread_mutex_unlock(&q->lock);
+    return NULL;
+}
+
+static int parse_class(const char *s) {
+    for (int c = 0; c < QUEUE_CLASSES; c++) {
+        if (strcmp(s, class_names[c]) == 0) return c;
+    }
+    if (isdigit((unsigned char)s[0]) && s[1] == '\0' && s[0] - '0' < QUEUE_CLASSES) {
+        return s[0] - '0';
+    }
+    return -1;
+}
+
+/*
+ * Parse one job line; returns NULL (and reports) on a malformed line
+ */
+static QueueJob* parse_job(const char *path, int lineno, char *line, uint32_t seq) {
+    char *hash = strchr(line, '#');
+    if (hash) *hash = '\0';
+
+    char cls[32], deadline[32], mode[32], input[4096], output[4096] = "";
+    int fields = sscanf(line, "%31s %31s %31s %4095s %4095s",
+                        cls, deadline, mode, input, output);
+    if (fields < 4) {
+        fprintf(stderr, "Error: %s:%d: expected <class> <deadline_ms|-> <mode> <input> [output]\n",
+                path, lineno);
+        return NULL;
+    }
+
+    QueueJob *j = calloc(1, sizeof(QueueJob));
+    j->cls = parse_class(cls);
+    if (j->cls < 0) {
+        fprintf(stderr, "Error: %s:%d: unknown class '%s'\n", path, lineno, cls);
+        free(j);
+        return NULL;
+    }
+    if (strcmp(mode, "compress") == 0) {
+        j->decompress = false;
+    } else if (strcmp(mode, "decompress") == 0) {
+        j->decompress = true;
+    } else {
+        fprintf(stderr, "Error: %s:%d: unknown mode '%s'\n", path, lineno, mode);
+        free(j);
+        return NULL;
+    }
+
+    j->submit_ns = now_ns();
+    j->enqueued_ns = j->submit_ns;
+    j->level = j->cls;
+    j->deadline_ns = strcmp(deadline, "-") == 0
+                         ? QUEUE_NO_DEADLINE
+                         : j->submit_ns + strtoull(deadline, NULL, 10) * 1000000ull;
+    j->input = strdup(input);
+    if (fields == 5) {
+        j->output = strdup(output);
+    } else {
+        size_t len = strlen(input) + 8;
+        j->output = malloc(len);
+        snprintf(j->output, len, "%s%s", input, j->decompress ? ".out" : ".canon");
+    }
+    j->seq = seq;
+    return j;
+}
+
+typedef struct {
+    JobQueue *q;
+    FILE *f;
+    const char *path;
+} QueueFeeder;
+
+/*
+ * Feeder: submit jobs as lines arrive, stop at end of list
+ */
+static void* queue_feeder(void *arg) {
+    QueueFeeder *fd = arg;
+    JobQueue *q = fd->q;
+    char line[8192];
+    int lineno = 0;
+
+    while (fgets(line, sizeof(line), fd->f)) {
+        lineno++;
+        char *p = line;
+        while (isspace((unsigned char)*p)) p++;
+        if (*p == '\0' || *p == '#') continue;
+
+        QueueJob *j = parse_job(fd->path, lineno, line, q->njobs);
+        pthread_mutex_lock(&q->lock);
+        if (!j) {
+            q->parse_error = true;
+            pthread_mutex_unlock(&q->lock);
+            continue;
+        }
+        if (q->njobs == q->cap) {
+            q->cap = q->cap ? q->cap * 2 : 64;
+            q->all = realloc(q->all, q->cap * sizeof(QueueJob *));
+            q->pending = realloc(q->pending, q->cap * sizeof(QueueJob *));
+        }
+        q->all[q->njobs++] = j;
+        q->pending[q->npending++] = j;
+        pthread_cond_signal(&q->wake);
+        pthread_mutex_unlock(&q->lock);
+    }
+
+    pthread_mutex_lock(&q->lock);
+    q->feeding = false;
+    pthread_cond_broadcast(&q->wake);
+    pthread_mutex_unlock(&q->lock);
+    return NULL;
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+/*
+ * `canon queue <joblist|-> [--threads N] [--block BYTES] [--aging-ms MS]`
+ */
+int canon_queue_main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: canon queue <joblist|-> [--threads N] [--block BYTES] [--aging-ms MS]\n");
+        return 1;
+    }
+
+    JobQueue q;
+    memset(&q, 0, sizeof(q));
+    q.block = CANON_BLOCK_SIZE;
+    q.aging_ns = 30000ull * 1000000ull;
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threads = strtol(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--block") == 0 && i + 1 < argc) {
+            q.block = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--aging-ms") == 0 && i + 1 < argc) {
+            q.aging_ns = strtoull(argv[++i], NULL, 10) * 1000000ull;
+        } else {
+            fprintf(stderr, "Error: Unknown option '%s'\n", argv[i]);
+            return 1;
+        }
+    }
+    if (threads < 1) threads = 1;
+    if (q.block < 4096) q.block = 4096;
+
+    FILE *list = strcmp(argv[1], "-") == 0 ? stdin : fopen(argv[1], "r");
+    if (!list) {
+        perror("Error opening job list");
+        return 1;
+    }
+
+    uint64_t start = now_ns();
+    q.feeding = true;
+    pthread_mutex_init(&q.lock, NULL);
+    pthread_cond_init(&q.wake, NULL);
+
+    printf("Queue: %s, %ld worker(s), %lu-byte blocks\n\n", argv[1], threads, q.block);
+    fflush(stdout);
+
+    // Workers first: without them the list is never read
+    pthread_t *pool = malloc(threads * sizeof(pthread_t));
+    long started = 0;
+    while (started < threads && pthread_create(&pool[started], NULL, queue_worker, &q) == 0) started++;
+    if (started < threads) {
+        fprintf(stderr, "Error: Cannot start queue workers (%ld of %ld running)\n", started, threads);
+    }
+
+    QueueFeeder feeder = { &q, list, argv[1] };
+    pthread_t feeder_thread;
+    bool fed = started > 0 && pthread_create(&feeder_thread, NULL, queue_feeder, &feeder) == 0;
+    if (started > 0 && !fed) {
+        fprintf(stderr, "Error: Cannot start queue feeder\n");
+        pthread_mutex_lock(&q.lock);
+        q.feeding = false;
+        pthread_cond_broadcast(&q.wake);
+        pthread_mutex_unlock(&q.lock);
+    }
+    for (long i = 0; i < started; i++) pthread_join(pool[i], NULL);
+    if (list != stdin) fclose(list);
+    if (!fed) {
+        free(pool);
+        pthread_mutex_destroy(&q.lock);
+        pthread_cond_destroy(&q.wake);
+        return 1;
+    }
+    pthread_join(feeder_thread, NULL);
+    double sec = (now_ns() - start) / 1e9;
+    int njobs = (int)q.njobs;
+
+    // Per-job report, then per-class latency and deadline summary
+    uint64_t *lat[QUEUE_CLASSES];
+    uint32_t count[QUEUE_CLASSES] = {0}, missed[QUEUE_CLASSES] = {0};
+    int failed = 0;
+    for (int c = 0; c < QUEUE_CLASSES; c++) lat[c] = malloc((njobs + 1) * sizeof(uint64_t));
+
+    for (int i = 0; i < njobs; i++) {
+        QueueJob *j = q.all[i];
+        uint64_t latency = j->done_ns - j->submit_ns;
+        bool late = j->deadline_ns != QUEUE_NO_DEADLINE && j->done_ns > j->deadline_ns;
+
+        printf("%s %-11s %s -> %s: wait %.1f ms, run %.1f ms, %u preemption(s)%s\n",
+               j->failed ? "✗" : "✓", class_names[j->cls], j->input, j->output,
+               (j->first_run_ns - j->submit_ns) / 1e6, j->run_ns / 1e6, j->preemptions,
+               late ? ", DEADLINE MISSED" : "");
+
+        lat[j->cls][count[j->cls]++] = latency;
+        if (late) missed[j->cls]++;
+        if (j->failed) failed++;
+    }
+
+    printf("\n");
+    for (int c = 0; c < QUEUE_CLASSES; c++) {
+        if (count[c] == 0) continue;
+        qsort(lat[c], count[c], sizeof(uint64_t), cmp_u64);
+        printf("%-11s %u job(s), completion p50 %.1f ms, p99 %.1f ms, %u deadline(s) missed\n",
+               class_names[c], count[c], lat[c][count[c] / 2] / 1e6,
+               lat[c][(count[c] * 99) / 100] / 1e6, missed[c]);
+    }
+    printf("Total: %.3f seconds, %lu preemption(s), %d failed\n", sec, q.preemptions, failed);
+
+    for (int c = 0; c < QUEUE_CLASSES; c++) free(lat[c]);
+    for (int i = 0; i < njobs; i++) {
+        free(q.all[i]->input);
+        free(q.all[i]->output);
+        free(q.all[i]);
+    }
+    free(q.all);
+    free(pool);
+    free(q.pending);
+    return (failed || q.parse_error) ? 1 : 0;
+}
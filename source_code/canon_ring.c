@@ -0,0 +1,829 @@
+/*
+ * CANON - Shared-memory ring ingestion for co-located producers
+ *
+ * Author: Francesco Pedulli
+ * Date: February 26, 2026
+ *
+ * `canon ring <socket>` creates one memfd-backed region holding a pool
+ * of payload slots and three kinds of lock-free queues of slot indices:
+ *
+ *   free queue        producers pop an empty slot, write payload in place
+ *   submit queue      producers push filled slots, engine workers pop
+ *   completion queues one per producer, engine pushes finished slots
+ *
+ * The engine compresses directly on the slot memory and encodes the
+ * result back into the same slot, so payloads are never copied. The
+ * Unix socket is only used once per producer to hand over the memfd;
+ * after that, submit/complete are plain atomics with no syscalls.
+ *
+ * Queues are bounded MPMC arrays with per-cell sequence numbers
+ * (Vyukov), so any number of producers and workers can share them.
+ *
+ * Producer ids are handed out by the engine along with the memfd, and
+ * the engine keeps a pidfd for each producer process. When one exits
+ * without detaching, its id is freed and every slot it held is returned
+ * to the free queue. Each id has a generation, bumped whenever the id
+ * changes hands. Completions still in flight for an earlier holder are
+ * recycled rather than delivered to the next one.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <time.h>
+#include <signal.h>
+#include <sched.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#include "canon.h"
+
+#define RING_MAGIC 0x474E4952414E4143ull // "CANARING"
+#define RING_MAX_PRODUCERS 64
+#define RING_DEFAULT_SLOTS 256
+#define RING_DEFAULT_SLOT_SIZE (1u << 20)
+#define RING_ALIGN 64
+
+#define SLOT_FREE 0     // In the free queue
+#define SLOT_HELD 1     // With its producer: being filled, or result being read
+#define SLOT_QUEUED 2   // Submitted: in the engine or a completion queue
+
+/*
+ * Bounded MPMC queue of slot indices (lives in the shared region)
+ */
+typedef struct {
+    _Atomic uint64_t seq;
+    uint64_t value;
+} RingCell;
+
+typedef struct {
+    _Alignas(RING_ALIGN) _Atomic uint64_t enqueue_pos;
+    _Alignas(RING_ALIGN) _Atomic uint64_t dequeue_pos;
+    _Alignas(RING_ALIGN) uint64_t mask;
+    uint64_t cells_offset;  // From region base
+} RingQueue;
+
+/*
+ * Per-slot descriptor: request in, result out
+ */
+typedef struct {
+    uint64_t size;        // Payload bytes (in), result bytes (out)
+    uint64_t tag;         // Opaque producer cookie
+    uint64_t elapsed_ns;  // Engine processing time
+    uint32_t producer;
+    int32_t status;       // SERVE_STATUS_*
+    uint32_t rank;
+    uint32_t gen;         // Generation of the producer id that holds the slot
+    _Atomic uint32_t state; // SLOT_*
+    uint32_t reserved;
+} RingSlot;
+
+/*
+ * Region header, at offset 0 of the memfd
+ */
+typedef struct {
+    uint64_t magic;
+    uint32_t nslots;
+    uint32_t slot_size;
+    uint64_t region_size;
+    uint64_t slots_offset;  // RingSlot[nslots]
+    uint64_t data_offset;   // nslots * slot_size payload bytes
+    _Atomic uint32_t running;
+    _Atomic uint64_t producers;  // Bitmap of attached producer ids
+    _Atomic uint32_t gen[RING_MAX_PRODUCERS];  // Bumped whenever the id changes hands
+    RingQueue free_q;
+    RingQueue submit_q;
+    RingQueue done_q[RING_MAX_PRODUCERS];
+} RingHeader;
+
+struct RingProducer {
+    uint8_t *base;
+    RingHeader *hdr;
+    uint32_t id;
+    uint32_t gen;
+};
+
+/*
+ * Attach reply: the producer id and its generation (id
+ * RING_MAX_PRODUCERS and no memfd when every id is taken)
+ */
+typedef struct {
+    uint32_t id;
+    uint32_t gen;
+} RingGrant;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static inline void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_pause();
+#endif
+}
+
+/*
+ * Idle backoff: spin first, yield the CPU only once the queue stays
+ * empty, so a busy ring never enters the kernel
+ */
+static void ring_backoff(uint32_t *idle) {
+    uint32_t n = (*idle)++;
+    if (n < 1024) {
+        cpu_relax();
+    } else if (n < 2048) {
+        sched_yield();
+    } else {
+        struct timespec ts = { 0, 50000 };
+        nanosleep(&ts, NULL);
+    }
+}
+
+static uint64_t align_up(uint64_t x) {
+    return (x + RING_ALIGN - 1) & ~(uint64_t)(RING_ALIGN - 1);
+}
+
+static void queue_init(uint8_t *base, RingQueue *q, uint64_t offset, uint32_t capacity) {
+    RingCell *cells = (RingCell *)(base + offset);
+    for (uint64_t i = 0; i < capacity; i++) atomic_init(&cells[i].seq, i);
+    atomic_init(&q->enqueue_pos, 0);
+    atomic_init(&q->dequeue_pos, 0);
+    q->mask = capacity - 1;
+    q->cells_offset = offset;
+}
+
+static bool queue_push(uint8_t *base, RingQueue *q, uint64_t value) {
+    RingCell *cells = (RingCell *)(base + q->cells_offset);
+    uint64_t pos = atomic_load_explicit(&q->enqueue_pos, memory_order_relaxed);
+
+    for (;;) {
+        RingCell *c = &cells[pos & q->mask];
+        uint64_t seq = atomic_load_explicit(&c->seq, memory_order_acquire);
+        int64_t diff = (int64_t)seq - (int64_t)pos;
+
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&q->enqueue_pos, &pos, pos + 1,
+                                                      memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                c->value = value;
+                atomic_store_explicit(&c->seq, pos + 1, memory_order_release);
+                return true;
+            }
+        } else if (diff < 0) {
+            return false;  // Full
+        } else {
+            pos = atomic_load_explicit(&q->enqueue_pos, memory_order_relaxed);
+        }
+    }
+}
+
+static bool queue_pop(uint8_t *base, RingQueue *q, uint64_t *value) {
+    RingCell *cells = (RingCell *)(base + q->cells_offset);
+    uint64_t pos = atomic_load_explicit(&q->dequeue_pos, memory_order_relaxed);
+
+    for (;;) {
+        RingCell *c = &cells[pos & q->mask];
+        uint64_t seq = atomic_load_explicit(&c->seq, memory_order_acquire);
+        int64_t diff = (int64_t)seq - (int64_t)(pos + 1);
+
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&q->dequeue_pos, &pos, pos + 1,
+                                                      memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                *value = c->value;
+                atomic_store_explicit(&c->seq, pos + q->mask + 1, memory_order_release);
+                return true;
+            }
+        } else if (diff < 0) {
+            return false;  // Empty
+        } else {
+            pos = atomic_load_explicit(&q->dequeue_pos, memory_order_relaxed);
+        }
+    }
+}
+
+static RingSlot* ring_slot(uint8_t *base, RingHeader *hdr, uint32_t slot) {
+    return (RingSlot *)(base + hdr->slots_offset) + slot;
+}
+
+static uint8_t* ring_data(uint8_t *base, RingHeader *hdr, uint32_t slot) {
+    return base + hdr->data_offset + (uint64_t)slot * hdr->slot_size;
+}
+
+/*
+ * Return a slot to the free queue (which has room for every slot)
+ */
+static void ring_recycle(uint8_t *base, RingHeader *hdr, uint32_t slot) {
+    atomic_store_explicit(&ring_slot(base, hdr, slot)->state, SLOT_FREE, memory_order_relaxed);
+    queue_push(base, &hdr->free_q, slot);
+}
+
+/*
+ * Take producer id away from its current holder
+ * Bumps the generation, so the engine recycles the holder's in-flight
+ * slots instead of completing them, then frees its completed and held
+ * slots. Only safe once the holder can no longer touch the ring.
+ * Returns the number of slots freed.
+ */
+static uint32_t ring_reclaim(uint8_t *base, RingHeader *hdr, uint32_t id) {
+    uint32_t old = atomic_fetch_add(&hdr->gen[id], 1);
+    uint32_t freed = 0;
+    uint64_t slot;
+    while (queue_pop(base, &hdr->done_q[id], &slot)) {
+        ring_recycle(base, hdr, (uint32_t)slot);
+        freed++;
+    }
+    for (uint32_t i = 0; i < hdr->nslots; i++) {
+        RingSlot *s = ring_slot(base, hdr, i);
+        if (atomic_load(&s->state) == SLOT_HELD && s->producer == id && s->gen == old) {
+            ring_recycle(base, hdr, i);
+            freed++;
+        }
+    }
+    return freed;
+}
+
+/*
+ * Create and lay out the shared region
+ */
+static uint8_t* ring_create(uint32_t nslots, uint32_t slot_size, int *fd_out) {
+    uint64_t off = align_up(sizeof(RingHeader));
+    uint64_t cells = off;
+    off = align_up(off + (uint64_t)(2 + RING_MAX_PRODUCERS) * nslots * sizeof(RingCell));
+    uint64_t slots = off;
+    off = align_up(off + (uint64_t)nslots * sizeof(RingSlot));
+    uint64_t data = off;
+    uint64_t size = data + (uint64_t)nslots * slot_size;
+
+    int fd = memfd_create("canon-ring", MFD_CLOEXEC);
+    if (fd < 0) {
+        perror("Error creating memfd");
+        return NULL;
+    }
+    if (ftruncate(fd, (off_t)size) < 0) {
+        perror("Error sizing ring region");
+        close(fd);
+        return NULL;
+    }
+    uint8_t *base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        perror("Error mapping ring region");
+        close(fd);
+        return NULL;
+    }
+
+    RingHeader *hdr = (RingHeader *)base;
+    hdr->nslots = nslots;
+    hdr->slot_size = slot_size;
+    hdr->region_size = size;
+    hdr->slots_offset = slots;
+    hdr->data_offset = data;
+    atomic_init(&hdr->running, 1);
+    atomic_init(&hdr->producers, 0);
+
+    uint64_t qbytes = (uint64_t)nslots * sizeof(RingCell);
+    queue_init(base, &hdr->free_q, cells, nslots);
+    queue_init(base, &hdr->submit_q, cells + qbytes, nslots);
+    for (int p = 0; p < RING_MAX_PRODUCERS; p++) {
+        atomic_init(&hdr->gen[p], 0);
+        queue_init(base, &hdr->done_q[p], cells + (2 + p) * qbytes, nslots);
+    }
+    for (uint32_t s = 0; s < nslots; s++) queue_push(base, &hdr->free_q, s);
+
+    // Publish the header last; producers check the magic
+    atomic_thread_fence(memory_order_release);
+    hdr->magic = RING_MAGIC;
+
+    *fd_out = fd;
+    return base;
+}
+
+typedef struct {
+    uint8_t *base;
+    pthread_t thread;
+    GF2_Basis *basis;    // Pooled context, reset per slot
+    uint64_t processed;
+} RingWorker;
+
+/*
+ * Engine worker: pop a slot, compress in place, post completion
+ */
+static void* ring_worker(void *arg) {
+    RingWorker *w = arg;
+    RingHeader *hdr = (RingHeader *)w->base;
+    uint32_t idle = 0;
+
+    while (atomic_load_explicit(&hdr->running, memory_order_relaxed)) {
+        uint64_t slot;
+        if (!queue_pop(w->base, &hdr->submit_q, &slot)) {
+            ring_backoff(&idle);
+            continue;
+        }
+        idle = 0;
+
+        RingSlot *s = ring_slot(w->base, hdr, (uint32_t)slot);
+        uint8_t *data = ring_data(w->base, hdr, (uint32_t)slot);
+        uint64_t start = now_ns();
+        uint64_t payload = s->size;
+
+        if (s->size > hdr->slot_size || s->producer >= RING_MAX_PRODUCERS) {
+            s->status = SERVE_STATUS_BAD_REQUEST;
+            s->rank = 0;
+            s->size = 0;
+        } else {
+            basis_reset(w->basis);
+            canon_compress_block(w->basis, data, s->size, 0);
+            s->rank = w->basis->rank;
+
+            // Payload is consumed: the result overwrites it in place
+            if (canon_encoded_size(w->basis) <= hdr->slot_size) {
+                s->size = canon_encode(w->basis, data);
+                s->status = SERVE_STATUS_OK;
+            } else {
+                s->size = 0;
+                s->status = SERVE_STATUS_TOO_LARGE;
+            }
+        }
+        s->elapsed_ns = now_ns() - start;
+        w->processed++;
+        if (s->status == SERVE_STATUS_OK) {
+            canon_metrics_record(METRIC_COMPRESS, s->elapsed_ns, payload, s->size);
+        }
+
+        // Queue push has release semantics; slot writes are visible first
+        uint32_t id = s->producer;
+        if (id < RING_MAX_PRODUCERS && s->gen == atomic_load(&hdr->gen[id])) {
+            while (!queue_push(w->base, &hdr->done_q[id], slot)) cpu_relax();
+        } else {
+            ring_recycle(w->base, hdr, (uint32_t)slot);  // Its producer is gone
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Hand the memfd (SCM_RIGHTS) and a producer id to one connecting producer
+ */
+static void ring_send_fd(int conn, int memfd, RingGrant grant) {
+    struct iovec iov = { &grant, sizeof(grant) };
+    union {
+        char buf[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } ctrl;
+    memset(&ctrl, 0, sizeof(ctrl));
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    if (grant.id < RING_MAX_PRODUCERS) {
+        msg.msg_control = ctrl.buf;
+        msg.msg_controllen = sizeof(ctrl.buf);
+
+        struct cmsghdr *cm = CMSG_FIRSTHDR(&msg);
+        cm->cmsg_level = SOL_SOCKET;
+        cm->cmsg_type = SCM_RIGHTS;
+        cm->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cm), &memfd, sizeof(int));
+    }
+
+    sendmsg(conn, &msg, MSG_NOSIGNAL);
+}
+
+typedef struct {
+    int listen_fd;
+    int memfd;
+    uint8_t *base;
+    int pidfd[RING_MAX_PRODUCERS];  // Process holding each id; -1 = not watched
+} RingAcceptor;
+
+/*
+ * Give the lowest free id to the producer on conn and watch its process
+ */
+static void ring_assign(RingAcceptor *a, int conn) {
+    RingHeader *hdr = (RingHeader *)a->base;
+    RingGrant grant = { RING_MAX_PRODUCERS, 0 };
+    uint64_t used = atomic_load(&hdr->producers);
+    if (used != UINT64_MAX) {
+        uint32_t id = (uint32_t)__builtin_ctzll(~used);
+        // The previous holder detached; whatever it left behind is freed
+        if (a->pidfd[id] >= 0) close(a->pidfd[id]);
+        ring_reclaim(a->base, hdr, id);
+
+        struct ucred cred;
+        socklen_t len = sizeof(cred);
+        a->pidfd[id] = getsockopt(conn, SOL_SOCKET, SO_PEERCRED, &cred, &len) == 0
+                           ? (int)syscall(SYS_pidfd_open, cred.pid, 0) : -1;
+        atomic_fetch_or(&hdr->producers, 1ull << id);
+        grant = (RingGrant){ id, atomic_load(&hdr->gen[id]) };
+    }
+    ring_send_fd(conn, a->memfd, grant);
+}
+
+/*
+ * Accept producers; reclaim the ids of those that exit attached
+ */
+static void* ring_acceptor(void *arg) {
+    RingAcceptor *a = arg;
+    RingHeader *hdr = (RingHeader *)a->base;
+    for (;;) {
+        struct pollfd fds[1 + RING_MAX_PRODUCERS];
+        uint32_t ids[1 + RING_MAX_PRODUCERS];
+        nfds_t n = 0;
+        fds[n++] = (struct pollfd){ a->listen_fd, POLLIN, 0 };
+        for (uint32_t id = 0; id < RING_MAX_PRODUCERS; id++) {
+            if (a->pidfd[id] < 0) continue;
+            ids[n] = id;
+            fds[n++] = (struct pollfd){ a->pidfd[id], POLLIN, 0 };
+        }
+        if (poll(fds, n, -1) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+
+        // A pidfd turns readable when its process exits
+        for (nfds_t i = 1; i < n; i++) {
+            if (!fds[i].revents) continue;
+            uint32_t id = ids[i];
+            close(a->pidfd[id]);
+            a->pidfd[id] = -1;
+            if (!(atomic_load(&hdr->producers) & (1ull << id))) continue;  // Detached first
+            uint32_t freed = ring_reclaim(a->base, hdr, id);
+            atomic_fetch_and(&hdr->producers, ~(1ull << id));
+            printf("Producer %u exited attached: id and %u slot(s) reclaimed\n", id, freed);
+            fflush(stdout);
+        }
+
+        if (fds[0].revents) {
+            int conn = accept4(a->listen_fd, NULL, NULL, SOCK_CLOEXEC);
+            if (conn < 0) {
+                if (errno == EINTR || errno == ECONNABORTED || errno == EAGAIN) continue;
+                break;
+            }
+            ring_assign(a, conn);
+            close(conn);
+        }
+    }
+    for (uint32_t id = 0; id < RING_MAX_PRODUCERS; id++) {
+        if (a->pidfd[id] >= 0) close(a->pidfd[id]);
+    }
+    return NULL;
+}
+
+/*
+ * `canon ring <socket> [--slots N] [--slot-size BYTES] [--threads N]`
+ */
+int canon_ring_main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: canon ring <socket> [--slots N] [--slot-size BYTES] [--threads N]\n");
+        return 1;
+    }
+    const char *path = argv[1];
+    uint64_t nslots = RING_DEFAULT_SLOTS;
+    uint64_t slot_size = RING_DEFAULT_SLOT_SIZE;
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--slots") == 0 && i + 1 < argc) {
+            nslots = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--slot-size") == 0 && i + 1 < argc) {
+            slot_size = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threads = strtol(argv[++i], NULL, 10);
+        } else {
+            fprintf(stderr, "Error: Unknown option '%s'\n", argv[i]);
+            return 1;
+        }
+    }
+    if (nslots < 2 || (nslots & (nslots - 1)) != 0 || nslots > (1u << 20)) {
+        fprintf(stderr, "Error: --slots must be a power of two in [2, 2^20]\n");
+        return 1;
+    }
+    if (slot_size < 4096 || slot_size > UINT32_MAX) {
+        fprintf(stderr, "Error: --slot-size must be in [4096, 4GB)\n");
+        return 1;
+    }
+    slot_size = align_up(slot_size);
+    if (threads < 1) threads = 1;
+
+    sigset_t stop;
+    sigemptyset(&stop);
+    sigaddset(&stop, SIGINT);
+    sigaddset(&stop, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stop, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    int memfd;
+    uint8_t *base = ring_create((uint32_t)nslots, (uint32_t)slot_size, &memfd);
+    if (!base) return 1;
+    RingHeader *hdr = (RingHeader *)base;
+
+    struct sockaddr_un addr;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Error: Socket path too long: %s\n", path);
+        return 1;
+    }
+    struct stat st;
+    if (stat(path, &st) == 0 && S_ISSOCK(st.st_mode)) unlink(path);
+
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    if (listen_fd < 0 || bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(listen_fd, 64) < 0) {
+        perror("Error binding socket");
+        return 1;
+    }
+
+    RingWorker *workers = calloc((size_t)threads, sizeof(RingWorker));
+    long started = 0;
+    for (long i = 0; i < threads; i++) {
+        workers[started].base = base;
+        workers[started].basis = basis_init();
+        if (pthread_create(&workers[started].thread, NULL, ring_worker, &workers[started]) != 0) {
+            basis_free(workers[started].basis);
+            continue;
+        }
+        started++;
+    }
+    if (started < threads) {
+        fprintf(stderr, "Error: Cannot start ring workers (%ld of %ld running)\n", started, threads);
+    }
+    threads = started;
+    RingAcceptor acceptor = { .listen_fd = listen_fd, .memfd = memfd, .base = base };
+    for (int id = 0; id < RING_MAX_PRODUCERS; id++) acceptor.pidfd[id] = -1;
+    pthread_t acceptor_thread;
+    bool up = threads > 0 && pthread_create(&acceptor_thread, NULL, ring_acceptor, &acceptor) == 0;
+    if (threads > 0 && !up) fprintf(stderr, "Error: Cannot start the ring acceptor\n");
+
+    if (up) {
+        printf("Ring on %s: %lu slots × %lu bytes (%.1f MB shared), %ld worker(s)\n",
+               path, nslots, slot_size, hdr->region_size / 1048576.0, threads);
+        printf("Press Ctrl-C to stop\n");
+        fflush(stdout);
+
+        int sig;
+        sigwait(&stop, &sig);
+    }
+
+    atomic_store(&hdr->running, 0);
+    shutdown(listen_fd, SHUT_RDWR);
+    close(listen_fd);
+    unlink(path);
+
+    uint64_t total = 0;
+    for (long i = 0; i < threads; i++) {
+        pthread_join(workers[i].thread, NULL);
+        total += workers[i].processed;
+        basis_free(workers[i].basis);
+    }
+    free(workers);
+
+    printf("\nStopped: %lu slot(s) processed\n", total);
+    munmap(base, hdr->region_size);
+    close(memfd);
+    return up ? 0 : 1;
+}
+
+/*
+ * Producer side: receive the memfd and a producer id
+ */
+RingProducer* canon_ring_attach(const char *socket_path) {
+    int conn = canon_serve_connect(socket_path);
+    if (conn < 0) return NULL;
+
+    RingGrant grant;
+    struct iovec iov = { &grant, sizeof(grant) };
+    union {
+        char buf[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } ctrl;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = ctrl.buf;
+    msg.msg_controllen = sizeof(ctrl.buf);
+
+    ssize_t n = recvmsg(conn, &msg, MSG_CMSG_CLOEXEC);
+    close(conn);
+    if (n == (ssize_t)sizeof(grant) && grant.id >= RING_MAX_PRODUCERS) {
+        fprintf(stderr, "Error: Ring has %d producers attached\n", RING_MAX_PRODUCERS);
+        return NULL;
+    }
+    struct cmsghdr *cm = CMSG_FIRSTHDR(&msg);
+    if (n != (ssize_t)sizeof(grant) || !cm || cm->cmsg_type != SCM_RIGHTS) return NULL;
+
+    int memfd;
+    memcpy(&memfd, CMSG_DATA(cm), sizeof(int));
+
+    struct stat st;
+    if (fstat(memfd, &st) < 0 || (uint64_t)st.st_size < sizeof(RingHeader)) {
+        close(memfd);
+        return NULL;
+    }
+    uint8_t *base = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+    close(memfd);
+    if (base == MAP_FAILED) return NULL;
+
+    RingHeader *hdr = (RingHeader *)base;
+    if (hdr->magic != RING_MAGIC || hdr->region_size != (uint64_t)st.st_size) {
+        munmap(base, st.st_size);
+        return NULL;
+    }
+
+    RingProducer *p = malloc(sizeof(RingProducer));
+    p->base = base;
+    p->hdr = hdr;
+    p->id = grant.id;
+    p->gen = grant.gen;
+    return p;
+}
+
+void canon_ring_detach(RingProducer *p) {
+    if (!p) return;
+    atomic_fetch_and(&p->hdr->producers, ~(1ull << p->id));
+    munmap(p->base, p->hdr->region_size);
+    free(p);
+}
+
+uint64_t canon_ring_slot_size(const RingProducer *p) {
+    return p->hdr->slot_size;
+}
+
+/*
+ * Take a free slot; returns its payload buffer or NULL if none is free
+ */
+uint8_t* canon_ring_acquire(RingProducer *p, uint32_t *slot) {
+    uint64_t s;
+    if (!queue_pop(p->base, &p->hdr->free_q, &s)) return NULL;
+    RingSlot *rs = ring_slot(p->base, p->hdr, (uint32_t)s);
+    rs->producer = p->id;
+    rs->gen = p->gen;
+    atomic_store(&rs->state, SLOT_HELD);
+    *slot = (uint32_t)s;
+    return ring_data(p->base, p->hdr, (uint32_t)s);
+}
+
+/*
+ * Submit size payload bytes already written into the slot
+ */
+bool canon_ring_submit(RingProducer *p, uint32_t slot, uint64_t size, uint64_t tag) {
+    if (size > p->hdr->slot_size) return false;
+    RingSlot *s = ring_slot(p->base, p->hdr, slot);
+    s->size = size;
+    s->tag = tag;
+    s->producer = p->id;
+    s->gen = p->gen;
+    s->status = 0;
+    atomic_store(&s->state, SLOT_QUEUED);
+    // The submit queue has one entry per slot, so it can never be full
+    return queue_push(p->base, &p->hdr->submit_q, slot);
+}
+
+/*
+ * Non-blocking: fetch one completed slot of this producer
+ * The encoded result is in canon_ring_acquire()'s buffer for that slot.
+ */
+bool canon_ring_poll(RingProducer *p, RingResult *r) {
+    uint64_t slot;
+    RingSlot *s;
+    for (;;) {
+        if (!queue_pop(p->base, &p->hdr->done_q[p->id], &slot)) return false;
+        s = ring_slot(p->base, p->hdr, (uint32_t)slot);
+        if (s->gen == p->gen) break;
+        ring_recycle(p->base, p->hdr, (uint32_t)slot);  // An earlier holder's
+    }
+    atomic_store(&s->state, SLOT_HELD);
+    r->slot = (uint32_t)slot;
+    r->status = s->status;
+    r->rank = s->rank;
+    r->tag = s->tag;
+    r->size = s->size;
+    r->elapsed_ns = s->elapsed_ns;
+    r->data = ring_data(p->base, p->hdr, (uint32_t)slot);
+    return true;
+}
+
+/*
+ * Return a slot to the free pool once its result has been consumed
+ */
+void canon_ring_release(RingProducer *p, uint32_t slot) {
+    ring_recycle(p->base, p->hdr, slot);
+}
+
+/*
+ * `canon ring-submit <socket> <input>...`
+ * Reads each input straight into a ring slot, writes <input>.canon
+ */
+int canon_ring_submit_main(int argc, char **argv) {
+    if (argc < 3) {
+        fprintf(stderr, "Usage: canon ring-submit <socket> <input>...\n");
+        return 1;
+    }
+    RingProducer *p = canon_ring_attach(argv[1]);
+    if (!p) {
+        fprintf(stderr, "Error: Cannot attach to ring at %s\n", argv[1]);
+        return 1;
+    }
+
+    int nfiles = argc - 2;
+    int next = 0, done = 0, failed = 0;
+    uint32_t idle = 0;
+    uint64_t start = now_ns();
+
+    while (done < nfiles) {
+        bool progress = false;
+
+        // Fill as many slots as are free
+        uint32_t slot;
+        uint8_t *buf;
+        while (next < nfiles && (buf = canon_ring_acquire(p, &slot)) != NULL) {
+            const char *input = argv[2 + next];
+            int fd = open(input, O_RDONLY | O_CLOEXEC);
+            ssize_t n = -1;
+            if (fd >= 0) {
+                uint64_t got = 0;
+                while (got < canon_ring_slot_size(p) &&
+                       (n = read(fd, buf + got, canon_ring_slot_size(p) - got)) > 0) {
+                    got += (uint64_t)n;
+                }
+                char extra;
+                if (n >= 0 && got == canon_ring_slot_size(p) && read(fd, &extra, 1) > 0) n = -1;
+                if (n >= 0) n = (ssize_t)got;
+                close(fd);
+            }
+            if (n < 0) {
+                fprintf(stderr, "Error: Cannot load %s into a %lu-byte slot\n",
+                        input, canon_ring_slot_size(p));
+                canon_ring_release(p, slot);
+                failed++;
+                done++;
+            } else {
+                canon_ring_submit(p, slot, (uint64_t)n, (uint64_t)next);
+            }
+            next++;
+            progress = true;
+        }
+
+        RingResult r;
+        while (canon_ring_poll(p, &r)) {
+            if (r.tag >= (uint64_t)nfiles) {
+                fprintf(stderr, "Error: Ring returned unknown tag %lu\n", r.tag);
+                canon_ring_release(p, r.slot);
+                failed++;
+                done++;
+                progress = true;
+                continue;
+            }
+            const char *input = argv[2 + r.tag];
+            if (r.status == SERVE_STATUS_OK) {
+                char out[4096];
+                snprintf(out, sizeof(out), "%s.canon", input);
+                FILE *f = fopen(out, "wb");
+                if (f && fwrite(r.data, 1, r.size, f) == r.size) {
+                    printf("%s: rank %u, %.1f us\n", input, r.rank, r.elapsed_ns / 1000.0);
+                } else {
+                    perror("Error writing output file");
+                    failed++;
+                }
+                if (f) fclose(f);
+            } else {
+                fprintf(stderr, "Error: %s returned status %d\n", input, r.status);
+                failed++;
+            }
+            canon_ring_release(p, r.slot);
+            done++;
+            progress = true;
+        }
+
+        if (progress) {
+            idle = 0;
+        } else {
+            ring_backoff(&idle);
+        }
+    }
+
+    double sec = (now_ns() - start) / 1e9;
+    printf("✓ %d file(s) in %.3f seconds, %d failed\n", nfiles, sec, failed);
+    canon_ring_detach(p);
+    return failed ? 1 : 0;
+}
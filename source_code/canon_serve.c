@@ -0,0 +1,487 @@
+/*
+ * CANON - Resident compression daemon over a Unix domain socket
+ *
+ * Author: Francesco Pedulli
+ * Date: February 26, 2026
+ *
+ * `canon serve <socket>` keeps a pool of warm worker threads, each
+ * owning a pre-allocated GF2_Basis that is reset (not reallocated)
+ * between requests. Clients send framed requests over a persistent
+ * connection and receive the encoded basis (compress) or just the
+ * rank (estimate) back, so small payloads cost a reset plus Θ(n·r)
+ * work instead of process startup and a fresh basis_init().
+ *
+ * Connections wait in one epoll set shared by all workers (EPOLLONESHOT,
+ * so each readiness goes to exactly one worker). A worker holds a
+ * connection only while it reads, runs and answers one request, then
+ * re-arms it; idle clients therefore hold no worker and cannot starve
+ * the others.
+ *
+ * Wire format (native endianness, local socket only):
+ *   request:  ServeRequest  + size payload bytes
+ *   response: ServeResponse + body_size bytes (canon_encode output)
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <time.h>
+#include <signal.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+
+#include "canon.h"
+
+#define SERVE_MAX_PAYLOAD (1ull << 32) // Derivation positions are 32-bit
+#define SERVE_KEEP_BUFFER (16u << 20)  // Larger buffers are released after the request
+
+/*
+ * Per-thread worker state
+ * The basis lives for the lifetime of the daemon; the buffers grow with
+ * the requests and are released again above SERVE_KEEP_BUFFER.
+ */
+typedef struct {
+    int listen_fd;
+    int epoll_fd;       // Shared: the listener and every idle connection
+    pthread_t thread;
+    GF2_Basis *basis;   // Pooled context, reset per request
+    uint8_t *buf;       // Payload buffer
+    uint64_t buf_cap;
+    uint8_t *out;       // Response body buffer
+    uint64_t out_cap;
+} ServeWorker;
+
+static _Atomic uint64_t serve_requests;
+static _Atomic uint64_t serve_bytes_in;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/*
+ * Read/write exactly len bytes, retrying on EINTR and short transfers
+ */
+static bool read_full(int fd, void *buf, uint64_t len) {
+    uint8_t *p = buf;
+    while (len > 0) {
+        ssize_t n = read(fd, p, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        len -= (uint64_t)n;
+    }
+    return true;
+}
+
+static bool write_full(int fd, const void *buf, uint64_t len) {
+    const uint8_t *p = buf;
+    while (len > 0) {
+        ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        len -= (uint64_t)n;
+    }
+    return true;
+}
+
+/*
+ * Send response header and body with one writev in the common case
+ */
+static bool send_response(int fd, const ServeResponse *resp, const uint8_t *body) {
+    struct iovec iov[2] = {
+        { (void *)resp, sizeof(*resp) },
+        { (void *)body, body ? resp->body_size : 0 },
+    };
+    uint64_t total = sizeof(*resp) + iov[1].iov_len;
+
+    ssize_t n;
+    do {
+        n = writev(fd, iov, 2);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0) return false;
+    if ((uint64_t)n == total) return true;
+
+    // Short write: finish the remainder byte-wise through write_full
+    if ((uint64_t)n < sizeof(*resp)) {
+        if (!write_full(fd, (const uint8_t *)resp + n, sizeof(*resp) - n)) return false;
+        n = sizeof(*resp);
+    }
+    uint64_t done = (uint64_t)n - sizeof(*resp);
+    return write_full(fd, body + done, iov[1].iov_len - done);
+}
+
+static bool grow(uint8_t **buf, uint64_t *cap, uint64_t need) {
+    if (need <= *cap) return true;
+    uint64_t ncap = *cap ? *cap : 65536;
+    while (ncap < need) ncap *= 2;
+    uint8_t *p = realloc(*buf, ncap);
+    if (!p) return false;
+    *buf = p;
+    *cap = ncap;
+    return true;
+}
+
+/*
+ * Drop a buffer a large request left behind; the next one starts small
+ */
+static void shrink(uint8_t **buf, uint64_t *cap) {
+    if (*cap <= SERVE_KEEP_BUFFER) return;
+    free(*buf);
+    *buf = NULL;
+    *cap = 0;
+}
+
+/*
+ * Read, run and answer one request
+ * Returns false when the connection should be closed.
+ */
+static bool serve_request(ServeWorker *w, int fd) {
+    ServeRequest req;
+    if (!read_full(fd, &req, sizeof(req))) return false;
+
+    ServeResponse resp;
+    memset(&resp, 0, sizeof(resp));
+    memcpy(resp.magic, SERVE_RESPONSE_MAGIC, 4);
+    resp.input_size = req.size;
+
+    if (memcmp(req.magic, SERVE_REQUEST_MAGIC, 4) != 0) {
+        resp.status = SERVE_STATUS_BAD_REQUEST;
+        send_response(fd, &resp, NULL);
+        return false;  // Stream is out of sync, drop the connection
+    }
+    if (req.size > SERVE_MAX_PAYLOAD || !grow(&w->buf, &w->buf_cap, req.size)) {
+        resp.status = SERVE_STATUS_TOO_LARGE;
+        send_response(fd, &resp, NULL);
+        return false;  // Cannot drain the payload, drop the connection
+    }
+    if (!read_full(fd, w->buf, req.size)) return false;
+
+    uint64_t trace_start = canon_trace_clock();
+    uint64_t start = now_ns();
+    const uint8_t *body = NULL;
+
+    if (req.op == SERVE_OP_COMPRESS || req.op == SERVE_OP_ESTIMATE) {
+        basis_reset(w->basis);
+        canon_compress_block(w->basis, w->buf, req.size, 0);
+        resp.rank = w->basis->rank;
+
+        if (req.op == SERVE_OP_COMPRESS) {
+            uint64_t len = canon_encoded_size(w->basis);
+            if (grow(&w->out, &w->out_cap, len)) {
+                resp.body_size = canon_encode(w->basis, w->out);
+                body = w->out;
+            } else {
+                resp.status = SERVE_STATUS_TOO_LARGE;
+            }
+        }
+    } else {
+        resp.status = SERVE_STATUS_BAD_OP;
+    }
+
+    resp.elapsed_ns = now_ns() - start;
+    if (resp.status == SERVE_STATUS_OK) {
+        CanonMetricOp op = req.op == SERVE_OP_COMPRESS ? METRIC_COMPRESS : METRIC_ESTIMATE;
+        canon_metrics_record(op, resp.elapsed_ns, req.size, resp.body_size);
+        canon_trace_record(op, trace_start, req.size, resp.body_size, resp.rank,
+                           resp.elapsed_ns, resp.elapsed_ns);
+    }
+    atomic_fetch_add_explicit(&serve_requests, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&serve_bytes_in, req.size, memory_order_relaxed);
+
+    bool ok = send_response(fd, &resp, body);
+    shrink(&w->buf, &w->buf_cap);
+    shrink(&w->out, &w->out_cap);
+    return ok;
+}
+
+/*
+ * Re-arm fd for one more readiness event (EPOLLONESHOT)
+ */
+static bool serve_arm(ServeWorker *w, int fd, int op) {
+    struct epoll_event ev = { .events = EPOLLIN | EPOLLONESHOT, .data.fd = fd };
+    return epoll_ctl(w->epoll_fd, op, fd, &ev) == 0;
+}
+
+/*
+ * Accept every pending connection into the epoll set
+ */
+static void serve_accept(ServeWorker *w) {
+    for (;;) {
+        int fd = accept4(w->listen_fd, NULL, NULL, SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            break;  // EAGAIN: backlog drained
+        }
+        if (!serve_arm(w, fd, EPOLL_CTL_ADD)) close(fd);
+    }
+    serve_arm(w, w->listen_fd, EPOLL_CTL_MOD);
+}
+
+/*
+ * Worker loop: take one ready connection (or the listener) at a time
+ */
+static void* serve_worker(void *arg) {
+    ServeWorker *w = arg;
+
+    for (;;) {
+        struct epoll_event ev;
+        int n = epoll_wait(w->epoll_fd, &ev, 1, -1);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) break;
+        if (n == 0) continue;
+
+        int fd = ev.data.fd;
+        if (fd == w->listen_fd) {
+            serve_accept(w);
+        } else if (!serve_request(w, fd) || !serve_arm(w, fd, EPOLL_CTL_MOD)) {
+            close(fd);
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Create a listening Unix socket, replacing a stale socket file
+ */
+static int serve_listen(const char *path) {
+    struct sockaddr_un addr;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Error: Socket path too long: %s\n", path);
+        return -1;
+    }
+
+    struct stat st;
+    if (stat(path, &st) == 0 && S_ISSOCK(st.st_mode)) unlink(path);
+
+    // Non-blocking: workers drain the backlog until EAGAIN
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("Error creating socket");
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 128) < 0) {
+        perror("Error binding socket");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/*
+ * `canon serve <socket> [--threads N]`
+ */
+int canon_serve_main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: canon serve <socket> [--threads N]\n");
+        return 1;
+    }
+    const char *path = argv[1];
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threads = strtol(argv[++i], NULL, 10);
+        } else {
+            fprintf(stderr, "Error: Unknown option '%s'\n", argv[i]);
+            return 1;
+        }
+    }
+    if (threads < 1) threads = 1;
+
+    // Workers inherit this mask; only the main thread handles shutdown
+    sigset_t stop;
+    sigemptyset(&stop);
+    sigaddset(&stop, SIGINT);
+    sigaddset(&stop, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stop, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    int listen_fd = serve_listen(path);
+    if (listen_fd < 0) return 1;
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event ev = { .events = EPOLLIN | EPOLLONESHOT, .data.fd = listen_fd };
+    if (epoll_fd < 0 || epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &ev) < 0) {
+        perror("Error creating epoll set");
+        if (epoll_fd >= 0) close(epoll_fd);
+        close(listen_fd);
+        unlink(path);
+        return 1;
+    }
+
+    ServeWorker *workers = calloc((size_t)threads, sizeof(ServeWorker));
+    long started = 0;
+    for (; started < threads; started++) {
+        ServeWorker *w = &workers[started];
+        w->listen_fd = listen_fd;
+        w->epoll_fd = epoll_fd;
+        w->basis = basis_init();
+        if (pthread_create(&w->thread, NULL, serve_worker, w) != 0) {
+            basis_free(w->basis);
+            break;
+        }
+    }
+    if (started < threads) {
+        fprintf(stderr, "Error: Cannot start worker threads (%ld of %ld running)\n", started, threads);
+    }
+    if (started == 0) {
+        free(workers);
+        close(epoll_fd);
+        close(listen_fd);
+        unlink(path);
+        return 1;
+    }
+
+    printf("Serving on %s with %ld worker(s)\n", path, started);
+    printf("Press Ctrl-C to stop\n");
+    fflush(stdout);
+
+    int sig;
+    sigwait(&stop, &sig);
+
+    close(listen_fd);
+    unlink(path);
+    printf("\nStopped: %lu request(s), %lu bytes\n",
+           atomic_load(&serve_requests), atomic_load(&serve_bytes_in));
+    // Workers may be mid-request; process exit reclaims their state
+    return 0;
+}
+
+/*
+ * Client side: connect to a running daemon
+ */
+int canon_serve_connect(const char *path) {
+    struct sockaddr_un addr;
+    if (strlen(path) >= sizeof(addr.sun_path)) return -1;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/*
+ * Client side: issue one request on a connected socket
+ * On success *body holds resp->body_size bytes (caller frees).
+ */
+bool canon_serve_call(int fd, uint32_t op, const uint8_t *data, uint64_t size,
+                      ServeResponse *resp, uint8_t **body) {
+    ServeRequest req;
+    memcpy(req.magic, SERVE_REQUEST_MAGIC, 4);
+    req.op = op;
+    req.size = size;
+
+    if (!write_full(fd, &req, sizeof(req)) || !write_full(fd, data, size)) return false;
+    if (!read_full(fd, resp, sizeof(*resp))) return false;
+    if (memcmp(resp->magic, SERVE_RESPONSE_MAGIC, 4) != 0) return false;
+
+    *body = NULL;
+    if (resp->body_size > 0) {
+        *body = malloc(resp->body_size);
+        if (!*body || !read_full(fd, *body, resp->body_size)) {
+            free(*body);
+            *body = NULL;
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * `canon request <socket> <compress|estimate> <input> [output]`
+ */
+int canon_request_main(int argc, char **argv) {
+    if (argc < 4) {
+        fprintf(stderr, "Usage: canon request <socket> <compress|estimate> <input> [output]\n");
+        return 1;
+    }
+    const char *path = argv[1];
+    const char *mode = argv[2];
+    const char *input_file = argv[3];
+    const char *output_file = (argc > 4) ? argv[4] : "output.canon";
+
+    uint32_t op;
+    if (strcmp(mode, "compress") == 0) {
+        op = SERVE_OP_COMPRESS;
+    } else if (strcmp(mode, "estimate") == 0) {
+        op = SERVE_OP_ESTIMATE;
+    } else {
+        fprintf(stderr, "Error: Unknown request '%s'\n", mode);
+        return 1;
+    }
+
+    uint64_t size;
+    uint8_t *data = read_file(input_file, &size);
+    if (!data) return 1;
+
+    int fd = canon_serve_connect(path);
+    if (fd < 0) {
+        perror("Error connecting to daemon");
+        free(data);
+        return 1;
+    }
+
+    ServeResponse resp;
+    uint8_t *body;
+    uint64_t start = now_ns();
+    bool ok = canon_serve_call(fd, op, data, size, &resp, &body);
+    uint64_t round_trip = now_ns() - start;
+    close(fd);
+    free(data);
+
+    if (!ok) {
+        fprintf(stderr, "Error: Daemon connection failed\n");
+        return 1;
+    }
+    if (resp.status != SERVE_STATUS_OK) {
+        fprintf(stderr, "Error: Daemon returned status %d\n", resp.status);
+        free(body);
+        return 1;
+    }
+
+    printf("Input size:   %lu bytes\n", resp.input_size);
+    printf("Rank (GF(2)): %u\n", resp.rank);
+    printf("Server time:  %.1f us\n", resp.elapsed_ns / 1000.0);
+    printf("Round trip:   %.1f us\n", round_trip / 1000.0);
+
+    if (op == SERVE_OP_COMPRESS) {
+        FILE *f = fopen(output_file, "wb");
+        if (!f || fwrite(body, 1, resp.body_size, f) != resp.body_size) {
+            perror("Error writing output file");
+            if (f) fclose(f);
+            free(body);
+            return 1;
+        }
+        fclose(f);
+        printf("✓ Compressed file saved: %s\n", output_file);
+    }
+
+    free(body);
+    return 0;
+}
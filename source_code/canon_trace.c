@@ -0,0 +1,427 @@
+/*
+ * CANON - Workload trace capture and replay load generator
+ *
+ * Author: Francesco Pedulli
+ * Date: February 26, 2026
+ *
+ * With CANON_TRACE=<file>, every compress/decompress invocation (and
+ * every daemon request) appends one fixed-size TraceRecord to <file>
+ * with a single O_APPEND write, so concurrent jobs interleave whole
+ * records. Payload contents are never recorded.
+ *
+ * `canon replay <trace>` re-issues the recorded workload with synthetic
+ * data of matching sizes, at the recorded inter-arrival times (scaled by
+ * --speed) and a chosen concurrency, against the in-process library, a
+ * canon binary, or a running `canon serve` daemon, then reports
+ * throughput and latency percentiles.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <spawn.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "canon.h"
+
+#define TRACE_MAGIC 0x31525443u // "CTR1"
+
+extern char **environ;
+
+/*
+ * On-disk record (48 bytes, native endianness)
+ */
+typedef struct {
+    uint32_t magic;
+    uint16_t mode;         // CanonMetricOp
+    uint16_t flags;        // Reserved
+    uint64_t timestamp_ns; // CLOCK_REALTIME at start
+    uint64_t input_size;
+    uint64_t output_size;
+    uint64_t compute_ns;   // Elimination only
+    uint32_t total_us;     // Whole invocation including I/O
+    uint32_t rank;
+} TraceRecord;
+
+static int trace_fd = -1;
+
+/*
+ * Read CANON_TRACE and open the log for appending
+ */
+void canon_trace_init(void) {
+    const char *path = getenv("CANON_TRACE");
+    if (!path || !*path) return;
+
+    trace_fd = open(path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+    if (trace_fd < 0) fprintf(stderr, "Warning: Cannot open trace log %s\n", path);
+}
+
+uint64_t canon_trace_clock(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/*
+ * Append one record (no-op unless tracing is enabled)
+ */
+void canon_trace_record(CanonMetricOp mode, uint64_t start_ns, uint64_t input_size,
+                        uint64_t output_size, uint32_t rank, uint64_t compute_ns,
+                        uint64_t total_ns) {
+    if (trace_fd < 0) return;
+
+    TraceRecord r;
+    memset(&r, 0, sizeof(r));
+    r.magic = TRACE_MAGIC;
+    r.mode = (uint16_t)mode;
+    r.timestamp_ns = start_ns;
+    r.input_size = input_size;
+    r.output_size = output_size;
+    r.compute_ns = compute_ns;
+    r.total_us = total_ns / 1000 > UINT32_MAX ? UINT32_MAX : (uint32_t)(total_ns / 1000);
+    r.rank = rank;
+
+    // One write per record keeps concurrent appenders from interleaving
+    if (write(trace_fd, &r, sizeof(r)) != (ssize_t)sizeof(r)) {
+        close(trace_fd);
+        trace_fd = -1;
+    }
+}
+
+/*
+ * Replay
+ */
+typedef enum { TARGET_LIBRARY, TARGET_BINARY, TARGET_DAEMON } ReplayTarget;
+
+typedef struct {
+    TraceRecord *events;
+    uint64_t count;
+    double speed;            // 0 = as fast as possible
+    ReplayTarget target;
+    const char *binary;
+    const char *socket_path;
+    const char *tmpdir;
+    uint8_t *synthetic;      // Shared read-only payload source
+    uint64_t synthetic_size;
+    uint64_t start_ns;       // Monotonic replay epoch
+    _Atomic uint64_t next;
+    uint64_t *latency_ns;    // Per event
+    uint64_t *late_ns;       // Start slip behind schedule
+    _Atomic uint64_t failures;
+} Replay;
+
+static uint64_t mono_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void sleep_until(uint64_t deadline) {
+    struct timespec ts = {
+        (time_t)(deadline / 1000000000ull), (long)(deadline % 1000000000ull)
+    };
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {}
+}
+
+/*
+ * Synthetic corpus: either a real sample file or generated text-like
+ * bytes (xorshift over a 64-symbol alphabet)
+ */
+static uint8_t* replay_corpus(const char *sample, uint64_t need, uint64_t *size) {
+    if (sample) {
+        uint8_t *src = read_file(sample, size);
+        if (!src || *size == 0) {
+            free(src);
+            return NULL;
+        }
+        if (*size >= need) return src;
+
+        // Tile the sample so every event can take a contiguous slice
+        uint8_t *tiled = malloc(need);
+        if (!tiled) {
+            free(src);
+            return NULL;
+        }
+        for (uint64_t off = 0; off < need; off += *size) {
+            memcpy(tiled + off, src, need - off < *size ? need - off : *size);
+        }
+        free(src);
+        *size = need;
+        return tiled;
+    }
+
+    static const char alphabet[] =
+        "etaoinshrdlcumwfgypbvkjxqz ETAOINSHRDLU0123456789.,;:-_/()\n\t\"'";
+    uint8_t *buf = malloc(need ? need : 1);
+    if (!buf) return NULL;
+    uint64_t x = 0x9E3779B97F4A7C15ull;
+    for (uint64_t i = 0; i < need; i++) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        buf[i] = (uint8_t)alphabet[x & 63];
+    }
+    *size = need;
+    return buf;
+}
+
+/*
+ * Binary target: stage a synthetic input file and run `canon compress`
+ */
+static bool replay_exec(Replay *rp, const TraceRecord *e, uint64_t idx) {
+    char input[4096], output[4096];
+    snprintf(input, sizeof(input), "%s/replay-%d-%lu.in", rp->tmpdir, (int)getpid(), idx);
+    snprintf(output, sizeof(output), "%s/replay-%d-%lu.canon", rp->tmpdir, (int)getpid(), idx);
+
+    int fd = open(input, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) return false;
+    bool ok = write(fd, rp->synthetic, e->input_size) == (ssize_t)e->input_size;
+    close(fd);
+
+    if (ok) {
+        // Decompress records replay as a compress of the same size
+        char *args[] = { (char *)rp->binary, "compress", input, output, NULL };
+        posix_spawn_file_actions_t fa;
+        posix_spawn_file_actions_init(&fa);
+        posix_spawn_file_actions_addopen(&fa, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+        posix_spawn_file_actions_addopen(&fa, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+
+        pid_t pid;
+        int status = 0;
+        ok = posix_spawn(&pid, rp->binary, &fa, NULL, args, environ) == 0 &&
+             waitpid(pid, &status, 0) == pid && WIFEXITED(status) &&
+             WEXITSTATUS(status) == 0;
+        posix_spawn_file_actions_destroy(&fa);
+    }
+    unlink(input);
+    unlink(output);
+    return ok;
+}
+
+static void* replay_worker(void *arg) {
+    Replay *rp = arg;
+    GF2_Basis *B = basis_init();
+    int conn = -1;
+
+    if (rp->target == TARGET_DAEMON) {
+        conn = canon_serve_connect(rp->socket_path);
+        if (conn < 0) fprintf(stderr, "Error: Cannot connect to %s\n", rp->socket_path);
+    }
+
+    for (;;) {
+        uint64_t i = atomic_fetch_add(&rp->next, 1);
+        if (i >= rp->count) break;
+        const TraceRecord *e = &rp->events[i];
+
+        uint64_t due = rp->start_ns;
+        if (rp->speed > 0) {
+            due += (uint64_t)((e->timestamp_ns - rp->events[0].timestamp_ns) / rp->speed);
+            sleep_until(due);
+        }
+
+        uint64_t t0 = mono_ns();
+        rp->late_ns[i] = t0 > due ? t0 - due : 0;
+        bool ok = true;
+
+        switch (rp->target) {
+        case TARGET_LIBRARY:
+            if (e->mode == METRIC_DECOMPRESS) {
+                // Reconstruct the recorded output size from a basis of the
+                // recorded rank, its positions spread over the output
+                basis_reset(B);
+                B->rank = e->rank < MAX_RANK ? e->rank : MAX_RANK;
+                memcpy(B->basis, rp->synthetic, B->rank);
+                B->input_size = e->output_size > B->rank ? e->output_size : B->rank;
+                // Positions are 32-bit, like those of a real derivation map
+                uint64_t span = B->input_size < (1ull << 32) ? B->input_size : 1ull << 32;
+                uint64_t spacing = B->rank ? span / B->rank : 1;
+                for (uint32_t k = 0; k < B->rank; k++) B->derivation[k] = (uint32_t)(k * spacing);
+                uint64_t out_size;
+                free(canon_decompress(B, &out_size));
+            } else {
+                basis_reset(B);
+                canon_compress_block(B, rp->synthetic, e->input_size, 0);
+                if (e->mode == METRIC_COMPRESS) {
+                    uint8_t *enc = malloc(canon_encoded_size(B));
+                    if (enc) canon_encode(B, enc);
+                    free(enc);
+                }
+            }
+            break;
+        case TARGET_BINARY:
+            ok = replay_exec(rp, e, i);
+            break;
+        case TARGET_DAEMON: {
+            ServeResponse resp;
+            uint8_t *body = NULL;
+            uint32_t op = e->mode == METRIC_ESTIMATE ? SERVE_OP_ESTIMATE : SERVE_OP_COMPRESS;
+            ok = conn >= 0 && canon_serve_call(conn, op, rp->synthetic, e->input_size,
+                                               &resp, &body) &&
+                 resp.status == SERVE_STATUS_OK;
+            free(body);
+            break;
+        }
+        }
+
+        rp->latency_ns[i] = mono_ns() - t0;
+        if (!ok) atomic_fetch_add(&rp->failures, 1);
+    }
+
+    if (conn >= 0) close(conn);
+    basis_free(B);
+    return NULL;
+}
+
+static int by_timestamp(const void *a, const void *b) {
+    uint64_t x = ((const TraceRecord *)a)->timestamp_ns;
+    uint64_t y = ((const TraceRecord *)b)->timestamp_ns;
+    return (x > y) - (x < y);
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void print_distribution(const char *label, uint64_t *v, uint64_t n) {
+    qsort(v, n, sizeof(uint64_t), cmp_u64);
+    printf("%-12s p50 %.1f us, p90 %.1f us, p99 %.1f us, p999 %.1f us, max %.1f us\n",
+           label, v[n / 2] / 1000.0, v[(n * 90) / 100] / 1000.0,
+           v[(n * 99) / 100] / 1000.0, v[(n * 999) / 1000] / 1000.0, v[n - 1] / 1000.0);
+}
+
+/*
+ * `canon replay <trace> [--speed X] [--concurrency N] [--sample FILE]
+ *                       [--binary PATH | --socket PATH]`
+ */
+int canon_replay_main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: canon replay <trace> [--speed X] [--concurrency N] "
+                        "[--sample FILE] [--binary PATH | --socket PATH]\n");
+        return 1;
+    }
+
+    Replay rp;
+    memset(&rp, 0, sizeof(rp));
+    rp.speed = 1.0;
+    rp.target = TARGET_LIBRARY;
+    rp.tmpdir = getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp";
+    long concurrency = 1;
+    const char *sample = NULL;
+
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--speed") == 0 && i + 1 < argc) {
+            rp.speed = strtod(argv[++i], NULL);
+        } else if (strcmp(argv[i], "--concurrency") == 0 && i + 1 < argc) {
+            concurrency = strtol(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--sample") == 0 && i + 1 < argc) {
+            sample = argv[++i];
+        } else if (strcmp(argv[i], "--binary") == 0 && i + 1 < argc) {
+            rp.target = TARGET_BINARY;
+            rp.binary = argv[++i];
+        } else if (strcmp(argv[i], "--socket") == 0 && i + 1 < argc) {
+            rp.target = TARGET_DAEMON;
+            rp.socket_path = argv[++i];
+        } else {
+            fprintf(stderr, "Error: Unknown option '%s'\n", argv[i]);
+            return 1;
+        }
+    }
+    if (concurrency < 1) concurrency = 1;
+    if (rp.speed < 0) rp.speed = 0;
+
+    // Load and validate the trace
+    uint64_t bytes;
+    uint8_t *raw = read_file(argv[1], &bytes);
+    if (!raw) return 1;
+    rp.events = (TraceRecord *)raw;
+    rp.count = bytes / sizeof(TraceRecord);
+    for (uint64_t i = 0; i < rp.count; i++) {
+        if (rp.events[i].magic != TRACE_MAGIC || rp.events[i].mode >= METRIC_OP_COUNT) {
+            fprintf(stderr, "Error: Corrupt trace record %lu\n", i);
+            free(raw);
+            return 1;
+        }
+    }
+    if (rp.count == 0) {
+        fprintf(stderr, "Error: Trace is empty\n");
+        free(raw);
+        return 1;
+    }
+
+    uint64_t max_size = 0, total_in = 0, first = UINT64_MAX, last = 0;
+    for (uint64_t i = 0; i < rp.count; i++) {
+        const TraceRecord *e = &rp.events[i];
+        if (e->input_size > max_size) max_size = e->input_size;
+        total_in += e->input_size;
+        if (e->timestamp_ns < first) first = e->timestamp_ns;
+        if (e->timestamp_ns > last) last = e->timestamp_ns;
+    }
+    // Records from concurrent jobs are appended in completion order
+    qsort(rp.events, rp.count, sizeof(TraceRecord), by_timestamp);
+
+    rp.synthetic = replay_corpus(sample, max_size > MAX_RANK ? max_size : MAX_RANK,
+                                 &rp.synthetic_size);
+    rp.latency_ns = calloc(rp.count, sizeof(uint64_t));
+    rp.late_ns = calloc(rp.count, sizeof(uint64_t));
+    if (!rp.synthetic || !rp.latency_ns || !rp.late_ns) {
+        fprintf(stderr, "Error: Out of memory\n");
+        return 1;
+    }
+
+    printf("Trace:        %lu event(s), %.2f MB input, %.3f s recorded span\n",
+           rp.count, total_in / 1048576.0, (last - first) / 1e9);
+    char speed[32];
+    if (rp.speed > 0) snprintf(speed, sizeof(speed), "×%g", rp.speed);
+    else snprintf(speed, sizeof(speed), "unthrottled");
+    printf("Replay:       %s, speed %s, concurrency %ld\n",
+           rp.target == TARGET_LIBRARY ? "library" :
+           rp.target == TARGET_BINARY ? rp.binary : rp.socket_path,
+           speed, concurrency);
+    fflush(stdout);
+
+    pthread_t *threads = calloc((size_t)concurrency, sizeof(pthread_t));
+    rp.start_ns = mono_ns();
+    long started = 0;
+    while (started < concurrency && pthread_create(&threads[started], NULL, replay_worker, &rp) == 0) {
+        started++;
+    }
+    if (started < concurrency) {
+        fprintf(stderr, "Error: Cannot start replay threads (%ld of %ld running)\n", started, concurrency);
+    }
+    if (started == 0) {
+        free(threads);
+        free(rp.latency_ns);
+        free(rp.late_ns);
+        free(rp.synthetic);
+        free(raw);
+        return 1;
+    }
+    for (long i = 0; i < started; i++) pthread_join(threads[i], NULL);
+    double sec = (mono_ns() - rp.start_ns) / 1e9;
+
+    printf("Time Taken:   %.3f seconds\n", sec);
+    printf("Throughput:   %.1f ops/s, %.2f MB/s\n",
+           rp.count / sec, (total_in / 1048576.0) / sec);
+    print_distribution("Latency:", rp.latency_ns, rp.count);
+    if (rp.speed > 0) print_distribution("Start slip:", rp.late_ns, rp.count);
+    printf("Failures:     %lu\n", atomic_load(&rp.failures));
+
+    free(threads);
+    free(rp.latency_ns);
+    free(rp.late_ns);
+    free(rp.synthetic);
+    free(raw);
+    return atomic_load(&rp.failures) ? 1 : 0;
+}